@@ -9,6 +9,7 @@ hints
     | join_prefix_hint
     | operator_hint
     | cardinality_hint
+    | cardinality_scale_hint
     | cost_hint
     | guc_hint
     ;
@@ -25,6 +26,7 @@ setting_list
 setting
     : plan_mode_setting
     | parallelization_setting
+    | plan_cache_setting
     ;
 
 plan_mode_setting
@@ -35,6 +37,10 @@ parallelization_setting
     : PARMODE EQ (DEFAULT | SEQUENTIAL | PARALLEL)
     ;
 
+plan_cache_setting
+    : PLANCACHE EQ (DEFAULT | GENERIC | CUSTOM)
+    ;
+
 join_order_hint
     : JOINORDER LPAREN join_order_entry RPAREN
     ;
@@ -59,6 +65,7 @@ intermediate_join_order
 operator_hint
     : join_op_hint
     | scan_op_hint
+    | cost_op_hint
     | result_hint
     ;
 
@@ -70,6 +77,10 @@ scan_op_hint
     : (SEQSCAN | IDXSCAN | BITMAPSCAN | MEMOIZE | MATERIALIZE) LPAREN relation_id param_list? RPAREN
     ;
 
+cost_op_hint
+    : (SORT | INCSORT | GATHER | GATHERMERGE | APPEND) LPAREN relation_id+ param_list? RPAREN
+    ;
+
 result_hint
     : RESULT LPAREN parallel_hint RPAREN
     ;
@@ -78,6 +89,10 @@ cardinality_hint
     : CARD LPAREN relation_id+ HASH INT RPAREN
     ;
 
+cardinality_scale_hint
+    : CARDSCALE LPAREN relation_id+ HASH (FLOAT | INT) RPAREN
+    ;
+
 param_list
     : LPAREN (forced_hint | cost_hint | parallel_hint)+ RPAREN
     ;
@@ -100,6 +115,17 @@ binary_rel_id
 
 relation_id
     : IDENTIFIER
+    | keyword
+    ;
+
+// Keywords are only reserved where the grammar expects them. Relation names and aliases may still use them.
+keyword
+    : DEFAULT | CONFIG | PLANMODE | FULL | ANCHORED | PARMODE | SEQUENTIAL | PARALLEL
+    | PLANCACHE | GENERIC | CUSTOM | SET
+    | JOINORDER | JOINPREFIX | CARD | CARDSCALE
+    | NESTLOOP | MERGEJOIN | HASHJOIN | SEQSCAN | IDXSCAN | BITMAPSCAN | MEMOIZE | MATERIALIZE
+    | SORT | INCSORT | GATHER | GATHERMERGE | APPEND | RESULT
+    | COST | STARTUP | TOTAL | WORKERS | FORCED
     ;
 
 cost
@@ -146,6 +172,9 @@ ANCHORED    : 'anchored'    ;
 PARMODE     : 'exec_mode'   ;
 SEQUENTIAL  : 'sequential'  ;
 PARALLEL    : 'parallel'    ;
+PLANCACHE   : 'plan_cache'  ;
+GENERIC     : 'generic'     ;
+CUSTOM      : 'custom'      ;
 SET         : 'Set'         ;
 
 
@@ -153,6 +182,7 @@ SET         : 'Set'         ;
 JOINORDER   : 'JoinOrder'   ;
 JOINPREFIX  : 'JoinPrefix'  ;
 CARD        : 'Card'        ;
+CARDSCALE   : 'CardScale'   ;
 
 // Operators
 NESTLOOP    : 'NestLoop'    ;
@@ -163,6 +193,11 @@ IDXSCAN     : 'IdxScan'     ;
 BITMAPSCAN  : 'BitmapScan'  ;
 MEMOIZE     : 'Memo'        ;
 MATERIALIZE : 'Material'    ;
+SORT        : 'Sort'        ;
+INCSORT     : 'IncrementalSort' ;
+GATHER      : 'Gather'      ;
+GATHERMERGE : 'GatherMerge' ;
+APPEND      : 'Append'      ;
 RESULT      : 'Result'      ;
 
 // Operator parameters
@@ -0,0 +1,38 @@
+
+#ifndef CARD_FEEDBACK_H
+#define CARD_FEEDBACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "executor/execdesc.h"
+#include "nodes/pathnodes.h"
+
+/* Sets up the GUCs and shared memory for the cardinality feedback. Must be called from _PG_init(). */
+extern void init_card_feedback(void);
+
+/*
+ * Checks whether the planner run of a specific query should use the cardinality feedback. This is only the case for the
+ * top-level query, since the relids of subqueries do not match the range table of the final plan.
+ */
+extern bool card_feedback_applicable(PlannerInfo *root);
+
+/*
+ * Fetches the actual cardinality of an intermediate from previous executions of the same query. Returns NAN if the
+ * intermediate has not been observed yet.
+ */
+extern double card_feedback_lookup(PlannerInfo *root, RelOptInfo *rel);
+
+/*
+ * Stores the actual cardinalities of all scans and joins of an instrumented query. Must be called before the plan state
+ * is shut down in ExecutorEnd.
+ */
+extern void card_feedback_record(QueryDesc *queryDesc);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // CARD_FEEDBACK_H
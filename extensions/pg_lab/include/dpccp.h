@@ -0,0 +1,36 @@
+
+#ifndef DPCCP_H
+#define DPCCP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "nodes/pathnodes.h"
+
+typedef enum JoinEnumerator
+{
+    JOIN_ENUMERATOR_STANDARD,   /* Postgres' own policies, i.e. standard_join_search() or GEQO */
+    JOIN_ENUMERATOR_DPCCP
+} JoinEnumerator;
+
+/* Join enumerator settings */
+extern int pglab_join_enumerator;
+
+/* Maximum number of relations that the DPccp enumerator can handle (one bit per relation) */
+#define DPCCP_MAX_RELS 64
+
+/*
+ * Maximum number of csg-cmp pairs that the DPccp enumerator materializes (16 bytes each). Join graphs with more pairs (e.g.
+ * large stars or cliques) are left to the standard join search or GEQO.
+ */
+#define DPCCP_MAX_PAIRS (1 << 22)
+
+extern RelOptInfo *dpccp_join_search(PlannerInfo *root, int levels_needed, List *initial_rels);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // DPCCP_H
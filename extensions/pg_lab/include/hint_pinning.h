@@ -0,0 +1,24 @@
+
+#ifndef HINT_PINNING_H
+#define HINT_PINNING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+
+/* Sets up the GUCs and shared memory for the pinned hint blocks. Must be called from _PG_init(). */
+extern void init_hint_pinning(void);
+
+/*
+ * Fetches the hint block that is pinned to a query in the current database. The hint block is allocated in the current
+ * memory context. Returns NULL if no hint block is pinned.
+ */
+extern char *fetch_pinned_hints(uint64 queryid);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // HINT_PINNING_H
@@ -55,6 +55,14 @@ typedef enum ParallelMode
     PARMODE_PARALLEL
 } ParallelMode;
 
+/* Plan caching of prepared statements, see Config(plan_cache=...) */
+typedef enum HintPlanCacheMode
+{
+    PLANCACHE_DEFAULT,
+    PLANCACHE_GENERIC,
+    PLANCACHE_CUSTOM
+} HintPlanCacheMode;
+
 
 typedef enum HintTag
 {
@@ -73,9 +81,18 @@ typedef enum PhysicalOperator
     OP_HASHJOIN,
     OP_MERGEJOIN,
     OP_MEMOIZE,
-    OP_MATERIALIZE
+    OP_MATERIALIZE,
+
+    /* The following operators can only be used for cost hints */
+    OP_SORT,
+    OP_INCSORT,
+    OP_GATHER,
+    OP_GATHERMERGE,
+    OP_APPEND
 } PhysicalOperator;
 
+#define IsCostOnlyOperator(op) ((op) >= OP_SORT)
+
 extern const char *PhysicalOperatorToString(PhysicalOperator op);
 
 typedef struct OperatorHint
@@ -89,6 +106,33 @@ typedef struct OperatorHint
     float parallel_workers;
 } OperatorHint;
 
+/*
+ * Contiguous representation of a join order tree, see compile_join_order().
+ *
+ * Nodes are stored in post-order, i.e. children always precede their parent and the root node is the last node of the
+ * array. As a consequence, each subtree occupies a contiguous range of the array that ends with the subtree's root.
+ */
+typedef struct FlatJoinOrderNode
+{
+    HintTag    node_type;
+    int        outer_child;     /* index of the outer child, -1 for base rels */
+    int        inner_child;     /* index of the inner child, -1 for base rels */
+    int        parent;          /* index of the parent node, -1 for the root node */
+    int        subtree_start;   /* index of the first node of the subtree rooted at this node */
+    int        level;
+    int        depth;           /* distance to the root node */
+    Index      rt_index;        /* only set for base rels */
+    bitmapword relids_word;     /* only set if the join order uses inline relids */
+    struct JoinOrder *node;     /* the corresponding node of the tree representation */
+} FlatJoinOrderNode;
+
+typedef struct FlatJoinOrder
+{
+    int  n_nodes;
+    bool inline_relids;  /* whether all relids fit into a single bitmapword */
+    FlatJoinOrderNode nodes[FLEXIBLE_ARRAY_MEMBER];
+} FlatJoinOrder;
+
 typedef struct JoinOrder
 {
     HintTag node_type;
@@ -106,6 +150,11 @@ typedef struct JoinOrder
     int           level;
     OperatorHint *physical_op;
     JoinOrder    *parent_node; /* NULL for root node */
+
+    /* Set by compile_join_order() */
+    struct HTAB   *node_lookup; /* Maps relids to the nodes of the entire tree, shared by all nodes */
+    FlatJoinOrder *flat;        /* Contiguous representation of the entire tree, shared by all nodes */
+    int            flat_index;  /* Index of this node in the contiguous representation */
 } JoinOrder;
 
 typedef enum JoinOrder_Comparison
@@ -117,18 +166,33 @@ typedef enum JoinOrder_Comparison
 
 #define IsRootNode(join_order) ((join_order)->parent_node == NULL)
 
+typedef struct JoinOrderLookupEntry
+{
+    Relids     relids;  /* hash key */
+    JoinOrder *node;
+} JoinOrderLookupEntry;
+
+extern void compile_join_order(JoinOrder *join_order);
+extern bool flat_join_order_relids_equal(FlatJoinOrder *join_order, int node_index, Relids relids);
 extern JoinOrder* traverse_join_order(JoinOrder *join_order, Relids node);
 extern JoinOrder_Comparison join_order_compare(JoinOrder *prefix, Path *path, Relids all_rels);
 extern bool is_linear_join_order(JoinOrder *join_order);
 extern void free_join_order(JoinOrder *join_order);
 
+/*
+ * Iterates over the levels of a join order, starting with the base rels. Each step provides the nodes of the next level.
+ */
 typedef struct JoinOrderIterator
 {
-    bool       done;
-    List      *current_nodes;
-    Bitmapset *current_relids;
+    bool           done;
+    FlatJoinOrder *join_order;
+    int           *current_nodes;  /* indexes into join_order->nodes */
+    int            n_current;
+    bool          *selected;       /* scratch space to de-duplicate the parent nodes */
 } JoinOrderIterator;
 
+#define joinorder_it_node(iterator, i) (&(iterator)->join_order->nodes[(iterator)->current_nodes[i]])
+
 extern void joinorder_it_init(JoinOrderIterator *iterator, JoinOrder *join_order);
 extern void joinorder_it_next(JoinOrderIterator *iterator);
 extern void joinorder_it_free(JoinOrderIterator *iterator);
@@ -141,6 +205,17 @@ typedef struct CardinalityHint
     Cardinality card;
 } CardinalityHint;
 
+/*
+ * A correction factor for the native cardinality estimate of an intermediate, see CardScale hints.
+ *
+ * The factor applies to the intermediate itself as well as to all of its supersets.
+ */
+typedef struct CardinalityScaleHint
+{
+    Relids relids;
+    double factor;
+} CardinalityScaleHint;
+
 typedef struct ScanCost
 {
     Cost seqscan_startup;
@@ -161,6 +236,29 @@ typedef struct JoinCost
     Cost merge_total;
 } JoinCost;
 
+/*
+ * Costs of operators that can be placed on top of base rels as well as join rels. For Memoize, these are the rescan
+ * costs. Sort, IncrementalSort and Append costs are applied to the path nodes once they are added to their relation,
+ * see apply_path_cost_hint().
+ */
+typedef struct IntermediateCost
+{
+    Cost sort_startup;
+    Cost sort_total;
+    Cost incsort_startup;
+    Cost incsort_total;
+    Cost material_startup;
+    Cost material_total;
+    Cost memoize_startup;
+    Cost memoize_total;
+    Cost gather_startup;
+    Cost gather_total;
+    Cost gathermerge_startup;
+    Cost gathermerge_total;
+    Cost append_startup;
+    Cost append_total;
+} IntermediateCost;
+
 typedef struct CostHint
 {
     Relids  relids;
@@ -171,8 +269,96 @@ typedef struct CostHint
         ScanCost scan_cost;
         JoinCost join_cost;
     } costs;
+
+    IntermediateCost intermediate_costs;
 } CostHint;
 
+/*
+ * Hint blocks are processed in two phases: first, the raw hint text is parsed into a HintBlockSpec. This representation
+ * only contains the syntactic information of the hint block, i.e. relations are still referenced by name. Afterwards,
+ * the spec is bound against the PlannerInfo of the current query to create the actual PlannerHints.
+ *
+ * Since the spec does not depend on the current query, it can be cached and re-used for multiple queries that share the
+ * same hint block.
+ */
+
+typedef enum HintSpecTag
+{
+    HS_PLAN_MODE,
+    HS_PARALLEL_MODE,
+    HS_PLAN_CACHE_MODE,
+    HS_JOIN_ORDER,
+    HS_JOIN_PREFIX,
+    HS_OPERATOR,
+    HS_RESULT,
+    HS_CARDINALITY,
+    HS_CARDINALITY_SCALE,
+    HS_GUC
+} HintSpecTag;
+
+typedef struct JoinOrderSpec
+{
+    HintTag node_type;
+
+    /* Only set for base rels */
+    char *relname;
+
+    /* Only set for join rels */
+    struct JoinOrderSpec *outer_child;
+    struct JoinOrderSpec *inner_child;
+} JoinOrderSpec;
+
+typedef struct HintSpec
+{
+    HintSpecTag tag;
+
+    /* Config hints */
+    HintMode          mode;
+    ParallelMode      parallel_mode;
+    HintPlanCacheMode plan_cache_mode;
+
+    /* JoinOrder and JoinPrefix hints */
+    JoinOrderSpec *join_order;
+
+    /* Operator, Result, Card and CardScale hints */
+    List            *relnames;
+    PhysicalOperator op;
+    float            parallel_workers; /* NAN if not specified */
+    bool             has_cost;
+    Cost             startup_cost;
+    Cost             total_cost;
+    Cardinality      card;
+    double           scale_factor;
+
+    /* Set hints */
+    char *guc_name;
+    char *guc_value;
+} HintSpec;
+
+typedef struct HintBlockSpec
+{
+    List *hints; /* HintSpec entries in the order in which they appear in the hint block */
+} HintBlockSpec;
+
+extern HintSpec *MakeHintSpec(HintSpecTag tag);
+extern JoinOrderSpec *MakeJoinOrderSpecBase(const char *relname);
+extern JoinOrderSpec *MakeJoinOrderSpecIntermediate(JoinOrderSpec *outer_child, JoinOrderSpec *inner_child);
+
+typedef enum HintParserType
+{
+    HINT_PARSER_ANTLR,
+    HINT_PARSER_NATIVE
+} HintParserType;
+
+/* Hint parser settings */
+extern int pglab_hint_parser;
+extern int pglab_hint_cache_size;
+
+extern HintBlockSpec *antlr_parse_hint_text(const char *hint_text);
+extern HintBlockSpec *native_parse_hint_text(const char *hint_text);
+extern HintBlockSpec *parse_hint_text(const char *hint_text);
+extern HintBlockSpec *fetch_hint_block_spec(const char *hint_text);
+
 typedef struct PlannerHints
 {
     char *raw_query;
@@ -193,8 +379,17 @@ typedef struct PlannerHints
 
     struct HTAB *cardinality_hints;
 
+    List *cardinality_scales; /* CardinalityScaleHint entries */
+
     struct HTAB *cost_hints;
 
+    /*
+     * Summary of the cost hints that allows the cost hooks to skip the lookup (and building the relids of joins) for
+     * intermediates that cannot have a cost hint: the union of all hinted relids and the sizes of the hinted intermediates.
+     */
+    Relids cost_hint_rels;
+    Bitmapset *cost_hint_sizes;
+
     Relids parallel_rels;
 
     int parallel_workers;
@@ -203,12 +398,23 @@ typedef struct PlannerHints
 
     List *temp_gucs;
 
+    struct HTAB *alias_lookup;  /* Maps relation aliases to their range table index, see build_alias_lookup() */
+
+    struct HTAB *path_verdicts; /* Memoized hint checks per path shape. This is maintained by the planner hooks. */
+
+    struct ModelEstimator *estimator; /* External estimator for the current query, NULL if disabled */
+
+    bool card_feedback; /* Whether the actual cardinalities of previous executions should be used */
+
 } PlannerHints;
 
 
 extern PlannerHints* init_hints(const char *raw_query);
 extern void free_hints(PlannerHints *hints);
 extern void parse_hint_block(PlannerInfo *root, PlannerHints *hints);
+extern HintPlanCacheMode fetch_plan_cache_hint(const char *query_string);
+extern void bind_hint_block(PlannerInfo *root, PlannerHints *hints, HintBlockSpec *spec);
+extern void build_alias_lookup(PlannerInfo *root, PlannerHints *hints);
 extern void post_process_hint_block(PlannerHints *hints);
 
 extern void MakeOperatorHint(PlannerInfo *root, PlannerHints *hints, List *rels,
@@ -217,12 +423,31 @@ extern void MakeIntermediateOpHint(PlannerInfo *root, PlannerHints *hints, List
                                    bool materialize, bool memoize, float par_workers);
 
 extern void MakeCardHint(PlannerInfo *root, PlannerHints *hints, List *rels, Cardinality card);
+extern void MakeCardScaleHint(PlannerInfo *root, PlannerHints *hints, List *rels, double factor);
+extern double cardinality_scale_factor(PlannerHints *hints, Relids relids, Relids outer_relids, Relids inner_relids);
+
+/*
+ * Cardinalities that have been supplied via pg_lab_set_cardinalities() for the next planned query.
+ */
+typedef struct BulkCardinalities
+{
+    MemoryContext context;    /* owns the struct and all of its arrays */
+    int           n_entries;
+    int          *offsets;    /* entry i references relnames[offsets[i]] up to relnames[offsets[i + 1] - 1] */
+    char        **relnames;
+    Cardinality  *cards;
+} BulkCardinalities;
+
+extern BulkCardinalities *consume_bulk_cardinalities(void);
+extern void bind_bulk_cardinalities(PlannerInfo *root, PlannerHints *hints, BulkCardinalities *bulk);
 
 extern void MakeCostHint(PlannerInfo *root, PlannerHints *hints, List *rels,
                          PhysicalOperator op, Cost startup_cost, Cost total_cost);
+extern void InitCostHint(CostHint *cost_hint, bool baserel);
+extern void StoreCostHint(CostHint *cost_hint, PhysicalOperator op, Cost startup_cost, Cost total_cost);
 
 extern JoinOrder* MakeJoinOrderIntermediate(PlannerInfo *root, JoinOrder *outer_child, JoinOrder *inner_child);
-extern JoinOrder* MakeJoinOrderBase(PlannerInfo *root, const char *relname);
+extern JoinOrder* MakeJoinOrderBase(PlannerInfo *root, PlannerHints *hints, const char *relname);
 
 extern TempGUC* MakeGUCHint(PlannerHints *hints, const char *guc_name, const char *guc_value);
 
@@ -0,0 +1,74 @@
+
+#ifndef MODEL_ESTIMATOR_H
+#define MODEL_ESTIMATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "nodes/pathnodes.h"
+
+#include "hints.h"
+
+/*
+ * The estimates of the external estimator for a single intermediate.
+ */
+typedef struct ModelEstimate
+{
+    Relids      relids;     /* hash key */
+    Cardinality rows;       /* NAN if the estimator did not provide a cardinality */
+    bool        has_costs;
+    CostHint    costs;      /* only valid if has_costs is set */
+
+    /*
+     * For intermediates of a join level batch: the intermediate of the previous level (outer_rel) that is extended by a
+     * base rel (inner_rel). outer_rel is NULL if it has not been built by the planner. Both are NULL for base rels and for
+     * intermediates that are requested on their own.
+     */
+    RelOptInfo *outer_rel;
+    RelOptInfo *inner_rel;
+} ModelEstimate;
+
+typedef struct ModelEstimator ModelEstimator;
+
+/*
+ * In-process alternative to the estimator socket.
+ *
+ * The hook receives all intermediates of a join level at once, before any of their paths are costed. It should set the
+ * rows of each estimate (or leave them at NAN to keep the native estimate). Since pg_lab is not linked against other
+ * extensions, the hook is installed via a rendezvous variable:
+ *
+ *   pglab_batch_estimates_hook_type *hook;
+ *   hook = (pglab_batch_estimates_hook_type *) find_rendezvous_variable(PGLAB_BATCH_ESTIMATES_HOOK);
+ *   *hook = my_batch_estimates;
+ *
+ * If the hook is set, it takes precedence over pglab.estimator_socket.
+ */
+typedef void (*pglab_batch_estimates_hook_type) (PlannerInfo *root, int level,
+                                                 ModelEstimate **estimates, int n_estimates);
+
+#define PGLAB_BATCH_ESTIMATES_HOOK "pg_lab_batch_estimates_hook"
+
+/* Sets up the GUCs of the external estimator. Must be called from _PG_init(). */
+extern void init_model_estimator(void);
+
+/*
+ * Prepares the external estimator for the current planner run. Returns NULL if neither an estimator socket nor a batch
+ * estimates hook is configured.
+ *
+ * All state is allocated in the current memory context.
+ */
+extern ModelEstimator *model_estimator_begin(PlannerInfo *root, const char *query_string);
+
+/*
+ * Provides the estimates for a specific intermediate. Outer joins in the relids are ignored. Returns NULL if the estimator
+ * does not know the intermediate, if it cannot be reached, or if the relids do not belong to the estimator's planner run.
+ */
+extern ModelEstimate *model_estimator_fetch(ModelEstimator *estimator, Relids relids);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // MODEL_ESTIMATOR_H
@@ -0,0 +1,27 @@
+
+#ifndef PLAN_CAPTURE_H
+#define PLAN_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "nodes/pathnodes.h"
+
+/* Plan capture settings */
+extern bool pglab_capture_plan;
+
+/* Sets up the GUCs and the EXPLAIN integration of the plan capture. Must be called from _PG_init(). */
+extern void init_plan_capture(void);
+
+/* Whether the final path of the current query should be captured, either due to the GUC or due to an EXPLAIN option. */
+extern bool plan_capture_requested(void);
+
+extern void capture_plan_hints(PlannerInfo *root, Path *best_path);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PLAN_CAPTURE_H
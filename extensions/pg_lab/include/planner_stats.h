@@ -0,0 +1,84 @@
+
+#ifndef PLANNER_STATS_H
+#define PLANNER_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "portability/instr_time.h"
+
+/*
+ * Instrumentation of a single planner run. The statistics of the most recent planner runs of each backend are exposed
+ * through the pg_lab_planner_stats() function.
+ */
+typedef struct PlannerStats
+{
+    int64 statement_no;
+    char *query;
+    bool  contains_hint;
+    bool  toplevel;             /* whether this is the outermost planner run */
+
+    instr_time start_time;
+    instr_time planning_time;
+    instr_time parse_time;      /* time spent to parse and bind the hint block */
+    instr_time check_time;      /* time spent in check_path_recursive() */
+
+    int64 add_path_calls;
+    int64 add_partial_path_calls;
+    int64 accepted_paths;
+
+    /* rejected paths, by the first check that failed */
+    int64 rejected_children;
+    int64 rejected_prefix;
+    int64 rejected_join_order;
+    int64 rejected_operators;
+    int64 rejected_parallel;
+
+    int64 memoized_verdicts;    /* hint checks that were answered by the path shape memo */
+} PlannerStats;
+
+/* Whether the statistics of each planner run are recorded in the per-backend history (pglab.track_planner_stats). */
+extern bool pglab_track_planner_stats;
+
+/* The statistics of the planner run that is currently active in this backend (if any). */
+extern PlannerStats *current_planner_stats;
+
+/* Sets up the GUCs and the EXPLAIN integration of the planner statistics. Must be called from _PG_init(). */
+extern void init_planner_stats(void);
+
+extern PlannerStats *planner_stats_begin(const char *query_string, bool toplevel);
+extern void planner_stats_end(PlannerStats *stats);
+extern double planner_stats_elapsed(PlannerStats *stats);
+
+/* Shared statistics per hint block, see hint_stats.cc */
+extern void init_hint_stats(void);
+extern bool hint_stats_enabled(void);
+extern void hint_stats_record(const char *hint_text, double plan_time, bool check_failed, bool fallback);
+
+#define PlannerStatsCount(field) \
+    if (current_planner_stats) \
+    { \
+        current_planner_stats->field++; \
+    }
+
+#define PlannerStatsTimerStart(timer) \
+    if (current_planner_stats) \
+    { \
+        INSTR_TIME_SET_CURRENT(timer); \
+    }
+
+#define PlannerStatsTimerStop(field, timer) \
+    if (current_planner_stats) \
+    { \
+        instr_time __end_time; \
+        INSTR_TIME_SET_CURRENT(__end_time); \
+        INSTR_TIME_ACCUM_DIFF(current_planner_stats->field, __end_time, timer); \
+    }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PLANNER_STATS_H
@@ -0,0 +1,146 @@
+/* extensions/pg_lab/pg_lab--0.6.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pg_lab" to load this file. \quit
+
+-- Planner statistics of the most recent planner runs in the current backend.
+CREATE FUNCTION pg_lab_planner_stats(
+    OUT statement_no int8,
+    OUT query text,
+    OUT hinted bool,
+    OUT planning_time float8,
+    OUT hint_parse_time float8,
+    OUT path_check_time float8,
+    OUT add_path_calls int8,
+    OUT add_partial_path_calls int8,
+    OUT accepted_paths int8,
+    OUT rejected_children int8,
+    OUT rejected_join_prefix int8,
+    OUT rejected_join_order int8,
+    OUT rejected_operators int8,
+    OUT rejected_parallelization int8,
+    OUT memoized_verdicts int8
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_lab_planner_stats'
+LANGUAGE C STRICT VOLATILE PARALLEL RESTRICTED;
+
+CREATE FUNCTION pg_lab_reset_planner_stats()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_lab_reset_planner_stats'
+LANGUAGE C STRICT VOLATILE PARALLEL RESTRICTED;
+
+-- Statistics about the hint blocks that have been planned by any backend. Requires pg_lab to be loaded via
+-- shared_preload_libraries.
+CREATE FUNCTION pg_lab_hint_stats(
+    OUT dbid oid,
+    OUT fingerprint int8,
+    OUT hint_block text,
+    OUT calls int8,
+    OUT total_plan_time float8,
+    OUT mean_plan_time float8,
+    OUT check_failures int8,
+    OUT fallbacks int8,
+    OUT failure_rate float8
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_lab_hint_stats'
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE;
+
+CREATE VIEW pg_lab_hint_stats AS
+    SELECT * FROM pg_lab_hint_stats();
+
+CREATE FUNCTION pg_lab_reset_hint_stats()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_lab_reset_hint_stats'
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE;
+
+REVOKE ALL ON FUNCTION pg_lab_reset_hint_stats() FROM PUBLIC;
+
+-- Discards the actual cardinalities that have been collected for the queries of the current database. Requires pg_lab to
+-- be loaded via shared_preload_libraries.
+CREATE FUNCTION pg_lab_reset_card_feedback()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_lab_reset_card_feedback'
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE;
+
+REVOKE ALL ON FUNCTION pg_lab_reset_card_feedback() FROM PUBLIC;
+
+-- The hint block of the most recently captured plan in the current backend. Plans are only captured if pglab.capture_plan
+-- is enabled.
+CREATE FUNCTION pg_lab_captured_hints()
+RETURNS text
+AS 'MODULE_PATHNAME', 'pg_lab_captured_hints'
+LANGUAGE C VOLATILE PARALLEL RESTRICTED;
+
+-- Hint blocks that are pinned to queries of the current database. Queries are identified by their query identifier (see
+-- pg_stat_statements). Requires pg_lab to be loaded via shared_preload_libraries.
+CREATE TABLE pg_lab_pinned_hints (
+    queryid int8 PRIMARY KEY,
+    hint_block text NOT NULL
+);
+
+SELECT pg_catalog.pg_extension_config_dump('pg_lab_pinned_hints', '');
+
+CREATE FUNCTION pg_lab_store_pinned_hints(queryid int8, hint_block text)
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_lab_store_pinned_hints'
+LANGUAGE C STRICT VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION pg_lab_remove_pinned_hints(queryid int8)
+RETURNS bool
+AS 'MODULE_PATHNAME', 'pg_lab_remove_pinned_hints'
+LANGUAGE C STRICT VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION pg_lab_clear_pinned_hints()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_lab_clear_pinned_hints'
+LANGUAGE C STRICT VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION pg_lab_pin_hints(queryid int8, hint_block text)
+RETURNS void
+AS $$
+    INSERT INTO @extschema@.pg_lab_pinned_hints (queryid, hint_block) VALUES ($1, $2)
+    ON CONFLICT (queryid) DO UPDATE SET hint_block = excluded.hint_block;
+    SELECT @extschema@.pg_lab_store_pinned_hints($1, $2);
+$$
+LANGUAGE SQL STRICT VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION pg_lab_unpin_hints(queryid int8)
+RETURNS bool
+AS $$
+    DELETE FROM @extschema@.pg_lab_pinned_hints WHERE pg_lab_pinned_hints.queryid = $1;
+    SELECT @extschema@.pg_lab_remove_pinned_hints($1);
+$$
+LANGUAGE SQL STRICT VOLATILE PARALLEL UNSAFE;
+
+-- Re-populates the shared memory from the pg_lab_pinned_hints table, e.g. after the table has been modified directly. This
+-- happens automatically after a server restart. Returns the number of pinned hint blocks.
+CREATE FUNCTION pg_lab_load_pinned_hints()
+RETURNS int8
+AS $$
+    SELECT @extschema@.pg_lab_clear_pinned_hints();
+    SELECT count(@extschema@.pg_lab_store_pinned_hints(queryid, hint_block)) FROM @extschema@.pg_lab_pinned_hints;
+$$
+LANGUAGE SQL STRICT VOLATILE PARALLEL UNSAFE;
+
+REVOKE ALL ON FUNCTION pg_lab_store_pinned_hints(int8, text) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_lab_remove_pinned_hints(int8) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_lab_clear_pinned_hints() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_lab_pin_hints(int8, text) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_lab_unpin_hints(int8) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_lab_load_pinned_hints() FROM PUBLIC;
+
+-- Parses a hint block with the parser that is selected by pglab.hint_parser. Returns a normalized representation of the
+-- parsed hints (one hint per line), which is mostly useful to debug the parsers.
+CREATE FUNCTION pg_lab_parse_hints(hint_block text)
+RETURNS text
+AS 'MODULE_PATHNAME', 'pg_lab_parse_hints'
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE;
+
+-- Cardinality estimates for the next query that is planned in the current backend. Each entry of relnames is either a
+-- whitespace-separated list of relation names or a row of a two-dimensional array (padded with NULLs).
+CREATE FUNCTION pg_lab_set_cardinalities(relnames text[], rows float8[])
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_lab_set_cardinalities'
+LANGUAGE C STRICT VOLATILE PARALLEL RESTRICTED;
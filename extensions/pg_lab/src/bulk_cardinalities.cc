@@ -0,0 +1,201 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ctype.h>
+#include <math.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+#include "hints.h"
+
+/*
+ * Bulk injection of cardinality estimates.
+ *
+ * Learned cardinality estimators typically produce estimates for all connected subgraphs of a query, which quickly
+ * amounts to thousands of Card hints. Tokenizing such a hint block can take longer than the actual planning. Instead,
+ * pg_lab_set_cardinalities() receives the estimates as arrays. The estimates are stored in the backend and are bound
+ * by the planner run of the next query, without going through the hint parser. Afterwards, they are discarded.
+ */
+
+PG_FUNCTION_INFO_V1(pg_lab_set_cardinalities);
+
+/* The cardinalities for the next query, allocated in their own child context of TopMemoryContext */
+static BulkCardinalities *pending_cardinalities = NULL;
+
+/*
+ * Hands the pending cardinalities over to the current planner run.
+ *
+ * The cardinalities are moved into the current memory context. This way, they are released together with the planner
+ * run, even if binding them fails.
+ */
+BulkCardinalities *
+consume_bulk_cardinalities(void)
+{
+    BulkCardinalities *bulk;
+
+    bulk = pending_cardinalities;
+    pending_cardinalities = NULL;
+
+    if (bulk)
+        MemoryContextSetParent(bulk->context, CurrentMemoryContext);
+
+    return bulk;
+}
+
+static void
+add_relname(BulkCardinalities *bulk, int *capacity, int n_relnames, char *relname)
+{
+    if (n_relnames >= *capacity)
+    {
+        *capacity *= 2;
+        bulk->relnames = (char **) repalloc(bulk->relnames, *capacity * sizeof(char *));
+    }
+
+    bulk->relnames[n_relnames] = relname;
+}
+
+/*
+ * Splits a whitespace-separated list of relation names.
+ */
+static int
+split_relnames(BulkCardinalities *bulk, int *capacity, int n_relnames, char *relnames)
+{
+    char *cur = relnames;
+
+    for (;;)
+    {
+        char *start;
+
+        while (*cur && isspace((unsigned char) *cur))
+            cur++;
+        if (!*cur)
+            break;
+
+        start = cur;
+        while (*cur && !isspace((unsigned char) *cur))
+            cur++;
+        if (*cur)
+            *cur++ = '\0';
+
+        add_relname(bulk, capacity, n_relnames++, start);
+    }
+
+    return n_relnames;
+}
+
+/*
+ * pg_lab_set_cardinalities(relnames text[], rows float8[])
+ *
+ * relnames is either a one-dimensional array of whitespace-separated relation names (e.g. '{"t mi", "t mi ci"}'), or a
+ * two-dimensional array with one relation per element, where shorter intermediates are padded with NULLs
+ * (e.g. '{{t, mi, NULL}, {t, mi, ci}}'). Passing empty arrays discards the pending cardinalities.
+ */
+Datum
+pg_lab_set_cardinalities(PG_FUNCTION_ARGS)
+{
+    ArrayType *relnames_arr = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType *rows_arr = PG_GETARG_ARRAYTYPE_P(1);
+    Datum *relname_elems, *row_elems;
+    bool *relname_nulls, *row_nulls;
+    int n_relname_elems, n_rows;
+    int ndim, n_entries, width;
+    int n_relnames, capacity;
+    BulkCardinalities *bulk;
+    MemoryContext context, oldcontext;
+
+    if (pending_cardinalities)
+    {
+        MemoryContextDelete(pending_cardinalities->context);
+        pending_cardinalities = NULL;
+    }
+
+    ndim = ARR_NDIM(relnames_arr);
+    if (ndim > 2)
+        ereport(ERROR,
+                errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+                errmsg("relnames must be a one- or two-dimensional array"));
+
+    n_entries = ndim > 0 ? ARR_DIMS(relnames_arr)[0] : 0;
+    width = ndim == 2 ? ARR_DIMS(relnames_arr)[1] : 1;
+
+    deconstruct_array_builtin(rows_arr, FLOAT8OID, &row_elems, &row_nulls, &n_rows);
+    if (ARR_NDIM(rows_arr) > 1 || n_rows != n_entries)
+        ereport(ERROR,
+                errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("rows must contain exactly one cardinality for each entry of relnames"),
+                errdetail("relnames has %d entries, but rows has %d elements.", n_entries, n_rows));
+
+    if (n_entries == 0)
+        PG_RETURN_VOID();
+
+    deconstruct_array_builtin(relnames_arr, TEXTOID, &relname_elems, &relname_nulls, &n_relname_elems);
+
+    /* We only move the context into TopMemoryContext once all entries are valid. Otherwise, errors would leak it. */
+    context = AllocSetContextCreate(CurrentMemoryContext,
+                                    "pg_lab bulk cardinalities",
+                                    ALLOCSET_DEFAULT_SIZES);
+    oldcontext = MemoryContextSwitchTo(context);
+
+    bulk = (BulkCardinalities *) palloc0(sizeof(BulkCardinalities));
+    bulk->context = context;
+    bulk->n_entries = n_entries;
+    bulk->offsets = (int *) palloc((n_entries + 1) * sizeof(int));
+    bulk->cards = (Cardinality *) palloc(n_entries * sizeof(Cardinality));
+
+    capacity = Max(n_relname_elems, 16);
+    bulk->relnames = (char **) palloc(capacity * sizeof(char *));
+    n_relnames = 0;
+
+    for (int i = 0; i < n_entries; i++)
+    {
+        double rows;
+
+        bulk->offsets[i] = n_relnames;
+        for (int j = i * width; j < (i + 1) * width; j++)
+        {
+            char *relname;
+
+            if (relname_nulls[j])
+                continue;
+
+            relname = text_to_cstring(DatumGetTextPP(relname_elems[j]));
+            if (ndim == 1)
+                n_relnames = split_relnames(bulk, &capacity, n_relnames, relname);
+            else
+                add_relname(bulk, &capacity, n_relnames++, relname);
+        }
+
+        if (n_relnames == bulk->offsets[i])
+            ereport(ERROR,
+                    errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("entry %d of relnames does not reference any relation", i + 1));
+
+        rows = row_nulls[i] ? NAN : DatumGetFloat8(row_elems[i]);
+        if (isnan(rows) || rows < 0)
+            ereport(ERROR,
+                    errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("invalid cardinality for entry %d of relnames", i + 1),
+                    errdetail("Cardinalities must be non-negative numbers."));
+
+        bulk->cards[i] = rows;
+    }
+    bulk->offsets[n_entries] = n_relnames;
+
+    MemoryContextSwitchTo(oldcontext);
+
+    MemoryContextSetParent(context, TopMemoryContext);
+    pending_cardinalities = bulk;
+
+    PG_RETURN_VOID();
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,512 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <limits.h>
+#include <math.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "executor/instrument.h"
+#include "nodes/execnodes.h"
+#include "nodes/plannodes.h"
+#include "nodes/queryjumble.h"
+#include "optimizer/cost.h"
+#include "parser/parsetree.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+
+#include "card_feedback.h"
+
+/*
+ * Shared-memory cache of actual cardinalities, similar to the LEarning Optimizer (LEO).
+ *
+ * Whenever an instrumented query finishes (e.g. via EXPLAIN ANALYZE or auto_explain.log_analyze), we harvest the actual
+ * row counts of its scans and joins. They are stored per database, query identifier and intermediate. Later planner runs of
+ * the same query use the actual cardinalities instead of the native estimates. Since the query identifier ignores
+ * constants, all executions of a parameterized query share the same feedback.
+ *
+ * Row counts are only harvested if they describe the entire intermediate. Inputs that are rescanned (the inner side of
+ * nested loops) or that might not be consumed completely (below a Limit, the inputs of a merge join, either side of a hash
+ * join whose other input is empty) are skipped.
+ *
+ * The feedback is only available if pg_lab is loaded via shared_preload_libraries. Just like in pg_stat_statements, each
+ * entry has a usage count that is increased with each observation. If the hash table is full, the usage counts of all entries
+ * decay and the least used entries are evicted in one go.
+ */
+
+/* Intermediates are identified by a fixed-size bitmap of their range table indexes */
+#define CARD_FEEDBACK_RELIDS_WORDS 4
+#define CARD_FEEDBACK_MAX_RTINDEX (CARD_FEEDBACK_RELIDS_WORDS * 64)
+
+/* Usage count handling, see pg_stat_statements */
+#define CARD_FEEDBACK_USAGE_INIT      (1.0)
+#define CARD_FEEDBACK_USAGE_DECAY     (0.99)
+#define CARD_FEEDBACK_DEALLOC_PERCENT 5
+#define CARD_FEEDBACK_DEALLOC_MIN     10
+
+typedef struct CardFeedbackKey
+{
+    Oid    dbid;
+    uint64 queryid;
+    uint64 relids[CARD_FEEDBACK_RELIDS_WORDS];
+} CardFeedbackKey;
+
+typedef struct CardFeedbackEntry
+{
+    CardFeedbackKey key;
+    double          rows;          /* cardinality of the most recent execution */
+    int64           observations;
+    double          usage;         /* decaying number of observations, used to pick the entries to evict */
+} CardFeedbackEntry;
+
+typedef struct CardFeedbackSharedState
+{
+    LWLock *lock;
+} CardFeedbackSharedState;
+
+typedef struct CardObservation
+{
+    CardFeedbackKey key;
+    double          rows;
+} CardObservation;
+
+typedef struct CardFeedbackContext
+{
+    uint64  queryid;
+    List   *rtable;
+    List   *observations;
+} CardFeedbackContext;
+
+static bool pglab_card_feedback = false;
+static int pglab_card_feedback_max = 10000;
+
+static CardFeedbackSharedState *card_feedback_state = NULL;
+static HTAB *card_feedback_hash = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+PG_FUNCTION_INFO_V1(pg_lab_reset_card_feedback);
+
+static Size
+card_feedback_memsize(void)
+{
+    Size size;
+
+    size = MAXALIGN(sizeof(CardFeedbackSharedState));
+    size = add_size(size, hash_estimate_size(pglab_card_feedback_max, sizeof(CardFeedbackEntry)));
+
+    return size;
+}
+
+static void
+card_feedback_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+
+    RequestAddinShmemSpace(card_feedback_memsize());
+    RequestNamedLWLockTranche("pg_lab card feedback", 1);
+}
+
+static void
+card_feedback_shmem_startup(void)
+{
+    HASHCTL hctl;
+    bool found;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    card_feedback_state = (CardFeedbackSharedState *) ShmemInitStruct("pg_lab card feedback",
+                                                                      sizeof(CardFeedbackSharedState),
+                                                                      &found);
+    if (!found)
+        card_feedback_state->lock = &(GetNamedLWLockTranche("pg_lab card feedback"))->lock;
+
+    hctl.keysize = sizeof(CardFeedbackKey);
+    hctl.entrysize = sizeof(CardFeedbackEntry);
+    card_feedback_hash = ShmemInitHash("pg_lab card feedback hash",
+                                       pglab_card_feedback_max, pglab_card_feedback_max,
+                                       &hctl,
+                                       HASH_ELEM | HASH_BLOBS);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+void
+init_card_feedback(void)
+{
+    if (!process_shared_preload_libraries_in_progress)
+        return;
+
+    DefineCustomBoolVariable("pglab.card_feedback",
+                             "Use the actual cardinalities of previous executions of the same query.",
+                             "Actual cardinalities are only collected from instrumented executions, "
+                             "e.g. EXPLAIN ANALYZE or auto_explain.log_analyze.",
+                             &pglab_card_feedback, false,
+                             PGC_SUSET, 0,
+                             NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pglab.card_feedback_max",
+                            "Maximum number of intermediates that are tracked in the cardinality feedback.",
+                            "Set to 0 to disable the cardinality feedback.",
+                            &pglab_card_feedback_max, 10000,
+                            0, INT_MAX / 2,
+                            PGC_POSTMASTER, 0,
+                            NULL, NULL, NULL);
+
+    if (pglab_card_feedback_max <= 0)
+        return;
+
+    /* The feedback is stored per query identifier, so we need Postgres to compute it. */
+    EnableQueryId();
+
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = card_feedback_shmem_request;
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = card_feedback_shmem_startup;
+}
+
+/*
+ * Builds the hash key of an intermediate. Outer joins are part of the relids in the planner, but not in the final plan.
+ * Therefore, we ignore them on both sides.
+ *
+ * Returns false if the intermediate cannot be represented by the key.
+ */
+static bool
+make_feedback_key(CardFeedbackKey *key, uint64 queryid, Relids relids, List *rtable)
+{
+    int rti = -1;
+    bool empty = true;
+
+    memset(key, 0, sizeof(CardFeedbackKey));
+    key->dbid = MyDatabaseId;
+    key->queryid = queryid;
+
+    while ((rti = bms_next_member(relids, rti)) >= 0)
+    {
+        if (rti > list_length(rtable) || rt_fetch(rti, rtable)->rtekind == RTE_JOIN)
+            continue;
+
+        if (rti >= CARD_FEEDBACK_MAX_RTINDEX)
+            return false;
+
+        key->relids[rti / 64] |= UINT64CONST(1) << (rti % 64);
+        empty = false;
+    }
+
+    return !empty;
+}
+
+bool
+card_feedback_applicable(PlannerInfo *root)
+{
+    return card_feedback_hash && pglab_card_feedback &&
+           root->query_level == 1 && root->parse->queryId != UINT64CONST(0);
+}
+
+double
+card_feedback_lookup(PlannerInfo *root, RelOptInfo *rel)
+{
+    CardFeedbackKey key;
+    CardFeedbackEntry *entry;
+    double rows = NAN;
+
+    /* The relids of child rels depend on partition pruning and might change between executions */
+    if (rel->reloptkind != RELOPT_BASEREL && rel->reloptkind != RELOPT_JOINREL)
+        return NAN;
+
+    if (!make_feedback_key(&key, root->parse->queryId, rel->relids, root->parse->rtable))
+        return NAN;
+
+    LWLockAcquire(card_feedback_state->lock, LW_SHARED);
+    entry = (CardFeedbackEntry *) hash_search(card_feedback_hash, &key, HASH_FIND, NULL);
+    if (entry)
+        rows = entry->rows;
+    LWLockRelease(card_feedback_state->lock);
+
+    return isnan(rows) ? rows : clamp_row_est(rows);
+}
+
+/*
+ * Determines the number of rows that a node produced over all of its loops (and parallel workers). Returns -1 if the node
+ * has not been executed.
+ */
+static double
+actual_rows(PlanState *planstate)
+{
+    Instrumentation *instr = planstate ? planstate->instrument : NULL;
+
+    if (!instr || (instr->nloops == 0 && !instr->running))
+        return -1;
+
+    /* The current loop is only added to ntuples by InstrEndLoop(), which is usually called by EXPLAIN */
+    return instr->ntuples + instr->tuplecount;
+}
+
+static void
+record_observation(CardFeedbackContext *context, Relids relids, PlanState *planstate)
+{
+    CardObservation *observation;
+    double rows;
+
+    rows = actual_rows(planstate);
+    if (rows < 0)
+        return;
+
+    observation = (CardObservation *) palloc(sizeof(CardObservation));
+    if (!make_feedback_key(&observation->key, context->queryid, relids, context->rtable))
+    {
+        pfree(observation);
+        return;
+    }
+
+    observation->rows = rows;
+    context->observations = lappend(context->observations, observation);
+}
+
+/*
+ * Collects the actual cardinalities of all scans and joins in a plan. Returns the relids that are produced by the plan.
+ *
+ * reliable indicates whether the row counts of the plan correspond to the entire intermediate.
+ */
+static Relids
+collect_observations(CardFeedbackContext *context, PlanState *planstate, bool reliable)
+{
+    Plan *plan;
+    Relids relids = EMPTY_BITMAP;
+    bool intermediate = true;
+
+    if (!planstate)
+        return EMPTY_BITMAP;
+
+    plan = planstate->plan;
+    switch (nodeTag(plan))
+    {
+        case T_SeqScan:
+        case T_SampleScan:
+        case T_IndexScan:
+        case T_IndexOnlyScan:
+        case T_BitmapHeapScan:
+        case T_TidScan:
+        case T_TidRangeScan:
+        case T_SubqueryScan:
+        case T_FunctionScan:
+        case T_TableFuncScan:
+        case T_ValuesScan:
+        case T_CteScan:
+        case T_NamedTuplestoreScan:
+        case T_WorkTableScan:
+            /* Subqueries use their own part of the range table, so we do not descend into their plans */
+            relids = bms_make_singleton(((Scan *) plan)->scanrelid);
+            break;
+
+        case T_ForeignScan:
+            relids = bms_copy(((ForeignScan *) plan)->fs_base_relids);
+            break;
+
+        case T_CustomScan:
+            relids = bms_copy(((CustomScan *) plan)->custom_relids);
+            break;
+
+        case T_NestLoop:
+            /* The inner side is rescanned for each outer tuple */
+            relids = collect_observations(context, outerPlanState(planstate), reliable);
+            relids = bms_join(relids, collect_observations(context, innerPlanState(planstate), false));
+            break;
+
+        case T_MergeJoin:
+            /* Merge joins stop as soon as one of their inputs is exhausted */
+            relids = collect_observations(context, outerPlanState(planstate), false);
+            relids = bms_join(relids, collect_observations(context, innerPlanState(planstate), false));
+            break;
+
+        case T_HashJoin:
+        {
+            /* Hash joins skip one of their inputs if the other one is empty. The inner side is always a Hash node. */
+            double outer_rows = actual_rows(outerPlanState(planstate));
+            double inner_rows = actual_rows(outerPlanState(innerPlanState(planstate)));
+
+            relids = collect_observations(context, outerPlanState(planstate), reliable && inner_rows > 0);
+            relids = bms_join(relids,
+                              collect_observations(context, innerPlanState(planstate), reliable && outer_rows > 0));
+            break;
+        }
+
+        case T_Append:
+        {
+            AppendState *append = (AppendState *) planstate;
+            for (int i = 0; i < append->as_nplans; i++)
+                bms_free(collect_observations(context, append->appendplans[i], reliable));
+            relids = bms_copy(((Append *) plan)->apprelids);
+            break;
+        }
+
+        case T_MergeAppend:
+        {
+            MergeAppendState *merge_append = (MergeAppendState *) planstate;
+            for (int i = 0; i < merge_append->ms_nplans; i++)
+                bms_free(collect_observations(context, merge_append->mergeplans[i], reliable));
+            relids = bms_copy(((MergeAppend *) plan)->apprelids);
+            break;
+        }
+
+        case T_Limit:
+            relids = collect_observations(context, outerPlanState(planstate), false);
+            intermediate = false;
+            break;
+
+        default:
+            /* All other nodes (sorts, aggregations, gathers, etc.) just pass on the relids of their inputs */
+            relids = collect_observations(context, outerPlanState(planstate), reliable);
+            relids = bms_join(relids, collect_observations(context, innerPlanState(planstate), reliable));
+            intermediate = false;
+            break;
+    }
+
+    if (intermediate && reliable)
+        record_observation(context, relids, planstate);
+
+    return relids;
+}
+
+static int
+compare_feedback_usage(const void *a, const void *b)
+{
+    double usage1 = (*(CardFeedbackEntry *const *) a)->usage;
+    double usage2 = (*(CardFeedbackEntry *const *) b)->usage;
+
+    return (usage1 > usage2) - (usage1 < usage2);
+}
+
+/*
+ * Decays the usage of all entries and removes the least used ones from the hash table. The caller must hold the lock in
+ * exclusive mode.
+ *
+ * Evicting a fixed share of the entries at once leaves room for the observations of many queries. Otherwise, each new
+ * intermediate would evict the one that was added right before it.
+ */
+static void
+evict_card_feedback_entries(void)
+{
+    HASH_SEQ_STATUS hstat;
+    CardFeedbackEntry *entry;
+    CardFeedbackEntry **entries;
+    long n_entries;
+    long n_evict;
+    long i = 0;
+
+    n_entries = hash_get_num_entries(card_feedback_hash);
+    entries = (CardFeedbackEntry **) palloc(n_entries * sizeof(CardFeedbackEntry *));
+
+    hash_seq_init(&hstat, card_feedback_hash);
+    while ((entry = (CardFeedbackEntry *) hash_seq_search(&hstat)) != NULL)
+    {
+        entries[i++] = entry;
+        entry->usage *= CARD_FEEDBACK_USAGE_DECAY;
+    }
+
+    qsort(entries, i, sizeof(CardFeedbackEntry *), compare_feedback_usage);
+
+    n_evict = Max(CARD_FEEDBACK_DEALLOC_MIN, i * CARD_FEEDBACK_DEALLOC_PERCENT / 100);
+    n_evict = Min(n_evict, i);
+    for (long j = 0; j < n_evict; j++)
+        hash_search(card_feedback_hash, &entries[j]->key, HASH_REMOVE, NULL);
+
+    pfree(entries);
+}
+
+void
+card_feedback_record(QueryDesc *queryDesc)
+{
+    CardFeedbackContext context;
+    ListCell *lc;
+
+    if (!card_feedback_hash || !pglab_card_feedback)
+        return;
+
+    if (!queryDesc->planstate || !queryDesc->planstate->instrument ||
+        queryDesc->plannedstmt->queryId == UINT64CONST(0))
+        return;
+
+    context.queryid = queryDesc->plannedstmt->queryId;
+    context.rtable = queryDesc->plannedstmt->rtable;
+    context.observations = NIL;
+    bms_free(collect_observations(&context, queryDesc->planstate, true));
+
+    if (context.observations == NIL)
+        return;
+
+    LWLockAcquire(card_feedback_state->lock, LW_EXCLUSIVE);
+
+    foreach (lc, context.observations)
+    {
+        CardObservation *observation = (CardObservation *) lfirst(lc);
+        CardFeedbackEntry *entry;
+        bool found;
+
+        entry = (CardFeedbackEntry *) hash_search(card_feedback_hash, &observation->key, HASH_FIND, NULL);
+        if (!entry)
+        {
+            if (hash_get_num_entries(card_feedback_hash) >= pglab_card_feedback_max)
+                evict_card_feedback_entries();
+
+            entry = (CardFeedbackEntry *) hash_search(card_feedback_hash, &observation->key, HASH_ENTER, &found);
+            Assert(!found);
+            entry->observations = 0;
+            entry->usage = 0.0;
+        }
+
+        entry->rows = observation->rows;
+        entry->observations++;
+        entry->usage += CARD_FEEDBACK_USAGE_INIT;
+    }
+
+    LWLockRelease(card_feedback_state->lock);
+
+    list_free_deep(context.observations);
+}
+
+/*
+ * Removes the cardinality feedback of all queries of the current database.
+ */
+Datum
+pg_lab_reset_card_feedback(PG_FUNCTION_ARGS)
+{
+    HASH_SEQ_STATUS hstat;
+    CardFeedbackEntry *entry;
+
+    if (!card_feedback_hash)
+        ereport(ERROR,
+                errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                errmsg("pg_lab cardinality feedback is not available"),
+                errhint("pg_lab must be loaded via shared_preload_libraries and pglab.card_feedback_max must be positive."));
+
+    LWLockAcquire(card_feedback_state->lock, LW_EXCLUSIVE);
+
+    hash_seq_init(&hstat, card_feedback_hash);
+    while ((entry = (CardFeedbackEntry *) hash_seq_search(&hstat)) != NULL)
+    {
+        if (entry->key.dbid != MyDatabaseId)
+            continue;
+
+        hash_search(card_feedback_hash, &entry->key, HASH_REMOVE, NULL);
+    }
+
+    LWLockRelease(card_feedback_state->lock);
+
+    PG_RETURN_VOID();
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,380 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "nodes/bitmapset.h"
+#include "optimizer/joininfo.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
+#include "port/pg_bitutils.h"
+#include "utils/hsearch.h"
+
+#include "dpccp.h"
+
+/*
+ * Join enumeration based on connected subgraph complement pairs (DPccp).
+ *
+ * See Moerkotte and Neumann: "Analysis of Two Existing and One New Dynamic Programming Algorithm for the Generation of
+ * Optimal Bushy Join Trees without Cross Products" (VLDB 2006).
+ *
+ * The standard join search of Postgres considers all pairs of intermediates at each level and then discards the pairs that
+ * are not connected by a join clause. DPccp instead only enumerates pairs (S1, S2) where both S1 and S2 are connected in the
+ * join graph and S1 is connected to S2. For sparse join graphs (chains, cycles, stars with few relations) this is orders of
+ * magnitude fewer pairs.
+ *
+ * The join graph is derived from the join clauses and join order restrictions between the initial rels. Outer joins are not
+ * modelled as hyperedges. Instead, we rely on make_join_rel() to reject illegal joins. If the join graph is not connected
+ * (i.e. the query requires cross products), or if the final join rel cannot be built from the connected pairs, we give up and
+ * let the caller fall back to the standard join search.
+ *
+ * The pairs are first enumerated purely on bitmasks and then processed in order of their size. This allows us to post-process
+ * each join rel once all of its paths have been added, just like standard_join_search() does after each level.
+ * Since the number of pairs grows exponentially for dense join graphs, the enumeration is aborted once DPCCP_MAX_PAIRS pairs
+ * have been emitted. At this point, no join rels have been created yet and we can still fall back to the standard policies.
+ */
+
+typedef uint64 RelMask;
+
+typedef struct CsgCmpPair
+{
+    RelMask csg;
+    RelMask cmp;
+} CsgCmpPair;
+
+typedef struct DPccpContext
+{
+    int         n_rels;
+    RelMask     neighbors[DPCCP_MAX_RELS];
+    CsgCmpPair *pairs;
+    Size        n_pairs;
+    Size        max_pairs;
+    bool        overflow;   /* more than DPCCP_MAX_PAIRS pairs, enumeration was aborted */
+} DPccpContext;
+
+typedef struct DPccpEntry
+{
+    RelMask     relmask;    /* hash key */
+    RelOptInfo *rel;
+} DPccpEntry;
+
+int pglab_join_enumerator = JOIN_ENUMERATOR_STANDARD;
+
+#define RelMaskSingleton(idx) (((RelMask) 1) << (idx))
+
+/* All relations with an index smaller than or equal to idx */
+#define RelMaskPrefix(idx) ((idx) >= DPCCP_MAX_RELS - 1 ? ~((RelMask) 0) : RelMaskSingleton((idx) + 1) - 1)
+
+/* Iterates over all non-empty subsets of a mask in increasing order */
+#define foreach_subset(subset, mask) \
+    for (RelMask subset = (0 - (mask)) & (mask); subset != 0; subset = (subset - (mask)) & (mask))
+
+static RelMask
+neighborhood(DPccpContext *ctx, RelMask relmask)
+{
+    RelMask result = 0;
+
+    while (relmask)
+    {
+        int idx = pg_rightmost_one_pos64(relmask);
+        result |= ctx->neighbors[idx];
+        relmask &= relmask - 1;
+    }
+
+    return result;
+}
+
+static void
+emit_pair(DPccpContext *ctx, RelMask csg, RelMask cmp)
+{
+    if (ctx->n_pairs >= DPCCP_MAX_PAIRS)
+    {
+        ctx->overflow = true;
+        return;
+    }
+
+    if (ctx->n_pairs >= ctx->max_pairs)
+    {
+        ctx->max_pairs = Min(2 * ctx->max_pairs, DPCCP_MAX_PAIRS);
+        ctx->pairs = (CsgCmpPair *) repalloc_huge(ctx->pairs, ctx->max_pairs * sizeof(CsgCmpPair));
+    }
+
+    ctx->pairs[ctx->n_pairs].csg = csg;
+    ctx->pairs[ctx->n_pairs].cmp = cmp;
+    ctx->n_pairs++;
+}
+
+static void
+enumerate_cmp_rec(DPccpContext *ctx, RelMask csg, RelMask cmp, RelMask excluded)
+{
+    RelMask neighbors;
+
+    check_stack_depth();
+
+    neighbors = neighborhood(ctx, cmp) & ~excluded;
+    if (!neighbors)
+        return;
+
+    foreach_subset(subset, neighbors)
+    {
+        if (ctx->overflow)
+            return;
+        emit_pair(ctx, csg, cmp | subset);
+    }
+
+    excluded |= neighbors;
+    foreach_subset(subset, neighbors)
+    {
+        if (ctx->overflow)
+            return;
+        enumerate_cmp_rec(ctx, csg, cmp | subset, excluded);
+    }
+}
+
+/*
+ * Emits all complements of a connected subgraph.
+ */
+static void
+emit_csg(DPccpContext *ctx, RelMask csg)
+{
+    RelMask excluded;
+    RelMask neighbors;
+
+    CHECK_FOR_INTERRUPTS();
+
+    excluded = csg | RelMaskPrefix(pg_rightmost_one_pos64(csg));
+    neighbors = neighborhood(ctx, csg) & ~excluded;
+
+    while (neighbors && !ctx->overflow)
+    {
+        int idx = pg_leftmost_one_pos64(neighbors);
+        RelMask cmp = RelMaskSingleton(idx);
+
+        emit_pair(ctx, csg, cmp);
+        enumerate_cmp_rec(ctx, csg, cmp, excluded | (RelMaskPrefix(idx) & neighbors));
+
+        neighbors &= ~cmp;
+    }
+}
+
+static void
+enumerate_csg_rec(DPccpContext *ctx, RelMask csg, RelMask excluded)
+{
+    RelMask neighbors;
+
+    check_stack_depth();
+
+    neighbors = neighborhood(ctx, csg) & ~excluded;
+    if (!neighbors)
+        return;
+
+    foreach_subset(subset, neighbors)
+    {
+        if (ctx->overflow)
+            return;
+        emit_csg(ctx, csg | subset);
+    }
+
+    excluded |= neighbors;
+    foreach_subset(subset, neighbors)
+    {
+        if (ctx->overflow)
+            return;
+        enumerate_csg_rec(ctx, csg | subset, excluded);
+    }
+}
+
+static int
+compare_pair_size(const void *a, const void *b)
+{
+    const CsgCmpPair *pair1 = (const CsgCmpPair *) a;
+    const CsgCmpPair *pair2 = (const CsgCmpPair *) b;
+    int size1, size2;
+
+    size1 = pg_popcount64(pair1->csg | pair1->cmp);
+    size2 = pg_popcount64(pair2->csg | pair2->cmp);
+
+    return (size1 > size2) - (size1 < size2);
+}
+
+/*
+ * Builds the join graph of the initial rels. Returns false if the graph is not connected.
+ */
+static bool
+build_join_graph(PlannerInfo *root, DPccpContext *ctx, List *initial_rels)
+{
+    RelMask reachable, all_rels;
+
+    for (int i = 0; i < ctx->n_rels; i++)
+    {
+        RelOptInfo *outer_rel = (RelOptInfo *) list_nth(initial_rels, i);
+
+        for (int j = i + 1; j < ctx->n_rels; j++)
+        {
+            RelOptInfo *inner_rel = (RelOptInfo *) list_nth(initial_rels, j);
+
+            if (have_relevant_joinclause(root, outer_rel, inner_rel) ||
+                have_join_order_restriction(root, outer_rel, inner_rel))
+            {
+                ctx->neighbors[i] |= RelMaskSingleton(j);
+                ctx->neighbors[j] |= RelMaskSingleton(i);
+            }
+        }
+    }
+
+    all_rels = RelMaskPrefix(ctx->n_rels - 1);
+    reachable = RelMaskSingleton(0);
+    for (;;)
+    {
+        RelMask expanded = reachable | neighborhood(ctx, reachable);
+        if (expanded == reachable)
+            break;
+        reachable = expanded;
+    }
+
+    return reachable == all_rels;
+}
+
+/*
+ * Same post-processing that standard_join_search() applies to each join rel once all of its paths have been generated.
+ */
+static void
+finalize_join_rels(PlannerInfo *root, List *joinrels)
+{
+    ListCell *lc;
+
+    foreach (lc, joinrels)
+    {
+        RelOptInfo *joinrel = (RelOptInfo *) lfirst(lc);
+
+        generate_partitionwise_join_paths(root, joinrel);
+        if (!bms_equal(joinrel->relids, root->all_query_rels))
+            generate_useful_gather_paths(root, joinrel, false);
+        set_cheapest(joinrel);
+    }
+}
+
+/*
+ * Computes the optimal join tree of the initial rels using the DPccp algorithm.
+ *
+ * Returns NULL if DPccp cannot be applied to the join problem. In this case, no join rels have been added to the planner.
+ */
+RelOptInfo *
+dpccp_join_search(PlannerInfo *root, int levels_needed, List *initial_rels)
+{
+    DPccpContext ctx;
+    HTAB *joinrels;
+    HASHCTL hctl;
+    DPccpEntry *entry;
+    ListCell *lc;
+    List *level_rels;
+    RelOptInfo *result;
+    RelMask all_rels;
+    int current_level;
+    int savelength;
+    int idx;
+
+    if (levels_needed > DPCCP_MAX_RELS)
+        return NULL;
+
+    memset(&ctx, 0, sizeof(DPccpContext));
+    ctx.n_rels = levels_needed;
+    if (!build_join_graph(root, &ctx, initial_rels))
+        return NULL;
+
+    ctx.max_pairs = 64;
+    ctx.pairs = (CsgCmpPair *) palloc(ctx.max_pairs * sizeof(CsgCmpPair));
+    for (idx = ctx.n_rels - 1; idx >= 0 && !ctx.overflow; idx--)
+    {
+        emit_csg(&ctx, RelMaskSingleton(idx));
+        enumerate_csg_rec(&ctx, RelMaskSingleton(idx), RelMaskPrefix(idx));
+    }
+
+    if (ctx.overflow)
+    {
+        /* too many pairs for an exhaustive enumeration, let the standard policies (e.g. GEQO) handle the join problem */
+        pfree(ctx.pairs);
+        return NULL;
+    }
+
+    qsort(ctx.pairs, ctx.n_pairs, sizeof(CsgCmpPair), compare_pair_size);
+
+    hctl.keysize = sizeof(RelMask);
+    hctl.entrysize = sizeof(DPccpEntry);
+    hctl.hcxt = CurrentMemoryContext;
+    joinrels = hash_create("DPccpJoinRels", 2 * ctx.n_rels, &hctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+    idx = 0;
+    foreach (lc, initial_rels)
+    {
+        RelMask relmask = RelMaskSingleton(idx);
+
+        entry = (DPccpEntry *) hash_search(joinrels, &relmask, HASH_ENTER, NULL);
+        entry->rel = (RelOptInfo *) lfirst(lc);
+        idx++;
+    }
+
+    savelength = list_length(root->join_rel_list);
+    current_level = 1;
+    level_rels = NIL;
+    for (Size i = 0; i < ctx.n_pairs; i++)
+    {
+        CsgCmpPair *pair = &ctx.pairs[i];
+        RelMask relmask = pair->csg | pair->cmp;
+        RelOptInfo *outer_rel, *inner_rel, *joinrel;
+        DPccpEntry *outer_entry, *inner_entry;
+        bool found;
+
+        if (pg_popcount64(relmask) != current_level)
+        {
+            finalize_join_rels(root, level_rels);
+            list_free(level_rels);
+            level_rels = NIL;
+            current_level = pg_popcount64(relmask);
+        }
+
+        /* the inputs might be missing if they could not be built, e.g. due to outer join restrictions */
+        outer_entry = (DPccpEntry *) hash_search(joinrels, &pair->csg, HASH_FIND, NULL);
+        inner_entry = (DPccpEntry *) hash_search(joinrels, &pair->cmp, HASH_FIND, NULL);
+        if (!outer_entry || !inner_entry)
+            continue;
+
+        outer_rel = outer_entry->rel;
+        inner_rel = inner_entry->rel;
+        joinrel = make_join_rel(root, outer_rel, inner_rel);
+        if (!joinrel)
+            continue;
+
+        entry = (DPccpEntry *) hash_search(joinrels, &relmask, HASH_ENTER, &found);
+        if (!found)
+        {
+            entry->rel = joinrel;
+            level_rels = lappend(level_rels, joinrel);
+        }
+    }
+
+    finalize_join_rels(root, level_rels);
+    list_free(level_rels);
+
+    all_rels = RelMaskPrefix(ctx.n_rels - 1);
+    entry = (DPccpEntry *) hash_search(joinrels, &all_rels, HASH_FIND, NULL);
+    result = entry ? entry->rel : NULL;
+
+    if (!result)
+    {
+        /* Same cleanup as in geqo_eval(). The join rel hash will be re-created from the join rel list when necessary. */
+        root->join_rel_list = list_truncate(root->join_rel_list, savelength);
+        root->join_rel_hash = NULL;
+    }
+
+    hash_destroy(joinrels);
+    pfree(ctx.pairs);
+
+    return result;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
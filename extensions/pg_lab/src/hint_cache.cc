@@ -0,0 +1,283 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <math.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "common/hashfn.h"
+#include "lib/ilist.h"
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "hints.h"
+
+/*
+ * Per-backend LRU cache for parsed hint blocks.
+ *
+ * Parsing a hint block is expensive compared to binding it: the parser needs to tokenize the entire hint text and build a
+ * full parse tree, whereas binding only resolves relation names against the current range table. Since workloads tend to
+ * re-use the same hint blocks over and over again, we cache the HintBlockSpec for each distinct hint text. Binding still
+ * happens for each query (see bind_hint_block()).
+ *
+ * Each cache entry owns a private memory context that contains the hint text as well as the entire spec. This way, evicting
+ * an entry is a simple matter of deleting its context.
+ */
+
+int pglab_hint_parser = HINT_PARSER_ANTLR;
+int pglab_hint_cache_size = 128;
+
+typedef struct HintCacheKey
+{
+    uint32 hashval;
+    Size   length;
+    int    parser;  /* HintParserType that created the spec */
+} HintCacheKey;
+
+typedef struct HintCacheEntry
+{
+    HintCacheKey   key;
+    char          *hint_text;
+    HintBlockSpec *spec;
+    MemoryContext  context;
+    dlist_node     lru_node;
+} HintCacheEntry;
+
+PG_FUNCTION_INFO_V1(pg_lab_parse_hints);
+
+static MemoryContext HintCacheContext = NULL;
+static HTAB *hint_cache = NULL;
+static dlist_head hint_cache_lru = DLIST_STATIC_INIT(hint_cache_lru);
+
+static void
+init_hint_cache(void)
+{
+    HASHCTL hctl;
+
+    HintCacheContext = AllocSetContextCreate(TopMemoryContext,
+                                             "pg_lab hint cache",
+                                             ALLOCSET_DEFAULT_SIZES);
+
+    hctl.keysize = sizeof(HintCacheKey);
+    hctl.entrysize = sizeof(HintCacheEntry);
+    hctl.hcxt = HintCacheContext;
+
+    hint_cache = hash_create("HintCacheHashes", pglab_hint_cache_size, &hctl,
+                             HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+/*
+ * Parses the raw hint text using the parser selected by pglab.hint_parser.
+ *
+ * The spec is allocated in the current memory context.
+ */
+HintBlockSpec *
+parse_hint_text(const char *hint_text)
+{
+    switch (pglab_hint_parser)
+    {
+        case HINT_PARSER_ANTLR:
+            return antlr_parse_hint_text(hint_text);
+        case HINT_PARSER_NATIVE:
+            return native_parse_hint_text(hint_text);
+        default:
+            elog(ERROR, "Unknown hint parser: %d", pglab_hint_parser);
+            return NULL;
+    }
+}
+
+static void
+evict_hint_cache_entry(HintCacheEntry *entry)
+{
+    MemoryContext entry_context;
+
+    entry_context = entry->context;
+    dlist_delete(&entry->lru_node);
+    hash_search(hint_cache, &entry->key, HASH_REMOVE, NULL);
+    MemoryContextDelete(entry_context);
+}
+
+/*
+ * Provides the parsed representation of a specific hint text.
+ *
+ * If the hint text has been parsed before, the cached spec is returned. Otherwise, the hint text is parsed and the result
+ * is added to the cache (evicting the least recently used entry if necessary).
+ *
+ * The returned spec must be treated as read-only by the caller. If caching is disabled, the spec is allocated in the
+ * current memory context.
+ */
+HintBlockSpec *
+fetch_hint_block_spec(const char *hint_text)
+{
+    HintCacheKey key;
+    HintCacheEntry *entry;
+    HintBlockSpec *spec;
+    MemoryContext entry_context, oldcontext;
+    bool found;
+
+    if (pglab_hint_cache_size <= 0)
+        return parse_hint_text(hint_text);
+
+    if (!hint_cache)
+        init_hint_cache();
+
+    memset(&key, 0, sizeof(HintCacheKey));
+    key.length = strlen(hint_text);
+    key.hashval = hash_bytes((const unsigned char *) hint_text, key.length);
+    key.parser = pglab_hint_parser;
+
+    entry = (HintCacheEntry *) hash_search(hint_cache, &key, HASH_FIND, &found);
+    if (found && strcmp(entry->hint_text, hint_text) == 0)
+    {
+        dlist_move_head(&hint_cache_lru, &entry->lru_node);
+        return entry->spec;
+    }
+    else if (found)
+    {
+        /* Hash collision with a different hint text, the newer hint text wins */
+        evict_hint_cache_entry(entry);
+    }
+
+    /*
+     * We parse the hint block in a context that is still owned by the current query. If the parser raises an error, the
+     * context is cleaned up along with the query. Only once parsing succeeded, the context is moved into the cache.
+     */
+    entry_context = AllocSetContextCreate(CurrentMemoryContext,
+                                          "pg_lab hint cache entry",
+                                          ALLOCSET_SMALL_SIZES);
+    oldcontext = MemoryContextSwitchTo(entry_context);
+    spec = parse_hint_text(hint_text);
+    MemoryContextSwitchTo(oldcontext);
+
+    MemoryContextSetParent(entry_context, HintCacheContext);
+
+    entry = (HintCacheEntry *) hash_search(hint_cache, &key, HASH_ENTER, &found);
+    Assert(!found);
+    entry->hint_text = MemoryContextStrdup(entry_context, hint_text);
+    entry->spec = spec;
+    entry->context = entry_context;
+    dlist_push_head(&hint_cache_lru, &entry->lru_node);
+
+    while (hash_get_num_entries(hint_cache) > pglab_hint_cache_size)
+    {
+        HintCacheEntry *victim;
+        victim = dlist_container(HintCacheEntry, lru_node, dlist_tail_node(&hint_cache_lru));
+        evict_hint_cache_entry(victim);
+    }
+
+    return spec;
+}
+
+static void
+append_join_order_spec(StringInfo buf, JoinOrderSpec *join_order)
+{
+    if (join_order->node_type == BASE_REL)
+    {
+        appendStringInfoString(buf, join_order->relname);
+        return;
+    }
+
+    appendStringInfoChar(buf, '(');
+    append_join_order_spec(buf, join_order->outer_child);
+    appendStringInfoChar(buf, ' ');
+    append_join_order_spec(buf, join_order->inner_child);
+    appendStringInfoChar(buf, ')');
+}
+
+static void
+append_relnames(StringInfo buf, List *relnames)
+{
+    ListCell *lc;
+
+    foreach (lc, relnames)
+    {
+        if (foreach_current_index(lc) > 0)
+            appendStringInfoChar(buf, ' ');
+        appendStringInfoString(buf, (char *) lfirst(lc));
+    }
+}
+
+/*
+ * Renders a parsed hint block as text, one hint per line. This is not a valid hint block, but rather a normalized
+ * representation of the spec that allows to compare the results of different parsers.
+ */
+static char *
+hint_block_spec_to_string(HintBlockSpec *spec)
+{
+    StringInfoData buf;
+    ListCell *lc;
+
+    initStringInfo(&buf);
+
+    foreach (lc, spec->hints)
+    {
+        HintSpec *hint = (HintSpec *) lfirst(lc);
+
+        switch (hint->tag)
+        {
+            case HS_PLAN_MODE:
+                appendStringInfo(&buf, "PlanMode(%d)", (int) hint->mode);
+                break;
+            case HS_PARALLEL_MODE:
+                appendStringInfo(&buf, "ParallelMode(%d)", (int) hint->parallel_mode);
+                break;
+            case HS_PLAN_CACHE_MODE:
+                appendStringInfo(&buf, "PlanCacheMode(%d)", (int) hint->plan_cache_mode);
+                break;
+            case HS_JOIN_ORDER:
+            case HS_JOIN_PREFIX:
+                appendStringInfoString(&buf, hint->tag == HS_JOIN_ORDER ? "JoinOrder(" : "JoinPrefix(");
+                append_join_order_spec(&buf, hint->join_order);
+                appendStringInfoChar(&buf, ')');
+                break;
+            case HS_OPERATOR:
+                appendStringInfo(&buf, "%s(", PhysicalOperatorToString(hint->op));
+                append_relnames(&buf, hint->relnames);
+                if (!isnan(hint->parallel_workers))
+                    appendStringInfo(&buf, " workers=%g", hint->parallel_workers);
+                if (hint->has_cost)
+                    appendStringInfo(&buf, " cost=%g..%g", hint->startup_cost, hint->total_cost);
+                appendStringInfoChar(&buf, ')');
+                break;
+            case HS_RESULT:
+                appendStringInfo(&buf, "Result(workers=%g)", hint->parallel_workers);
+                break;
+            case HS_CARDINALITY:
+            case HS_CARDINALITY_SCALE:
+                appendStringInfoString(&buf, hint->tag == HS_CARDINALITY ? "Card(" : "CardScale(");
+                append_relnames(&buf, hint->relnames);
+                appendStringInfo(&buf, " #%g)", hint->tag == HS_CARDINALITY ? hint->card : hint->scale_factor);
+                break;
+            case HS_GUC:
+                appendStringInfo(&buf, "Set(%s = %s)", hint->guc_name, hint->guc_value);
+                break;
+        }
+
+        appendStringInfoChar(&buf, '\n');
+    }
+
+    return buf.data;
+}
+
+/*
+ * Parses a hint block with the parser selected by pglab.hint_parser and returns the normalized representation of the
+ * parsed hints. The hint cache is bypassed.
+ */
+Datum
+pg_lab_parse_hints(PG_FUNCTION_ARGS)
+{
+    char *hint_text;
+    HintBlockSpec *spec;
+
+    hint_text = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    spec = parse_hint_text(hint_text);
+
+    PG_RETURN_TEXT_P(cstring_to_text(hint_block_spec_to_string(spec)));
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
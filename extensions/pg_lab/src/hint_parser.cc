@@ -23,187 +23,211 @@ extern "C" {
 class HintBlockListener : public pg_lab::HintBlockBaseListener
 {
     public:
-        explicit HintBlockListener(PlannerInfo *root, PlannerHints *hints)
-            : root_(root), hints_(hints), temp_gucs_() {}
+        explicit HintBlockListener(HintBlockSpec *spec)
+            : spec_(spec) {}
 
         void enterPlan_mode_setting(pg_lab::HintBlockParser::Plan_mode_settingContext *ctx) override
         {
+            HintSpec *hint = MakeHintSpec(HS_PLAN_MODE);
+
             if (ctx->FULL())
-                hints_->mode = HINTMODE_FULL;
+                hint->mode = HINTMODE_FULL;
             else if (ctx->ANCHORED())
-                hints_->mode = HINTMODE_ANCHORED;
+                hint->mode = HINTMODE_ANCHORED;
             else
                 elog(ERROR, "Unknown plan mode setting: %s", ctx->getText().c_str());
 
-            hints_->contains_hint = true;
+            AddHint(hint);
         }
 
         void enterParallelization_setting(pg_lab::HintBlockParser::Parallelization_settingContext *ctx) override
         {
-            if (hints_->parallel_rels || hints_->parallelize_entire_plan)
-            {
-                ereport(WARNING,
-                    errmsg("[pg_lab] Ignoring global parallelization setting"),
-                    errdetail("Global parallelization setting is overridden by operator hints"));
-                return;
-            }
+            HintSpec *hint = MakeHintSpec(HS_PARALLEL_MODE);
 
             if (ctx->PARALLEL())
-                hints_->parallel_mode = PARMODE_PARALLEL;
+                hint->parallel_mode = PARMODE_PARALLEL;
             else if (ctx->SEQUENTIAL())
-                hints_->parallel_mode = PARMODE_SEQUENTIAL;
+                hint->parallel_mode = PARMODE_SEQUENTIAL;
             else if (ctx->DEFAULT())
-                hints_->parallel_mode = PARMODE_DEFAULT;
+                hint->parallel_mode = PARMODE_DEFAULT;
             else
                 ereport(ERROR, errmsg("[pg_lab] Unknown parallelization mode setting: %s", ctx->getText().c_str()));
 
-            hints_->contains_hint = true;
+            AddHint(hint);
         }
 
-        void enterJoin_order_hint(pg_lab::HintBlockParser::Join_order_hintContext *ctx) override
+        void enterPlan_cache_setting(pg_lab::HintBlockParser::Plan_cache_settingContext *ctx) override
         {
-            if (hints_->join_prefixes)
-                ereport(ERROR, errmsg("Cannot combine JoinOrder hint with JoinPrefix hint"));
+            HintSpec *hint = MakeHintSpec(HS_PLAN_CACHE_MODE);
 
-            auto join_order = this->ParseJoinOrder(ctx->join_order_entry());
-            hints_->join_order_hint = join_order;
-            hints_->contains_hint = true;
-
-            #ifdef PGLAB_TRACE
-
-            StringInfo joinorder_debug = makeStringInfo();
-            joinorder_to_string(join_order, joinorder_debug);
-            ereport(INFO, (errmsg("Creating join order hint"), errdetail("%s", joinorder_debug->data)));
-            destroyStringInfo(joinorder_debug);
+            if (ctx->GENERIC())
+                hint->plan_cache_mode = PLANCACHE_GENERIC;
+            else if (ctx->CUSTOM())
+                hint->plan_cache_mode = PLANCACHE_CUSTOM;
+            else if (ctx->DEFAULT())
+                hint->plan_cache_mode = PLANCACHE_DEFAULT;
+            else
+                ereport(ERROR, errmsg("[pg_lab] Unknown plan cache setting: %s", ctx->getText().c_str()));
 
-            #endif
+            AddHint(hint);
+        }
 
+        void enterJoin_order_hint(pg_lab::HintBlockParser::Join_order_hintContext *ctx) override
+        {
+            HintSpec *hint = MakeHintSpec(HS_JOIN_ORDER);
+            hint->join_order = this->ParseJoinOrder(ctx->join_order_entry());
+            AddHint(hint);
         }
 
         void enterJoin_prefix_hint(pg_lab::HintBlockParser::Join_prefix_hintContext *ctx) override
         {
-            if (hints_->join_order_hint)
-                ereport(ERROR, errmsg("Cannot combine JoinPrefix hint with JoinOrder hint"));
-
-            auto join_order = this->ParseJoinOrder(ctx->join_order_entry());
-            hints_->join_prefixes = lappend(hints_->join_prefixes, join_order);
-            hints_->contains_hint = true;
+            HintSpec *hint = MakeHintSpec(HS_JOIN_PREFIX);
+            hint->join_order = this->ParseJoinOrder(ctx->join_order_entry());
+            AddHint(hint);
         }
 
         void enterJoin_op_hint(pg_lab::HintBlockParser::Join_op_hintContext *ctx) override
         {
+            HintSpec *hint = MakeHintSpec(HS_OPERATOR);
 
-            List *relnames = NIL;
             for (const auto &rel_ctx : ctx->binary_rel_id()->relation_id())
             {
                 auto relname = pstrdup(rel_ctx->getText().c_str());
-                relnames = lappend(relnames, relname);
+                hint->relnames = lappend(hint->relnames, relname);
             }
 
             for (const auto &rel_ctx : ctx->relation_id())
             {
                 auto relname = pstrdup(rel_ctx->getText().c_str());
-                relnames = lappend(relnames, relname);
+                hint->relnames = lappend(hint->relnames, relname);
             }
 
-
-            PhysicalOperator op = OP_UNKNOWN;
             if (ctx->NESTLOOP())
-                op = OP_NESTLOOP;
+                hint->op = OP_NESTLOOP;
             else if (ctx->HASHJOIN())
-                op = OP_HASHJOIN;
+                hint->op = OP_HASHJOIN;
             else if (ctx->MERGEJOIN())
-                op = OP_MERGEJOIN;
+                hint->op = OP_MERGEJOIN;
             else if (ctx->MEMOIZE())
-                op = OP_MEMOIZE;
+                hint->op = OP_MEMOIZE;
             else if (ctx->MATERIALIZE())
-                op = OP_MATERIALIZE;
+                hint->op = OP_MATERIALIZE;
             else
                 ereport(ERROR, errmsg("[pg_lab] Unknown join operator: %s", ctx->getText().c_str()));
 
-            ParseOperatorHint(relnames, op, ctx->param_list());
-            list_free_deep(relnames);
+            ParseOperatorParams(hint, ctx->param_list());
+            AddHint(hint);
         }
 
         void enterScan_op_hint(pg_lab::HintBlockParser::Scan_op_hintContext *ctx) override {
+            HintSpec *hint = MakeHintSpec(HS_OPERATOR);
+
             auto relname = pstrdup(ctx->relation_id()->getText().c_str());
-            List *relnames = list_make1(relname);
+            hint->relnames = list_make1(relname);
 
-            PhysicalOperator op = OP_UNKNOWN;
             if (ctx->SEQSCAN())
-                op = OP_SEQSCAN;
+                hint->op = OP_SEQSCAN;
             else if (ctx->IDXSCAN())
-                op = OP_IDXSCAN;
+                hint->op = OP_IDXSCAN;
             else if (ctx->BITMAPSCAN())
-                op = OP_BITMAPSCAN;
+                hint->op = OP_BITMAPSCAN;
             else if (ctx->MEMOIZE())
-                op = OP_MEMOIZE;
+                hint->op = OP_MEMOIZE;
             else if (ctx->MATERIALIZE())
-                op = OP_MATERIALIZE;
+                hint->op = OP_MATERIALIZE;
             else
                 ereport(ERROR, errmsg("[pg_lab] Unknown scan operator: %s", ctx->getText().c_str()));
 
+            ParseOperatorParams(hint, ctx->param_list());
+            AddHint(hint);
+        }
+
+        void enterCost_op_hint(pg_lab::HintBlockParser::Cost_op_hintContext *ctx) override
+        {
+            HintSpec *hint = MakeHintSpec(HS_OPERATOR);
+
+            for (const auto &rel_ctx : ctx->relation_id())
+            {
+                auto relname = pstrdup(rel_ctx->getText().c_str());
+                hint->relnames = lappend(hint->relnames, relname);
+            }
+
+            if (ctx->SORT())
+                hint->op = OP_SORT;
+            else if (ctx->INCSORT())
+                hint->op = OP_INCSORT;
+            else if (ctx->GATHER())
+                hint->op = OP_GATHER;
+            else if (ctx->GATHERMERGE())
+                hint->op = OP_GATHERMERGE;
+            else if (ctx->APPEND())
+                hint->op = OP_APPEND;
+            else
+                ereport(ERROR, errmsg("[pg_lab] Unknown operator: %s", ctx->getText().c_str()));
 
-            ParseOperatorHint(relnames, op, ctx->param_list());
-            list_free_deep(relnames);
+            ParseOperatorParams(hint, ctx->param_list());
+            AddHint(hint);
         }
 
         void enterResult_hint(pg_lab::HintBlockParser::Result_hintContext *ctx) override
         {
+            HintSpec *hint;
+
             if (!ctx->parallel_hint())
             {
                 ereport(WARNING, errmsg("[pg_lab] Ignoring empty Result hint"));
                 return;
             }
 
-            if (hints_->parallelize_entire_plan)
-            {
-                ereport(WARNING,
-                    errmsg("[pg_lab] Found multiple parallel hints"),
-                    errdetail("Postgres normally creates only one parallel subplan. This might break the query."));
-            }
-
-            hints_->parallel_workers = ParseParallelWorkers(ctx->parallel_hint());
-            hints_->parallelize_entire_plan = true;
-            hints_->parallel_mode = PARMODE_PARALLEL;
+            hint = MakeHintSpec(HS_RESULT);
+            hint->parallel_workers = ParseParallelWorkers(ctx->parallel_hint());
+            AddHint(hint);
         }
 
         void enterCardinality_hint(pg_lab::HintBlockParser::Cardinality_hintContext *ctx) override
         {
-            List *relnames = NIL;
+            HintSpec *hint = MakeHintSpec(HS_CARDINALITY);
+
             for (const auto &rel_ctx : ctx->relation_id())
             {
                 auto relname = pstrdup(rel_ctx->getText().c_str());
-                relnames = lappend(relnames, relname);
+                hint->relnames = lappend(hint->relnames, relname);
             }
 
-            Cardinality cardinality = std::atof(ctx->INT()->getText().c_str());
-
-            MakeCardHint(root_, hints_, relnames, cardinality);
-            list_free_deep(relnames);
+            hint->card = std::atof(ctx->INT()->getText().c_str());
+            AddHint(hint);
         }
 
-        void enterGuc_hint(pg_lab::HintBlockParser::Guc_hintContext *ctx) override
+        void enterCardinality_scale_hint(pg_lab::HintBlockParser::Cardinality_scale_hintContext *ctx) override
         {
-            auto guc_name = ctx->guc_name()->getText();
-            auto guc_value = ctx->guc_value()->getText();
+            HintSpec *hint = MakeHintSpec(HS_CARDINALITY_SCALE);
+
+            for (const auto &rel_ctx : ctx->relation_id())
+            {
+                auto relname = pstrdup(rel_ctx->getText().c_str());
+                hint->relnames = lappend(hint->relnames, relname);
+            }
 
-            auto cleanup = MakeGUCHint(hints_, guc_name.c_str(), guc_value.c_str());
-            if (cleanup)
-                temp_gucs_.push_back(cleanup);
+            auto factor = ctx->FLOAT() ? ctx->FLOAT() : ctx->INT();
+            hint->scale_factor = std::atof(factor->getText().c_str());
+            AddHint(hint);
         }
 
-        void ExportGucCleanup()
+        void enterGuc_hint(pg_lab::HintBlockParser::Guc_hintContext *ctx) override
         {
-            InitGucCleanup(temp_gucs_.size());
-            for (const auto &temp_guc : temp_gucs_)
-                StoreGucCleanup(temp_guc);
+            HintSpec *hint = MakeHintSpec(HS_GUC);
+            hint->guc_name = pstrdup(ctx->guc_name()->getText().c_str());
+            hint->guc_value = pstrdup(ctx->guc_value()->getText().c_str());
+            AddHint(hint);
         }
 
     private:
-        PlannerInfo  *root_;
-        PlannerHints *hints_;
-        std::vector<TempGUC *> temp_gucs_;
+        HintBlockSpec *spec_;
+
+        void AddHint(HintSpec *hint)
+        {
+            spec_->hints = lappend(spec_->hints, hint);
+        }
 
         float ParseParallelWorkers(pg_lab::HintBlockParser::Parallel_hintContext *ctx)
         {
@@ -216,23 +240,15 @@ class HintBlockListener : public pg_lab::HintBlockBaseListener
             return std::atof(ctx->INT()->getText().c_str());
         }
 
-        void ParseOperatorHint(List *relnames, PhysicalOperator op, pg_lab::HintBlockParser::Param_listContext *ctx)
+        void ParseOperatorParams(HintSpec *hint, pg_lab::HintBlockParser::Param_listContext *ctx)
         {
-            float par_workers = NAN;
-            if (ctx && ctx->parallel_hint().size() > 0)
-            {
-                if (hints_->parallel_rels || hints_->parallelize_entire_plan)
-                {
-                    ereport(ERROR, (
-                            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-                            errmsg("[pg_lab] Found multiple parallel hints"),
-                            errdetail("Postgres only supports one parallel subplan.")));
-                }
+            if (!ctx)
+                return;
 
-                par_workers = ParseParallelWorkers(ctx->parallel_hint().back());
-            }
+            if (ctx->parallel_hint().size() > 0)
+                hint->parallel_workers = ParseParallelWorkers(ctx->parallel_hint().back());
 
-            if (ctx && ctx->cost_hint().size() > 1)
+            if (ctx->cost_hint().size() > 0)
             {
                 auto cost_hint = ctx->cost_hint().back();
                 if (cost_hint->cost().size() != 2)
@@ -240,19 +256,10 @@ class HintBlockListener : public pg_lab::HintBlockBaseListener
                     ereport(ERROR, errmsg("[pg_lab] Invalid cost hint format: '%s'", cost_hint->getText().c_str()));
                     return;
                 }
-                auto startup_cost = ParseCost(cost_hint->cost().front());
-                auto total_cost = ParseCost(cost_hint->cost().back());
-                MakeCostHint(root_, hints_, relnames, op, startup_cost, total_cost);
-                return;
+                hint->has_cost = true;
+                hint->startup_cost = ParseCost(cost_hint->cost().front());
+                hint->total_cost = ParseCost(cost_hint->cost().back());
             }
-
-
-            if (op == OP_MEMOIZE)
-                MakeIntermediateOpHint(root_, hints_, relnames, false, true, par_workers);
-            else if (op == OP_MATERIALIZE)
-                MakeIntermediateOpHint(root_, hints_, relnames, true, false, par_workers);
-            else
-                MakeOperatorHint(root_, hints_, relnames, op, par_workers);
         }
 
         Cost ParseCost(pg_lab::HintBlockParser::CostContext *ctx)
@@ -268,7 +275,7 @@ class HintBlockListener : public pg_lab::HintBlockBaseListener
             }
         }
 
-        JoinOrder *ParseJoinOrder(pg_lab::HintBlockParser::Join_order_entryContext *ctx)
+        JoinOrderSpec *ParseJoinOrder(pg_lab::HintBlockParser::Join_order_entryContext *ctx)
         {
             auto base_join_order = ctx->base_join_order();
             if (base_join_order)
@@ -277,49 +284,106 @@ class HintBlockListener : public pg_lab::HintBlockBaseListener
                 return ParseJoinOrderIntermediate(ctx->intermediate_join_order());
         }
 
-        JoinOrder *ParseJoinOrderIntermediate(pg_lab::HintBlockParser::Intermediate_join_orderContext *ctx)
+        JoinOrderSpec *ParseJoinOrderIntermediate(pg_lab::HintBlockParser::Intermediate_join_orderContext *ctx)
         {
             Assert(ctx->join_order_entry().size() == 2);
             auto outer_child = ParseJoinOrder(ctx->join_order_entry().front());
             auto inner_child = ParseJoinOrder(ctx->join_order_entry().back());
-            return MakeJoinOrderIntermediate(root_, outer_child, inner_child);
+            return MakeJoinOrderSpecIntermediate(outer_child, inner_child);
         }
 
-        JoinOrder *ParseJoinOrderBase(pg_lab::HintBlockParser::Base_join_orderContext *ctx)
+        JoinOrderSpec *ParseJoinOrderBase(pg_lab::HintBlockParser::Base_join_orderContext *ctx)
         {
-            auto relname = pstrdup(ctx->relation_id()->getText().c_str());
-            auto join_order = MakeJoinOrderBase(root_, relname);
-            pfree(relname);
-            return join_order;
+            return MakeJoinOrderSpecBase(ctx->relation_id()->getText().c_str());
         }
 
 };
 
+/*
+ * Parses the raw hint text (including the surrounding comment markers) into a HintBlockSpec using the ANTLR parser.
+ *
+ * The spec is allocated in the current memory context.
+ */
+extern "C" HintBlockSpec *
+antlr_parse_hint_text(const char *hint_text)
+{
+    HintBlockSpec *spec;
+
+    spec = (HintBlockSpec *) palloc0(sizeof(HintBlockSpec));
+    spec->hints = NIL;
+
+    antlr4::ANTLRInputStream parser_input(hint_text);
+    pg_lab::HintBlockLexer lexer(&parser_input);
+    antlr4::CommonTokenStream tokens(&lexer);
+    pg_lab::HintBlockParser parser(&tokens);
+
+    antlr4::tree::ParseTree *tree = parser.hint_block();
+    HintBlockListener listener(spec);
+    antlr4::tree::ParseTreeWalker::DEFAULT.walk(&listener, tree);
+
+    return spec;
+}
+
+/*
+ * Extracts the hint block from a raw query string. Returns NULL if the query does not contain a hint block.
+ */
+static char *
+extract_hint_block(const char *raw_query)
+{
+    const char *hb_start, *hb_end;
+
+    hb_start = strstr(raw_query, "/*=pg_lab=");
+    hb_end = hb_start ? strstr(hb_start, "*/") : NULL;
+    if (!hb_start || !hb_end)
+        return NULL;
+
+    return pnstrdup(hb_start, hb_end - hb_start + 2);
+}
+
 extern "C" void
 parse_hint_block(PlannerInfo *root, PlannerHints *hints)
 {
-    std::string query_buffer = std::string(hints->raw_query);
-    auto hb_start = query_buffer.find("/*=pg_lab=");
-    auto hb_end   = query_buffer.find("*/");
-    if (hb_start == std::string::npos || hb_end == std::string::npos)
+    HintBlockSpec *spec;
+
+    hints->raw_hint = extract_hint_block(hints->raw_query);
+    if (!hints->raw_hint)
     {
         hints->contains_hint = false;
         return;
     }
 
-    auto hint_string = query_buffer.substr(hb_start, hb_end - hb_start + 2);
-    hints->raw_hint = (char *) pstrdup(hint_string.c_str());
+    spec = fetch_hint_block_spec(hints->raw_hint);
+    build_alias_lookup(root, hints);
+    bind_hint_block(root, hints, spec);
+}
+
+/*
+ * Determines the plan cache setting of the hint block of a prepared statement.
+ *
+ * This is called when the statement is prepared. As a side effect, the hint block is parsed and put into the hint cache,
+ * such that subsequent planner runs of the statement only need to bind it.
+ */
+extern "C" HintPlanCacheMode
+fetch_plan_cache_hint(const char *query_string)
+{
+    HintPlanCacheMode mode = PLANCACHE_DEFAULT;
+    HintBlockSpec *spec;
+    ListCell *lc;
+    char *raw_hint;
 
-    antlr4::ANTLRInputStream parser_input(hint_string);
-    pg_lab::HintBlockLexer lexer(&parser_input);
-    antlr4::CommonTokenStream tokens(&lexer);
-    pg_lab::HintBlockParser parser(&tokens);
+    raw_hint = query_string ? extract_hint_block(query_string) : NULL;
+    if (!raw_hint)
+        return PLANCACHE_DEFAULT;
 
-    antlr4::tree::ParseTree *tree = parser.hint_block();
-    HintBlockListener listener(root, hints);
-    antlr4::tree::ParseTreeWalker::DEFAULT.walk(&listener, tree);
-    listener.ExportGucCleanup();
+    spec = fetch_hint_block_spec(raw_hint);
+    foreach (lc, spec->hints)
+    {
+        HintSpec *hint = (HintSpec *) lfirst(lc);
+
+        if (hint->tag == HS_PLAN_CACHE_MODE)
+            mode = hint->plan_cache_mode;
+    }
 
-    if (hints->mode == HINTMODE_FULL && hints->parallel_mode == PARMODE_DEFAULT)
-        hints->parallel_mode = PARMODE_SEQUENTIAL;
+    pfree(raw_hint);
+    return mode;
 }
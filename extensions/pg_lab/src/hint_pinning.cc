@@ -0,0 +1,595 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <limits.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "access/xact.h"
+#include "catalog/pg_authid.h"
+#include "commands/extension.h"
+#include "executor/spi.h"
+#include "nodes/queryjumble.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "hint_pinning.h"
+
+/*
+ * Shared-memory repository of pinned hint blocks.
+ *
+ * A pinned hint block is applied to all queries of a database that share the same query identifier (as computed during
+ * post-parse analysis), unless the query already contains a hint block of its own. This allows to fix the plans of
+ * queries without changing the SQL text that is sent by the application.
+ *
+ * The persistent copy of the pinned hint blocks lives in the pg_lab_pinned_hints table of each database. The SQL functions
+ * pg_lab_pin_hints() and pg_lab_unpin_hints() keep the table and the shared hash table in sync. To make sure that the shared
+ * hash table never contains hint blocks that are not in the table, modifications are only applied to the shared hash table
+ * once the transaction commits.
+ *
+ * Since the shared hash table does not survive a server restart, the pinned hint blocks of a database are loaded from the
+ * table the first time a planner probes the hash table in that database. pg_lab_load_pinned_hints() re-populates the
+ * shared hash table explicitly, e.g. after the table has been modified directly.
+ *
+ * The planner only needs a shared lock to probe the hash table. If no hint blocks are pinned at all, not even the lock is
+ * acquired. Pinning is only available if pg_lab is loaded via shared_preload_libraries.
+ */
+
+#define PINNED_HINTS_TEXT_LEN 4096
+
+/* Number of databases whose pinned hint blocks are known to be loaded. Databases beyond this limit load them per backend. */
+#define PINNED_HINTS_MAX_DATABASES 64
+
+typedef struct PinnedHintsKey
+{
+    Oid    dbid;
+    uint64 queryid;
+} PinnedHintsKey;
+
+typedef struct PinnedHintsEntry
+{
+    PinnedHintsKey key;
+    char           hint_text[PINNED_HINTS_TEXT_LEN];
+} PinnedHintsEntry;
+
+typedef struct PinnedHintsSharedState
+{
+    LWLock           *lock;
+    pg_atomic_uint32  n_entries;  /* allows the planner to skip the lookup if nothing is pinned */
+    int               n_loaded_dbs;
+    Oid               loaded_dbs[PINNED_HINTS_MAX_DATABASES];  /* databases whose table has been loaded */
+} PinnedHintsSharedState;
+
+typedef enum PinnedHintsAction
+{
+    PINNED_HINTS_STORE,
+    PINNED_HINTS_REMOVE,
+    PINNED_HINTS_CLEAR
+} PinnedHintsAction;
+
+/*
+ * A modification of the shared hash table that is applied once the current transaction commits.
+ */
+typedef struct PendingPinnedHints
+{
+    PinnedHintsAction action;
+    SubTransactionId  subid;      /* the subtransaction that requested the modification */
+    uint64            queryid;    /* not used for PINNED_HINTS_CLEAR */
+    char             *hint_text;  /* only for PINNED_HINTS_STORE */
+} PendingPinnedHints;
+
+static int pglab_pinned_hints_max = 1000;
+
+static PinnedHintsSharedState *pinned_hints_state = NULL;
+static HTAB *pinned_hints_hash = NULL;
+
+/* Modifications of the current transaction, allocated in the TopTransactionContext */
+static List *pending_pinned_hints = NIL;
+
+/* Whether this backend has made sure that the pinned hint blocks of its database are loaded */
+static bool pinned_hints_loaded = false;
+static bool pinned_hints_loading = false;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+PG_FUNCTION_INFO_V1(pg_lab_store_pinned_hints);
+PG_FUNCTION_INFO_V1(pg_lab_remove_pinned_hints);
+PG_FUNCTION_INFO_V1(pg_lab_clear_pinned_hints);
+
+static Size
+pinned_hints_memsize(void)
+{
+    Size size;
+
+    size = MAXALIGN(sizeof(PinnedHintsSharedState));
+    size = add_size(size, hash_estimate_size(pglab_pinned_hints_max, sizeof(PinnedHintsEntry)));
+
+    return size;
+}
+
+static void
+pinned_hints_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+
+    RequestAddinShmemSpace(pinned_hints_memsize());
+    RequestNamedLWLockTranche("pg_lab pinned hints", 1);
+}
+
+static void
+pinned_hints_shmem_startup(void)
+{
+    HASHCTL hctl;
+    bool found;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    pinned_hints_state = (PinnedHintsSharedState *) ShmemInitStruct("pg_lab pinned hints",
+                                                                    sizeof(PinnedHintsSharedState),
+                                                                    &found);
+    if (!found)
+    {
+        pinned_hints_state->lock = &(GetNamedLWLockTranche("pg_lab pinned hints"))->lock;
+        pg_atomic_init_u32(&pinned_hints_state->n_entries, 0);
+        pinned_hints_state->n_loaded_dbs = 0;
+    }
+
+    hctl.keysize = sizeof(PinnedHintsKey);
+    hctl.entrysize = sizeof(PinnedHintsEntry);
+    pinned_hints_hash = ShmemInitHash("pg_lab pinned hints hash",
+                                      pglab_pinned_hints_max, pglab_pinned_hints_max,
+                                      &hctl,
+                                      HASH_ELEM | HASH_BLOBS);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Stores a hint block in the shared hash table. The caller must hold the lock in exclusive mode.
+ *
+ * Returns false if the hash table is full.
+ */
+static bool
+store_pinned_hints_entry(Oid dbid, uint64 queryid, const char *hint_text)
+{
+    PinnedHintsKey key;
+    PinnedHintsEntry *entry;
+    bool found;
+
+    memset(&key, 0, sizeof(PinnedHintsKey));
+    key.dbid = dbid;
+    key.queryid = queryid;
+
+    entry = (PinnedHintsEntry *) hash_search(pinned_hints_hash, &key, HASH_FIND, NULL);
+    if (!entry && hash_get_num_entries(pinned_hints_hash) >= pglab_pinned_hints_max)
+        return false;
+
+    entry = (PinnedHintsEntry *) hash_search(pinned_hints_hash, &key, HASH_ENTER, &found);
+    strlcpy(entry->hint_text, hint_text, PINNED_HINTS_TEXT_LEN);
+    if (!found)
+        pg_atomic_add_fetch_u32(&pinned_hints_state->n_entries, 1);
+
+    return true;
+}
+
+/*
+ * Removes a hint block from the shared hash table. The caller must hold the lock in exclusive mode.
+ */
+static void
+remove_pinned_hints_entry(Oid dbid, uint64 queryid)
+{
+    PinnedHintsKey key;
+    bool found;
+
+    memset(&key, 0, sizeof(PinnedHintsKey));
+    key.dbid = dbid;
+    key.queryid = queryid;
+
+    hash_search(pinned_hints_hash, &key, HASH_REMOVE, &found);
+    if (found)
+        pg_atomic_sub_fetch_u32(&pinned_hints_state->n_entries, 1);
+}
+
+/*
+ * Removes all hint blocks of a database from the shared hash table. The caller must hold the lock in exclusive mode.
+ */
+static void
+clear_pinned_hints_entries(Oid dbid)
+{
+    HASH_SEQ_STATUS hstat;
+    PinnedHintsEntry *entry;
+
+    hash_seq_init(&hstat, pinned_hints_hash);
+    while ((entry = (PinnedHintsEntry *) hash_seq_search(&hstat)) != NULL)
+    {
+        if (entry->key.dbid != dbid)
+            continue;
+
+        hash_search(pinned_hints_hash, &entry->key, HASH_REMOVE, NULL);
+        pg_atomic_sub_fetch_u32(&pinned_hints_state->n_entries, 1);
+    }
+}
+
+static bool
+pinned_hints_db_loaded(Oid dbid)
+{
+    for (int i = 0; i < pinned_hints_state->n_loaded_dbs; i++)
+    {
+        if (pinned_hints_state->loaded_dbs[i] == dbid)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Populates the shared hash table from the pg_lab_pinned_hints table of the current database, unless this has already been
+ * done by some other backend since the server started.
+ */
+static void
+load_pinned_hints(void)
+{
+    Oid extension_oid;
+    Oid save_userid;
+    int save_sec_context;
+    char *query;
+    bool loaded;
+
+    if (!IsTransactionState() || !ActiveSnapshotSet())
+        return;
+
+    LWLockAcquire(pinned_hints_state->lock, LW_SHARED);
+    loaded = pinned_hints_db_loaded(MyDatabaseId);
+    LWLockRelease(pinned_hints_state->lock);
+
+    if (loaded)
+    {
+        pinned_hints_loaded = true;
+        return;
+    }
+
+    /* Without the extension, there is no table to load from. Hint blocks can only be pinned once it has been created. */
+    extension_oid = get_extension_oid("pg_lab", true);
+    if (!OidIsValid(extension_oid))
+        return;
+
+    query = psprintf("SELECT queryid, hint_block FROM %s.pg_lab_pinned_hints",
+                     quote_identifier(get_namespace_name(get_extension_schema(extension_oid))));
+
+    /*
+     * The query is planned by ourselves, so we need to make sure to not end up here again. Furthermore, the current user
+     * might not be allowed to read the table, so we switch to the superuser (just like autovacuum does).
+     */
+    pinned_hints_loading = true;
+    GetUserIdAndSecContext(&save_userid, &save_sec_context);
+    SetUserIdAndSecContext(BOOTSTRAP_SUPERUSERID,
+                           save_sec_context | SECURITY_LOCAL_USERID_CHANGE | SECURITY_RESTRICTED_OPERATION);
+    PG_TRY();
+    {
+        SPI_connect();
+        SPI_execute(query, true, 0);
+
+        LWLockAcquire(pinned_hints_state->lock, LW_EXCLUSIVE);
+        if (!pinned_hints_db_loaded(MyDatabaseId))
+        {
+            for (uint64 i = 0; i < SPI_processed; i++)
+            {
+                HeapTuple tuple = SPI_tuptable->vals[i];
+                bool isnull;
+                uint64 queryid;
+                char *hint_text;
+
+                queryid = (uint64) DatumGetInt64(SPI_getbinval(tuple, SPI_tuptable->tupdesc, 1, &isnull));
+                hint_text = TextDatumGetCString(SPI_getbinval(tuple, SPI_tuptable->tupdesc, 2, &isnull));
+
+                if (!store_pinned_hints_entry(MyDatabaseId, queryid, hint_text))
+                {
+                    ereport(WARNING,
+                            errmsg("[pg_lab] could not load all pinned hint blocks, the shared memory is full"),
+                            errhint("Increase pglab.pinned_hints_max."));
+                    break;
+                }
+            }
+
+            if (pinned_hints_state->n_loaded_dbs < PINNED_HINTS_MAX_DATABASES)
+                pinned_hints_state->loaded_dbs[pinned_hints_state->n_loaded_dbs++] = MyDatabaseId;
+        }
+        LWLockRelease(pinned_hints_state->lock);
+
+        SPI_finish();
+    }
+    PG_FINALLY();
+    {
+        SetUserIdAndSecContext(save_userid, save_sec_context);
+        pinned_hints_loading = false;
+    }
+    PG_END_TRY();
+
+    pinned_hints_loaded = true;
+    pfree(query);
+}
+
+/*
+ * Applies the modifications of a committed transaction to the shared hash table.
+ */
+static void
+apply_pending_pinned_hints(void)
+{
+    ListCell *lc;
+
+    LWLockAcquire(pinned_hints_state->lock, LW_EXCLUSIVE);
+
+    foreach (lc, pending_pinned_hints)
+    {
+        PendingPinnedHints *pending = (PendingPinnedHints *) lfirst(lc);
+
+        switch (pending->action)
+        {
+            case PINNED_HINTS_STORE:
+                if (!store_pinned_hints_entry(MyDatabaseId, pending->queryid, pending->hint_text))
+                    ereport(WARNING,
+                            errmsg("[pg_lab] hint block for query " INT64_FORMAT " is not active, the shared memory is full",
+                                   (int64) pending->queryid),
+                            errhint("Increase pglab.pinned_hints_max and restart the server."));
+                break;
+            case PINNED_HINTS_REMOVE:
+                remove_pinned_hints_entry(MyDatabaseId, pending->queryid);
+                break;
+            case PINNED_HINTS_CLEAR:
+                clear_pinned_hints_entries(MyDatabaseId);
+                break;
+        }
+    }
+
+    LWLockRelease(pinned_hints_state->lock);
+}
+
+static void
+pinned_hints_xact_callback(XactEvent event, void *arg)
+{
+    switch (event)
+    {
+        case XACT_EVENT_COMMIT:
+        case XACT_EVENT_PARALLEL_COMMIT:
+            if (pending_pinned_hints != NIL)
+                apply_pending_pinned_hints();
+            pending_pinned_hints = NIL;
+            break;
+        case XACT_EVENT_PRE_PREPARE:
+            /*
+             * The pending modifications live in the TopTransactionContext, which does not survive the PREPARE. Since the
+             * shared memory is not WAL-logged, we cannot apply them at COMMIT PREPARED either.
+             */
+            if (pending_pinned_hints != NIL)
+                ereport(ERROR,
+                        errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("[pg_lab] cannot PREPARE a transaction that has pinned or unpinned hint blocks"));
+            break;
+        case XACT_EVENT_PREPARE:
+        case XACT_EVENT_ABORT:
+        case XACT_EVENT_PARALLEL_ABORT:
+            pending_pinned_hints = NIL;
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+pinned_hints_subxact_callback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg)
+{
+    ListCell *lc;
+
+    switch (event)
+    {
+        case SUBXACT_EVENT_COMMIT_SUB:
+            foreach (lc, pending_pinned_hints)
+            {
+                PendingPinnedHints *pending = (PendingPinnedHints *) lfirst(lc);
+                if (pending->subid == mySubid)
+                    pending->subid = parentSubid;
+            }
+            break;
+        case SUBXACT_EVENT_ABORT_SUB:
+            foreach (lc, pending_pinned_hints)
+            {
+                PendingPinnedHints *pending = (PendingPinnedHints *) lfirst(lc);
+                if (pending->subid == mySubid)
+                    pending_pinned_hints = foreach_delete_current(pending_pinned_hints, lc);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Remembers a modification of the shared hash table until the current transaction commits.
+ */
+static void
+register_pending_pinned_hints(PinnedHintsAction action, uint64 queryid, const char *hint_text)
+{
+    PendingPinnedHints *pending;
+    MemoryContext oldcontext;
+
+    oldcontext = MemoryContextSwitchTo(TopTransactionContext);
+
+    pending = (PendingPinnedHints *) palloc(sizeof(PendingPinnedHints));
+    pending->action = action;
+    pending->subid = GetCurrentSubTransactionId();
+    pending->queryid = queryid;
+    pending->hint_text = hint_text ? pstrdup(hint_text) : NULL;
+    pending_pinned_hints = lappend(pending_pinned_hints, pending);
+
+    MemoryContextSwitchTo(oldcontext);
+}
+
+void
+init_hint_pinning(void)
+{
+    if (!process_shared_preload_libraries_in_progress)
+        return;
+
+    DefineCustomIntVariable("pglab.pinned_hints_max",
+                            "Maximum number of hint blocks that can be pinned to queries.",
+                            "Set to 0 to disable hint pinning.",
+                            &pglab_pinned_hints_max, 1000,
+                            0, INT_MAX / 2,
+                            PGC_POSTMASTER, 0,
+                            NULL, NULL, NULL);
+
+    if (pglab_pinned_hints_max <= 0)
+        return;
+
+    /* Pinned hint blocks are identified by their query identifier, so we need Postgres to compute it. */
+    EnableQueryId();
+
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = pinned_hints_shmem_request;
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = pinned_hints_shmem_startup;
+
+    RegisterXactCallback(pinned_hints_xact_callback, NULL);
+    RegisterSubXactCallback(pinned_hints_subxact_callback, NULL);
+}
+
+char *
+fetch_pinned_hints(uint64 queryid)
+{
+    PinnedHintsKey key;
+    PinnedHintsEntry *entry;
+    char *hint_text;
+
+    if (!pinned_hints_hash || queryid == UINT64CONST(0))
+        return NULL;
+
+    if (!pinned_hints_loaded && !pinned_hints_loading)
+        load_pinned_hints();
+
+    if (pg_atomic_read_u32(&pinned_hints_state->n_entries) == 0)
+        return NULL;
+
+    memset(&key, 0, sizeof(PinnedHintsKey));
+    key.dbid = MyDatabaseId;
+    key.queryid = queryid;
+
+    LWLockAcquire(pinned_hints_state->lock, LW_SHARED);
+    entry = (PinnedHintsEntry *) hash_search(pinned_hints_hash, &key, HASH_FIND, NULL);
+    hint_text = entry ? pstrdup(entry->hint_text) : NULL;
+    LWLockRelease(pinned_hints_state->lock);
+
+    return hint_text;
+}
+
+static void
+check_pinned_hints_available(void)
+{
+    if (!pinned_hints_hash)
+        ereport(ERROR,
+                errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                errmsg("pg_lab hint pinning is not available"),
+                errhint("pg_lab must be loaded via shared_preload_libraries and pglab.pinned_hints_max must be positive."));
+}
+
+/*
+ * Pins a hint block to a query, once the current transaction commits.
+ */
+Datum
+pg_lab_store_pinned_hints(PG_FUNCTION_ARGS)
+{
+    PinnedHintsKey key;
+    char *hint_text;
+    bool full;
+
+    check_pinned_hints_available();
+
+    hint_text = text_to_cstring(PG_GETARG_TEXT_PP(1));
+    if (!strstr(hint_text, "/*=pg_lab=") || !strstr(hint_text, "*/"))
+        ereport(ERROR,
+                errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("pinned hints must be a pg_lab hint block"),
+                errhint("Hint blocks start with /*=pg_lab= and end with */."));
+
+    if (strlen(hint_text) >= PINNED_HINTS_TEXT_LEN)
+        ereport(ERROR,
+                errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                errmsg("pinned hint block is too long"),
+                errdetail("Pinned hint blocks can be at most %d bytes long.", PINNED_HINTS_TEXT_LEN - 1));
+
+    memset(&key, 0, sizeof(PinnedHintsKey));
+    key.dbid = MyDatabaseId;
+    key.queryid = (uint64) PG_GETARG_INT64(0);
+
+    /* We check the capacity right away to report the error to the user. The commit only emits a warning. */
+    LWLockAcquire(pinned_hints_state->lock, LW_SHARED);
+    full = !hash_search(pinned_hints_hash, &key, HASH_FIND, NULL) &&
+           hash_get_num_entries(pinned_hints_hash) >= pglab_pinned_hints_max;
+    LWLockRelease(pinned_hints_state->lock);
+
+    if (full)
+        ereport(ERROR,
+                errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                errmsg("too many pinned hint blocks"),
+                errhint("Increase pglab.pinned_hints_max or unpin some hint blocks."));
+
+    register_pending_pinned_hints(PINNED_HINTS_STORE, key.queryid, hint_text);
+
+    PG_RETURN_VOID();
+}
+
+/*
+ * Unpins the hint block of a query, once the current transaction commits. Returns whether a hint block is currently pinned.
+ */
+Datum
+pg_lab_remove_pinned_hints(PG_FUNCTION_ARGS)
+{
+    PinnedHintsKey key;
+    bool found;
+
+    check_pinned_hints_available();
+
+    memset(&key, 0, sizeof(PinnedHintsKey));
+    key.dbid = MyDatabaseId;
+    key.queryid = (uint64) PG_GETARG_INT64(0);
+
+    LWLockAcquire(pinned_hints_state->lock, LW_SHARED);
+    found = hash_search(pinned_hints_hash, &key, HASH_FIND, NULL) != NULL;
+    LWLockRelease(pinned_hints_state->lock);
+
+    register_pending_pinned_hints(PINNED_HINTS_REMOVE, key.queryid, NULL);
+
+    PG_RETURN_BOOL(found);
+}
+
+/*
+ * Removes all pinned hint blocks of the current database from the shared hash table, once the current transaction commits.
+ */
+Datum
+pg_lab_clear_pinned_hints(PG_FUNCTION_ARGS)
+{
+    check_pinned_hints_available();
+
+    register_pending_pinned_hints(PINNED_HINTS_CLEAR, 0, NULL);
+
+    PG_RETURN_VOID();
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
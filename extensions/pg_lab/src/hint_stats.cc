@@ -0,0 +1,340 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <limits.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "common/hashfn.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/tuplestore.h"
+
+#include "planner_stats.h"
+
+/*
+ * Shared-memory statistics about the hint blocks that have been planned by any backend.
+ *
+ * The statistics are aggregated per database and hint block. Hint blocks are identified by a fingerprint of their raw
+ * text. The design loosely follows pg_stat_statements: the hash table itself is protected by an LWLock, while the counters
+ * of each entry are protected by a spinlock. Each call increases the usage count of the entry. If the hash table is full,
+ * the usage counts of all entries decay and the least used entries are evicted in one go.
+ *
+ * The statistics are only available if pg_lab is loaded via shared_preload_libraries.
+ */
+
+#define HINT_STATS_TEXT_LEN 1024
+#define HINT_STATS_COLS 9
+
+/* Usage count handling, see pg_stat_statements */
+#define HINT_STATS_USAGE_INIT      (1.0)
+#define HINT_STATS_USAGE_DECAY     (0.99)
+#define HINT_STATS_DEALLOC_PERCENT 5
+#define HINT_STATS_DEALLOC_MIN     10
+
+typedef struct HintStatsKey
+{
+    Oid    dbid;
+    uint64 fingerprint;
+} HintStatsKey;
+
+typedef struct HintStatsCounters
+{
+    int64  calls;
+    double total_plan_time;  /* in ms */
+    int64  check_failures;   /* final path did not satisfy the hints and pglab.check_final_path raised an error */
+    int64  fallbacks;        /* final path did not satisfy the hints but was used anyway */
+    double usage;            /* decaying number of calls, used to pick the entries to evict */
+} HintStatsCounters;
+
+typedef struct HintStatsEntry
+{
+    HintStatsKey      key;
+    slock_t           mutex;
+    HintStatsCounters counters;
+    char              hint_text[HINT_STATS_TEXT_LEN]; /* possibly truncated */
+} HintStatsEntry;
+
+typedef struct HintStatsSharedState
+{
+    LWLock *lock;
+} HintStatsSharedState;
+
+static int pglab_hint_stats_max = 1000;
+
+static HintStatsSharedState *hint_stats_state = NULL;
+static HTAB *hint_stats_hash = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+PG_FUNCTION_INFO_V1(pg_lab_hint_stats);
+PG_FUNCTION_INFO_V1(pg_lab_reset_hint_stats);
+
+static Size
+hint_stats_memsize(void)
+{
+    Size size;
+
+    size = MAXALIGN(sizeof(HintStatsSharedState));
+    size = add_size(size, hash_estimate_size(pglab_hint_stats_max, sizeof(HintStatsEntry)));
+
+    return size;
+}
+
+static void
+hint_stats_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+
+    RequestAddinShmemSpace(hint_stats_memsize());
+    RequestNamedLWLockTranche("pg_lab", 1);
+}
+
+static void
+hint_stats_shmem_startup(void)
+{
+    HASHCTL hctl;
+    bool found;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    hint_stats_state = (HintStatsSharedState *) ShmemInitStruct("pg_lab hint stats",
+                                                                sizeof(HintStatsSharedState),
+                                                                &found);
+    if (!found)
+        hint_stats_state->lock = &(GetNamedLWLockTranche("pg_lab"))->lock;
+
+    hctl.keysize = sizeof(HintStatsKey);
+    hctl.entrysize = sizeof(HintStatsEntry);
+    hint_stats_hash = ShmemInitHash("pg_lab hint stats hash",
+                                    pglab_hint_stats_max, pglab_hint_stats_max,
+                                    &hctl,
+                                    HASH_ELEM | HASH_BLOBS);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Sets up the GUCs and shared memory for the hint statistics. Must be called from _PG_init().
+ */
+void
+init_hint_stats(void)
+{
+    if (!process_shared_preload_libraries_in_progress)
+        return;
+
+    DefineCustomIntVariable("pglab.hint_stats_max",
+                            "Maximum number of hint blocks that are tracked in the shared hint statistics.",
+                            "Set to 0 to disable the hint statistics.",
+                            &pglab_hint_stats_max, 1000,
+                            0, INT_MAX / 2,
+                            PGC_POSTMASTER, 0,
+                            NULL, NULL, NULL);
+
+    if (pglab_hint_stats_max <= 0)
+        return;
+
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = hint_stats_shmem_request;
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = hint_stats_shmem_startup;
+}
+
+/*
+ * Checks whether the hint statistics are collected, i.e. whether pg_lab has been loaded via shared_preload_libraries.
+ */
+bool
+hint_stats_enabled(void)
+{
+    return hint_stats_hash != NULL;
+}
+
+static int
+compare_hint_stats_usage(const void *a, const void *b)
+{
+    double usage1 = (*(HintStatsEntry *const *) a)->counters.usage;
+    double usage2 = (*(HintStatsEntry *const *) b)->counters.usage;
+
+    return (usage1 > usage2) - (usage1 < usage2);
+}
+
+/*
+ * Decays the usage of all entries and removes the least used ones from the hash table. The caller must hold the lock in
+ * exclusive mode, so nobody can update the counters concurrently.
+ */
+static void
+evict_hint_stats_entries(void)
+{
+    HASH_SEQ_STATUS hstat;
+    HintStatsEntry *entry;
+    HintStatsEntry **entries;
+    long n_evict;
+    long i = 0;
+
+    entries = (HintStatsEntry **) palloc(hash_get_num_entries(hint_stats_hash) * sizeof(HintStatsEntry *));
+
+    hash_seq_init(&hstat, hint_stats_hash);
+    while ((entry = (HintStatsEntry *) hash_seq_search(&hstat)) != NULL)
+    {
+        entries[i++] = entry;
+        entry->counters.usage *= HINT_STATS_USAGE_DECAY;
+    }
+
+    qsort(entries, i, sizeof(HintStatsEntry *), compare_hint_stats_usage);
+
+    n_evict = Max(HINT_STATS_DEALLOC_MIN, i * HINT_STATS_DEALLOC_PERCENT / 100);
+    n_evict = Min(n_evict, i);
+    for (long j = 0; j < n_evict; j++)
+        hash_search(hint_stats_hash, &entries[j]->key, HASH_REMOVE, NULL);
+
+    pfree(entries);
+}
+
+/*
+ * Adds the outcome of a single planner run to the statistics of its hint block.
+ */
+void
+hint_stats_record(const char *hint_text, double plan_time, bool check_failed, bool fallback)
+{
+    HintStatsKey key;
+    HintStatsEntry *entry;
+    Size hint_len;
+    bool found;
+
+    if (!hint_stats_hash || !hint_text)
+        return;
+
+    hint_len = strlen(hint_text);
+    memset(&key, 0, sizeof(HintStatsKey));
+    key.dbid = MyDatabaseId;
+    key.fingerprint = hash_bytes_extended((const unsigned char *) hint_text, hint_len, 0);
+
+    LWLockAcquire(hint_stats_state->lock, LW_SHARED);
+    entry = (HintStatsEntry *) hash_search(hint_stats_hash, &key, HASH_FIND, NULL);
+
+    if (!entry)
+    {
+        /* We need to create a new entry, which requires an exclusive lock */
+        LWLockRelease(hint_stats_state->lock);
+        LWLockAcquire(hint_stats_state->lock, LW_EXCLUSIVE);
+
+        entry = (HintStatsEntry *) hash_search(hint_stats_hash, &key, HASH_FIND, NULL);
+        if (!entry)
+        {
+            if (hash_get_num_entries(hint_stats_hash) >= pglab_hint_stats_max)
+                evict_hint_stats_entries();
+
+            entry = (HintStatsEntry *) hash_search(hint_stats_hash, &key, HASH_ENTER, &found);
+            Assert(!found);
+            memset(&entry->counters, 0, sizeof(HintStatsCounters));
+            SpinLockInit(&entry->mutex);
+            strlcpy(entry->hint_text, hint_text, HINT_STATS_TEXT_LEN);
+        }
+    }
+
+    SpinLockAcquire(&entry->mutex);
+    entry->counters.calls++;
+    entry->counters.usage += HINT_STATS_USAGE_INIT;
+    entry->counters.total_plan_time += plan_time;
+    if (check_failed)
+        entry->counters.check_failures++;
+    if (fallback)
+        entry->counters.fallbacks++;
+    SpinLockRelease(&entry->mutex);
+
+    LWLockRelease(hint_stats_state->lock);
+}
+
+Datum
+pg_lab_hint_stats(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo;
+    HASH_SEQ_STATUS hstat;
+    HintStatsEntry *entry;
+
+    if (!hint_stats_hash)
+        ereport(ERROR,
+                errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                errmsg("pg_lab hint statistics are not available"),
+                errhint("pg_lab must be loaded via shared_preload_libraries and pglab.hint_stats_max must be positive."));
+
+    InitMaterializedSRF(fcinfo, 0);
+    rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+    LWLockAcquire(hint_stats_state->lock, LW_SHARED);
+
+    hash_seq_init(&hstat, hint_stats_hash);
+    while ((entry = (HintStatsEntry *) hash_seq_search(&hstat)) != NULL)
+    {
+        HintStatsCounters counters;
+        Datum values[HINT_STATS_COLS];
+        bool nulls[HINT_STATS_COLS];
+        int i = 0;
+
+        SpinLockAcquire(&entry->mutex);
+        counters = entry->counters;
+        SpinLockRelease(&entry->mutex);
+
+        memset(nulls, 0, sizeof(nulls));
+
+        values[i++] = ObjectIdGetDatum(entry->key.dbid);
+        values[i++] = Int64GetDatum((int64) entry->key.fingerprint);
+        values[i++] = CStringGetTextDatum(entry->hint_text);
+        values[i++] = Int64GetDatum(counters.calls);
+        values[i++] = Float8GetDatum(counters.total_plan_time);
+        values[i++] = Float8GetDatum(counters.calls > 0 ? counters.total_plan_time / counters.calls : 0.0);
+        values[i++] = Int64GetDatum(counters.check_failures);
+        values[i++] = Int64GetDatum(counters.fallbacks);
+        values[i++] = Float8GetDatum(counters.calls > 0
+                                     ? (double) (counters.check_failures + counters.fallbacks) / counters.calls
+                                     : 0.0);
+        Assert(i == HINT_STATS_COLS);
+
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+    }
+
+    LWLockRelease(hint_stats_state->lock);
+
+    return (Datum) 0;
+}
+
+Datum
+pg_lab_reset_hint_stats(PG_FUNCTION_ARGS)
+{
+    HASH_SEQ_STATUS hstat;
+    HintStatsEntry *entry;
+
+    if (!hint_stats_hash)
+        ereport(ERROR,
+                errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                errmsg("pg_lab hint statistics are not available"),
+                errhint("pg_lab must be loaded via shared_preload_libraries and pglab.hint_stats_max must be positive."));
+
+    LWLockAcquire(hint_stats_state->lock, LW_EXCLUSIVE);
+
+    hash_seq_init(&hstat, hint_stats_hash);
+    while ((entry = (HintStatsEntry *) hash_seq_search(&hstat)) != NULL)
+        hash_search(hint_stats_hash, &entry->key, HASH_REMOVE, NULL);
+
+    LWLockRelease(hint_stats_state->lock);
+
+    PG_RETURN_VOID();
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -28,6 +28,11 @@ PhysicalOperatorToString(PhysicalOperator op)
         case OP_MERGEJOIN:    return "MergeJoin";
         case OP_MEMOIZE:      return "Memoize";
         case OP_MATERIALIZE:  return "Materialize";
+        case OP_SORT:         return "Sort";
+        case OP_INCSORT:      return "IncrementalSort";
+        case OP_GATHER:       return "Gather";
+        case OP_GATHERMERGE:  return "GatherMerge";
+        case OP_APPEND:       return "Append";
         default:              return "Unknown";
     }
 }
@@ -40,6 +45,11 @@ void free_join_order(JoinOrder *join_order)
         free_join_order(join_order->inner_child);
     }
 
+    if (IsRootNode(join_order) && join_order->node_lookup)
+        hash_destroy(join_order->node_lookup);
+    if (IsRootNode(join_order) && join_order->flat)
+        pfree(join_order->flat);
+
     bms_free(join_order->relids);
     if (join_order->base_identifier)
         pfree(join_order->base_identifier);
@@ -47,11 +57,153 @@ void free_join_order(JoinOrder *join_order)
     pfree(join_order);
 }
 
+static void
+register_join_order_nodes(HTAB *lookup, JoinOrder *join_order)
+{
+    JoinOrderLookupEntry *entry;
+    bool found;
+
+    check_stack_depth();
+
+    entry = (JoinOrderLookupEntry *) hash_search(lookup, &(join_order->relids), HASH_ENTER, &found);
+    Assert(!found);
+    entry->node = join_order;
+    join_order->node_lookup = lookup;
+
+    if (join_order->node_type == JOIN_REL)
+    {
+        register_join_order_nodes(lookup, join_order->outer_child);
+        register_join_order_nodes(lookup, join_order->inner_child);
+    }
+}
+
+static int
+flatten_join_order(FlatJoinOrder *flat, JoinOrder *join_order, int depth)
+{
+    FlatJoinOrderNode *flat_node;
+    int subtree_start, outer_index, inner_index, index;
+
+    check_stack_depth();
+
+    subtree_start = flat->n_nodes;
+    outer_index = -1;
+    inner_index = -1;
+    if (join_order->node_type == JOIN_REL)
+    {
+        outer_index = flatten_join_order(flat, join_order->outer_child, depth + 1);
+        inner_index = flatten_join_order(flat, join_order->inner_child, depth + 1);
+    }
+
+    index = flat->n_nodes++;
+    flat_node = &flat->nodes[index];
+    flat_node->node_type = join_order->node_type;
+    flat_node->outer_child = outer_index;
+    flat_node->inner_child = inner_index;
+    flat_node->parent = -1;
+    flat_node->subtree_start = subtree_start;
+    flat_node->level = join_order->level;
+    flat_node->depth = depth;
+    flat_node->rt_index = join_order->node_type == BASE_REL ? join_order->rt_index : 0;
+    flat_node->node = join_order;
+
+    if (!flat->inline_relids)
+        flat_node->relids_word = 0;
+    else if (join_order->node_type == BASE_REL)
+        flat_node->relids_word = ((bitmapword) 1) << join_order->rt_index;
+    else
+        flat_node->relids_word = flat->nodes[outer_index].relids_word | flat->nodes[inner_index].relids_word;
+
+    if (join_order->node_type == JOIN_REL)
+    {
+        flat->nodes[outer_index].parent = index;
+        flat->nodes[inner_index].parent = index;
+    }
+
+    join_order->flat = flat;
+    join_order->flat_index = index;
+    return index;
+}
+
+/*
+ * Compiles the join order into two additional representations that are shared by all nodes of the tree:
+ *
+ * 1. a hash table that maps the relids of each node to the node itself. Afterwards, traverse_join_order() only needs
+ *    a single hash lookup instead of walking the tree.
+ * 2. a contiguous array of all nodes (see FlatJoinOrder). Iterating over the join order only needs to scan this array.
+ *    If the range table is small enough, the relids of each node are also stored inline.
+ *
+ * Both are allocated in the current memory context.
+ */
+void
+compile_join_order(JoinOrder *join_order)
+{
+    HASHCTL hctl;
+    FlatJoinOrder *flat;
+    int n_nodes;
+
+    Assert(IsRootNode(join_order));
+    if (join_order->node_lookup)
+        return;
+
+    /* a join order over n base rels has exactly 2n - 1 nodes */
+    n_nodes = 2 * bms_num_members(join_order->relids) - 1;
+
+    flat = (FlatJoinOrder *) palloc0(offsetof(FlatJoinOrder, nodes) + n_nodes * sizeof(FlatJoinOrderNode));
+    flat->inline_relids = bms_prev_member(join_order->relids, -1) < BITS_PER_BITMAPWORD;
+    flatten_join_order(flat, join_order, 0);
+    Assert(flat->n_nodes == n_nodes);
+
+    hctl.keysize = sizeof(Relids);
+    hctl.entrysize = sizeof(JoinOrderLookupEntry);
+    hctl.hcxt = CurrentMemoryContext;
+    hctl.hash = bitmap_hash;
+    hctl.match = bitmap_match;
+
+    /* a join order over n base rels has exactly 2n - 1 nodes */
+    join_order->node_lookup = hash_create("JoinOrderLookup", n_nodes, &hctl,
+                                          HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
+    register_join_order_nodes(join_order->node_lookup, join_order);
+}
+
+/*
+ * Checks, whether a specific node of the flattened join order is computed by the given relids.
+ */
+bool
+flat_join_order_relids_equal(FlatJoinOrder *join_order, int node_index, Relids relids)
+{
+    FlatJoinOrderNode *node = &join_order->nodes[node_index];
+
+    if (!join_order->inline_relids)
+        return bms_equal(node->node->relids, relids);
+
+    /* Bitmapsets never contain trailing zero words, so a single-word set has to match exactly */
+    if (relids == NULL)
+        return node->relids_word == 0;
+    return relids->nwords == 1 && relids->words[0] == node->relids_word;
+}
+
 JoinOrder *
 traverse_join_order(JoinOrder *join_order, Relids node)
 {
     JoinOrder *result;
 
+    if (join_order->node_lookup)
+    {
+        JoinOrderLookupEntry *entry;
+
+        entry = (JoinOrderLookupEntry *) hash_search(join_order->node_lookup, &node, HASH_FIND, NULL);
+        if (!entry)
+            return NULL;
+
+        /*
+         * The lookup table contains all nodes of the entire tree. Since the relids of two nodes are either disjoint or
+         * one contains the other, the node is part of our subtree iff its relids are a subset of the subtree.
+         */
+        if (IsRootNode(join_order) || bms_is_subset(entry->node->relids, join_order->relids))
+            return entry->node;
+        return NULL;
+    }
+
     check_stack_depth();
 
     if (bms_equal(join_order->relids, node))
@@ -238,90 +390,132 @@ is_linear_join_order(JoinOrder* join_order)
            is_linear_join_order(join_order->inner_child);
 }
 
+static int
+compare_leaf_nodes(const void *a, const void *b, void *arg)
+{
+    FlatJoinOrder *join_order = (FlatJoinOrder *) arg;
+    int lhs = *((const int *) a);
+    int rhs = *((const int *) b);
+    int lhs_depth = join_order->nodes[lhs].depth;
+    int rhs_depth = join_order->nodes[rhs].depth;
+
+    if (lhs_depth != rhs_depth)
+        return lhs_depth < rhs_depth ? -1 : 1;
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+/*
+ * Initializes the iterator with the base rels of the join order.
+ *
+ * The base rels are provided in breadth-first order, i.e. base rels that are closer to the root come first. Within the
+ * same depth, the base rels are ordered from left to right.
+ */
 void
 joinorder_it_init(JoinOrderIterator *iterator, JoinOrder *join_order)
 {
-    List        *leaf_nodes = NIL;
-    JoinOrder   *current_node = NULL;
-    List        *node_stack = list_make1(join_order);
+    FlatJoinOrder *flat;
+    FlatJoinOrderNode *root;
+
+    if (!join_order->flat)
+        compile_join_order(join_order);
 
-    iterator->current_relids = EMPTY_BITMAP;
+    flat = join_order->flat;
+    root = &flat->nodes[join_order->flat_index];
 
-    while (node_stack)
+    iterator->join_order = flat;
+    iterator->current_nodes = (int *) palloc(sizeof(int) * flat->n_nodes);
+    iterator->selected = (bool *) palloc0(sizeof(bool) * flat->n_nodes);
+    iterator->n_current = 0;
+
+    for (int i = root->subtree_start; i <= join_order->flat_index; ++i)
     {
-        current_node = (JoinOrder*) linitial(node_stack);
-        if (current_node->node_type == BASE_REL)
-        {
-            leaf_nodes = lappend(leaf_nodes, current_node);
-            bms_add_member(iterator->current_relids, current_node->rt_index);
-        }
-        else
-        {
-            node_stack = lappend(node_stack, current_node->outer_child);
-            node_stack = lappend(node_stack, current_node->inner_child);
-        }
-        node_stack = list_delete_first(node_stack);
+        if (flat->nodes[i].node_type == BASE_REL)
+            iterator->current_nodes[iterator->n_current++] = i;
     }
 
-    iterator->done = list_length(leaf_nodes) == 0;
-    iterator->current_nodes = leaf_nodes;
+    qsort_arg(iterator->current_nodes, iterator->n_current, sizeof(int), compare_leaf_nodes, flat);
+
+    iterator->done = iterator->n_current == 0;
 }
 
+/*
+ * Moves the iterator to the next level of the join order. This is the lowest level among all parents of the current nodes.
+ */
 void
 joinorder_it_next(JoinOrderIterator *iterator)
 {
-    List        *new_nodes = NIL;
-    int          min_new_level = INT_MAX;
-    JoinOrder   *current_node = NULL;
-    JoinOrder   *parent_node = NULL;
-    ListCell    *lc = NULL;
+    FlatJoinOrder *flat;
+    int min_new_level = INT_MAX;
+    int n_new = 0;
 
     if (iterator->done)
         return;
 
-    bms_free(iterator->current_relids);
-    iterator->current_relids = EMPTY_BITMAP;
+    flat = iterator->join_order;
 
-    foreach (lc, iterator->current_nodes)
+    for (int i = 0; i < iterator->n_current; ++i)
     {
-        current_node = (JoinOrder*) lfirst(lc);
-        parent_node = current_node->parent_node;
+        int parent = flat->nodes[iterator->current_nodes[i]].parent;
+        if (parent >= 0 && flat->nodes[parent].level < min_new_level)
+            min_new_level = flat->nodes[parent].level;
+    }
 
-        if (!parent_node || parent_node->level > min_new_level)
+    /*
+     * We can compact the current nodes in-place, since each node contributes at most one new node. Both children of the
+     * same parent would contribute the same node, hence we need to de-duplicate.
+     */
+    for (int i = 0; i < iterator->n_current; ++i)
+    {
+        int parent = flat->nodes[iterator->current_nodes[i]].parent;
+        if (parent < 0 || flat->nodes[parent].level != min_new_level || iterator->selected[parent])
             continue;
 
-        if (parent_node->level < min_new_level)
-        {
-            list_free(new_nodes);
-            new_nodes = list_make1(parent_node);
-
-            bms_free(iterator->current_relids);
-            iterator->current_relids = bms_copy(parent_node->relids);
-
-            min_new_level = parent_node->level;
-        }
-        else if (!bms_overlap(parent_node->relids, iterator->current_relids))
-        {
-            new_nodes = lappend(new_nodes, parent_node);
-            bms_add_members(iterator->current_relids, parent_node->relids);
-        }
+        iterator->selected[parent] = true;
+        iterator->current_nodes[n_new++] = parent;
     }
 
-    list_free(iterator->current_nodes);
-    iterator->done = list_length(new_nodes) == 0;
-    iterator->current_nodes = new_nodes;
+    for (int i = 0; i < n_new; ++i)
+        iterator->selected[iterator->current_nodes[i]] = false;
+
+    iterator->n_current = n_new;
+    iterator->done = n_new == 0;
 }
 
 void
 joinorder_it_free(JoinOrderIterator *iterator)
 {
-    list_free(iterator->current_nodes);
-    bms_free(iterator->current_relids);
+    pfree(iterator->current_nodes);
+    pfree(iterator->selected);
+}
+
+static void
+flat_joinorder_to_string(FlatJoinOrder *join_order, int node_index, StringInfo buf)
+{
+    FlatJoinOrderNode *node = &join_order->nodes[node_index];
+
+    check_stack_depth();
+
+    if (node->node_type == BASE_REL)
+        appendStringInfoString(buf, node->node->base_identifier);
+    else
+    {
+        appendStringInfoChar(buf, '(');
+        flat_joinorder_to_string(join_order, node->outer_child, buf);
+        appendStringInfoString(buf, ", ");
+        flat_joinorder_to_string(join_order, node->inner_child, buf);
+        appendStringInfoChar(buf, ')');
+    }
 }
 
 void
 joinorder_to_string(JoinOrder *join_order, StringInfo buf)
 {
+    if (join_order->flat)
+    {
+        flat_joinorder_to_string(join_order->flat, join_order->flat_index, buf);
+        return;
+    }
+
     if (join_order->node_type == BASE_REL)
         appendStringInfoString(buf, join_order->base_identifier);
     else
@@ -334,25 +528,85 @@ joinorder_to_string(JoinOrder *join_order, StringInfo buf)
     }
 }
 
+typedef struct AliasLookupEntry
+{
+    char  alias[NAMEDATALEN];  /* hash key */
+    Index rt_index;
+    Index conflicting_rt_index;  /* InvalidIndex if the alias is unique */
+} AliasLookupEntry;
 
-static Index
-FetchRTIndex(PlannerInfo *root, const char *relname)
+/*
+ * Builds a hash table that maps the aliases of all relations of the current query to their range table index.
+ *
+ * If multiple range table entries share the same alias (e.g. because a subquery has been pulled up), the alias is marked as
+ * ambiguous. Referencing an ambiguous alias in a hint raises an error. Children of inheritance trees and partitioned tables
+ * re-use the alias of their parent and are ignored.
+ */
+void
+build_alias_lookup(PlannerInfo *root, PlannerHints *hints)
 {
+    HASHCTL hctl;
+
+    if (hints->alias_lookup)
+        return;
+
+    hctl.keysize = NAMEDATALEN;
+    hctl.entrysize = sizeof(AliasLookupEntry);
+    hctl.hcxt = CurrentMemoryContext;
+
+    hints->alias_lookup = hash_create("AliasLookup", root->simple_rel_array_size, &hctl,
+                                      HASH_ELEM | HASH_STRINGS | HASH_CONTEXT);
+
     for (int i = 1; i < root->simple_rel_array_size; ++i)
     {
         RangeTblEntry *rte = root->simple_rte_array[i];
-        if (rte && strcmp(rte->eref->aliasname, relname) == 0)
-            return i;
+        RelOptInfo *rel = root->simple_rel_array[i];
+        AliasLookupEntry *entry;
+        bool found;
+
+        if (!rte || !rte->eref)
+            continue;
+        if (rel && rel->reloptkind == RELOPT_OTHER_MEMBER_REL)
+            continue;
+
+        entry = (AliasLookupEntry *) hash_search(hints->alias_lookup, rte->eref->aliasname, HASH_ENTER, &found);
+        if (!found)
+        {
+            entry->rt_index = i;
+            entry->conflicting_rt_index = InvalidIndex;
+        }
+        else if (entry->conflicting_rt_index == (Index) InvalidIndex)
+            entry->conflicting_rt_index = i;
     }
+}
+
+static Index
+FetchRTIndex(PlannerInfo *root, PlannerHints *hints, const char *relname)
+{
+    AliasLookupEntry *entry;
+
+    if (!hints->alias_lookup)
+        build_alias_lookup(root, hints);
 
-    ereport(ERROR,
-            (errcode(ERRCODE_UNDEFINED_TABLE),
-             errmsg("relation \"%s\" does not exist", relname)));
-    return InvalidIndex;
+    entry = (AliasLookupEntry *) hash_search(hints->alias_lookup, relname, HASH_FIND, NULL);
+    if (!entry)
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_TABLE),
+                 errmsg("relation \"%s\" does not exist", relname)));
+
+    if (entry->conflicting_rt_index != (Index) InvalidIndex)
+        ereport(ERROR,
+                (errcode(ERRCODE_AMBIGUOUS_ALIAS),
+                 errmsg("relation reference \"%s\" is ambiguous", relname),
+                 errdetail("The alias is used by range table entries %u and %u.",
+                           entry->rt_index, entry->conflicting_rt_index),
+                 errhint("Use unique aliases for all relations that are referenced in the hint block.")));
+
+    return entry->rt_index;
 }
 
 static Relids
-FetchRelids(PlannerInfo *root, List *relnames)
+FetchRelids(PlannerInfo *root, PlannerHints *hints, List *relnames)
 {
     ListCell *lc;
     Relids relids = EMPTY_BITMAP;
@@ -367,7 +621,7 @@ FetchRelids(PlannerInfo *root, List *relnames)
     foreach (lc, relnames)
     {
         char *relname = (char *) lfirst(lc);
-        Index rti = FetchRTIndex(root, relname);
+        Index rti = FetchRTIndex(root, hints, relname);
         relids = bms_add_member(relids, rti);
     }
 
@@ -416,7 +670,10 @@ init_hints(const char *raw_query)
 
     hints->operator_hints = NULL;
     hints->cardinality_hints = NULL;
+    hints->cardinality_scales = NIL;
     hints->cost_hints = NULL;
+    hints->cost_hint_rels = EMPTY_BITMAP;
+    hints->cost_hint_sizes = NULL;
 
     hints->parallel_rels = EMPTY_BITMAP;
     hints->parallel_workers = 0;
@@ -424,6 +681,11 @@ init_hints(const char *raw_query)
 
     hints->temp_gucs = NIL;
 
+    hints->alias_lookup = NULL;
+    hints->path_verdicts = NULL;
+    hints->estimator = NULL;
+    hints->card_feedback = false;
+
     return hints;
 }
 
@@ -442,7 +704,12 @@ free_hints(PlannerHints *hints)
 
     hash_destroy(hints->operator_hints);
     hash_destroy(hints->cardinality_hints);
+    list_free_deep(hints->cardinality_scales);
     hash_destroy(hints->cost_hints);
+    bms_free(hints->cost_hint_rels);
+    bms_free(hints->cost_hint_sizes);
+    hash_destroy(hints->alias_lookup);
+    hash_destroy(hints->path_verdicts);
 
     foreach (lc, hints->temp_gucs)
     {
@@ -457,36 +724,37 @@ free_hints(PlannerHints *hints)
 void
 post_process_hint_block(PlannerHints *hints)
 {
-    JoinOrderIterator it;
+    HASH_SEQ_STATUS hstat;
+    JoinOrderLookupEntry *entry;
+    ListCell *lc;
+
+    if (!hints || !hints->contains_hint)
+        return;
+
+    if (hints->join_order_hint)
+        compile_join_order(hints->join_order_hint);
 
-    if (!hints ||
-        !hints->contains_hint ||
-        !hints->join_order_hint ||
+    foreach (lc, hints->join_prefixes)
+    {
+        JoinOrder *prefix = (JoinOrder *) lfirst(lc);
+        compile_join_order(prefix);
+    }
+
+    if (!hints->join_order_hint ||
         !hints->operator_hints ||
         hash_get_num_entries(hints->operator_hints) == 0)
         return;
 
-    joinorder_it_init(&it, hints->join_order_hint);
-
-    while (!it.done)
+    hash_seq_init(&hstat, hints->join_order_hint->node_lookup);
+    while ((entry = (JoinOrderLookupEntry *) hash_seq_search(&hstat)) != NULL)
     {
-        ListCell *lc;
-        foreach (lc, it.current_nodes)
-        {
-            OperatorHint *op_hint;
-            bool found;
-            JoinOrder *current_node = (JoinOrder *) lfirst(lc);
-
-            op_hint = (OperatorHint *) hash_search(hints->operator_hints, &(current_node->relids),
-                                                   HASH_FIND, &found);
-            if (found)
-                current_node->physical_op = op_hint;
-        }
+        OperatorHint *op_hint;
+        bool found;
 
-        joinorder_it_next(&it);
+        op_hint = (OperatorHint *) hash_search(hints->operator_hints, &(entry->relids), HASH_FIND, &found);
+        if (found)
+            entry->node->physical_op = op_hint;
     }
-
-    joinorder_it_free(&it);
 }
 
 void
@@ -515,7 +783,7 @@ MakeOperatorHint(PlannerInfo *root, PlannerHints *hints, List *rels,
                                             HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
     }
 
-    relids = FetchRelids(root, rels);
+    relids = FetchRelids(root, hints, rels);
     op_hint = (OperatorHint *) hash_search(hints->operator_hints, &relids, HASH_ENTER, &found);
 
     #ifdef PGLAB_TRACE
@@ -575,7 +843,7 @@ MakeIntermediateOpHint(PlannerInfo *root, PlannerHints *hints, List *rels,
                                             HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
     }
 
-    relids = FetchRelids(root, rels);
+    relids = FetchRelids(root, hints, rels);
     op_hint = (OperatorHint *) hash_search(hints->operator_hints, &relids, HASH_ENTER, &found);
 
     if (found)
@@ -603,13 +871,9 @@ MakeIntermediateOpHint(PlannerInfo *root, PlannerHints *hints, List *rels,
     }
 }
 
-void
-MakeCardHint(PlannerInfo *root, PlannerHints *hints, List *rels, Cardinality cardinality)
+static CardinalityHint *
+FetchCardHintEntry(PlannerInfo *root, PlannerHints *hints, Relids relids, bool *found)
 {
-    CardinalityHint *card_hint;
-    bool found;
-    Relids relids;
-
     hints->contains_hint = true;
 
     if (!hints->cardinality_hints)
@@ -628,8 +892,18 @@ MakeCardHint(PlannerInfo *root, PlannerHints *hints, List *rels, Cardinality car
                                                HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
     }
 
-    relids = FetchRelids(root, rels);
-    card_hint = (CardinalityHint *) hash_search(hints->cardinality_hints, &relids, HASH_ENTER, &found);
+    return (CardinalityHint *) hash_search(hints->cardinality_hints, &relids, HASH_ENTER, found);
+}
+
+void
+MakeCardHint(PlannerInfo *root, PlannerHints *hints, List *rels, Cardinality cardinality)
+{
+    CardinalityHint *card_hint;
+    bool found;
+    Relids relids;
+
+    relids = FetchRelids(root, hints, rels);
+    card_hint = FetchCardHintEntry(root, hints, relids, &found);
 
     if (found)
     {
@@ -647,36 +921,88 @@ MakeCardHint(PlannerInfo *root, PlannerHints *hints, List *rels, Cardinality car
 }
 
 void
-MakeCostHint(PlannerInfo *root, PlannerHints *hints, List *rels, PhysicalOperator op, Cost startup, Cost total)
+MakeCardScaleHint(PlannerInfo *root, PlannerHints *hints, List *rels, double factor)
 {
-    CostHint *cost_hint;
-    bool found;
-    Relids relids;
-    bool baserel;
+    CardinalityScaleHint *scale_hint;
 
     hints->contains_hint = true;
 
-    if (!hints->cost_hints)
+    scale_hint = (CardinalityScaleHint *) palloc0(sizeof(CardinalityScaleHint));
+    scale_hint->relids = FetchRelids(root, hints, rels);
+    scale_hint->factor = factor;
+
+    hints->cardinality_scales = lappend(hints->cardinality_scales, scale_hint);
+}
+
+/*
+ * Computes the combined correction factor of all CardScale hints that need to be applied to the native estimate of an
+ * intermediate.
+ *
+ * For join rels, the native estimate is derived from the (already corrected) cardinalities of the outer and inner rel.
+ * Therefore, we only apply the hints that are introduced by this join, i.e. hints that span both input rels. Hints for
+ * subsets of either input are already contained in the input cardinalities. This also ensures that the corrected
+ * estimate does not depend on the join pair that was used to compute it. For base rels and for estimates that do not
+ * depend on the inputs (e.g. from an external estimator), outer_relids and inner_relids are NULL.
+ */
+double
+cardinality_scale_factor(PlannerHints *hints, Relids relids, Relids outer_relids, Relids inner_relids)
+{
+    ListCell *lc;
+    double factor = 1.0;
+
+    foreach (lc, hints->cardinality_scales)
     {
-        HASHCTL hctl;
-        long nelems;
+        CardinalityScaleHint *scale_hint = (CardinalityScaleHint *) lfirst(lc);
 
-        hctl.keysize = sizeof(Relids);
-        hctl.entrysize = sizeof(CostHint);
-        hctl.hcxt = CurrentMemoryContext;
-        hctl.hash = bitmap_hash;
-        hctl.match = bitmap_match;
+        if (!bms_is_subset(scale_hint->relids, relids))
+            continue;
+        if (bms_is_subset(scale_hint->relids, outer_relids) || bms_is_subset(scale_hint->relids, inner_relids))
+            continue;
 
-        nelems = 6 * list_length(root->parse->rtable) - 1;
-        hints->cost_hints = hash_create("CostHintHashes", nelems, &hctl,
-                                        HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
+        factor *= scale_hint->factor;
     }
 
-    baserel = list_length(rels) == 1;
-    relids = FetchRelids(root, rels);
-    cost_hint = (CostHint *) hash_search(hints->cost_hints, &relids, HASH_ENTER, &found);
+    return factor;
+}
 
-    if (!found && baserel)
+/*
+ * Adds the cardinalities from pg_lab_set_cardinalities() to the hints.
+ *
+ * This bypasses the hint parser entirely: the relation names are resolved directly via the alias lookup. Card hints from
+ * the hint block take precedence over the bulk cardinalities.
+ */
+void
+bind_bulk_cardinalities(PlannerInfo *root, PlannerHints *hints, BulkCardinalities *bulk)
+{
+    for (int i = 0; i < bulk->n_entries; i++)
+    {
+        CardinalityHint *card_hint;
+        Relids relids = EMPTY_BITMAP;
+        bool found;
+
+        for (int j = bulk->offsets[i]; j < bulk->offsets[i + 1]; j++)
+            relids = bms_add_member(relids, FetchRTIndex(root, hints, bulk->relnames[j]));
+
+        card_hint = FetchCardHintEntry(root, hints, relids, &found);
+        if (found)
+        {
+            bms_free(relids);
+            continue;
+        }
+
+        card_hint->card = bulk->cards[i];
+    }
+}
+
+/*
+ * Initializes a cost hint that does not overwrite any costs yet.
+ */
+void
+InitCostHint(CostHint *cost_hint, bool baserel)
+{
+    IntermediateCost *intermediate_costs;
+
+    if (baserel)
     {
         ScanCost *costs;
         cost_hint->node_type = BASE_REL;
@@ -689,7 +1015,7 @@ MakeCostHint(PlannerInfo *root, PlannerHints *hints, List *rels, PhysicalOperato
         costs->bitmap_startup = NAN;
         costs->bitmap_total = NAN;
     }
-    else if (!found && !baserel)
+    else
     {
         JoinCost *costs;
         cost_hint->node_type = JOIN_REL;
@@ -703,6 +1029,29 @@ MakeCostHint(PlannerInfo *root, PlannerHints *hints, List *rels, PhysicalOperato
         costs->merge_total = NAN;
     }
 
+    intermediate_costs = &(cost_hint->intermediate_costs);
+    intermediate_costs->sort_startup = NAN;
+    intermediate_costs->sort_total = NAN;
+    intermediate_costs->incsort_startup = NAN;
+    intermediate_costs->incsort_total = NAN;
+    intermediate_costs->material_startup = NAN;
+    intermediate_costs->material_total = NAN;
+    intermediate_costs->memoize_startup = NAN;
+    intermediate_costs->memoize_total = NAN;
+    intermediate_costs->gather_startup = NAN;
+    intermediate_costs->gather_total = NAN;
+    intermediate_costs->gathermerge_startup = NAN;
+    intermediate_costs->gathermerge_total = NAN;
+    intermediate_costs->append_startup = NAN;
+    intermediate_costs->append_total = NAN;
+}
+
+/*
+ * Sets the costs of a specific operator in a cost hint.
+ */
+void
+StoreCostHint(CostHint *cost_hint, PhysicalOperator op, Cost startup, Cost total)
+{
     switch (op)
     {
         case OP_SEQSCAN:
@@ -729,11 +1078,76 @@ MakeCostHint(PlannerInfo *root, PlannerHints *hints, List *rels, PhysicalOperato
             cost_hint->costs.join_cost.merge_startup = startup;
             cost_hint->costs.join_cost.merge_total = total;
             break;
+        case OP_SORT:
+            cost_hint->intermediate_costs.sort_startup = startup;
+            cost_hint->intermediate_costs.sort_total = total;
+            break;
+        case OP_INCSORT:
+            cost_hint->intermediate_costs.incsort_startup = startup;
+            cost_hint->intermediate_costs.incsort_total = total;
+            break;
+        case OP_MATERIALIZE:
+            cost_hint->intermediate_costs.material_startup = startup;
+            cost_hint->intermediate_costs.material_total = total;
+            break;
+        case OP_MEMOIZE:
+            cost_hint->intermediate_costs.memoize_startup = startup;
+            cost_hint->intermediate_costs.memoize_total = total;
+            break;
+        case OP_GATHER:
+            cost_hint->intermediate_costs.gather_startup = startup;
+            cost_hint->intermediate_costs.gather_total = total;
+            break;
+        case OP_GATHERMERGE:
+            cost_hint->intermediate_costs.gathermerge_startup = startup;
+            cost_hint->intermediate_costs.gathermerge_total = total;
+            break;
+        case OP_APPEND:
+            cost_hint->intermediate_costs.append_startup = startup;
+            cost_hint->intermediate_costs.append_total = total;
+            break;
         default:
             elog(ERROR, "Unknown scan operator: %d", op);
             break;
     }
+}
+
+void
+MakeCostHint(PlannerInfo *root, PlannerHints *hints, List *rels, PhysicalOperator op, Cost startup, Cost total)
+{
+    CostHint *cost_hint;
+    bool found;
+    Relids relids;
+
+    hints->contains_hint = true;
+
+    if (!hints->cost_hints)
+    {
+        HASHCTL hctl;
+        long nelems;
+
+        hctl.keysize = sizeof(Relids);
+        hctl.entrysize = sizeof(CostHint);
+        hctl.hcxt = CurrentMemoryContext;
+        hctl.hash = bitmap_hash;
+        hctl.match = bitmap_match;
+
+        nelems = 6 * list_length(root->parse->rtable) - 1;
+        hints->cost_hints = hash_create("CostHintHashes", nelems, &hctl,
+                                        HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
+    }
 
+    relids = FetchRelids(root, hints, rels);
+    cost_hint = (CostHint *) hash_search(hints->cost_hints, &relids, HASH_ENTER, &found);
+
+    if (!found)
+    {
+        InitCostHint(cost_hint, list_length(rels) == 1);
+        hints->cost_hint_rels = bms_add_members(hints->cost_hint_rels, relids);
+        hints->cost_hint_sizes = bms_add_member(hints->cost_hint_sizes, bms_num_members(relids));
+    }
+
+    StoreCostHint(cost_hint, op, startup, total);
 }
 
 JoinOrder *
@@ -759,12 +1173,12 @@ MakeJoinOrderIntermediate(PlannerInfo *root, JoinOrder *outer_child, JoinOrder *
 }
 
 JoinOrder *
-MakeJoinOrderBase(PlannerInfo *root, const char *relname)
+MakeJoinOrderBase(PlannerInfo *root, PlannerHints *hints, const char *relname)
 {
     JoinOrder *join_order;
     Index rti;
 
-    rti = FetchRTIndex(root, relname);
+    rti = FetchRTIndex(root, hints, relname);
 
     join_order = (JoinOrder *) palloc0(sizeof(JoinOrder));
     join_order->node_type = BASE_REL;
@@ -778,6 +1192,216 @@ MakeJoinOrderBase(PlannerInfo *root, const char *relname)
     return join_order;
 }
 
+HintSpec *
+MakeHintSpec(HintSpecTag tag)
+{
+    HintSpec *hint;
+
+    hint = (HintSpec *) palloc0(sizeof(HintSpec));
+    hint->tag = tag;
+    hint->relnames = NIL;
+    hint->op = OP_UNKNOWN;
+    hint->parallel_workers = NAN;
+    hint->has_cost = false;
+    hint->startup_cost = NAN;
+    hint->total_cost = NAN;
+
+    return hint;
+}
+
+JoinOrderSpec *
+MakeJoinOrderSpecBase(const char *relname)
+{
+    JoinOrderSpec *join_order;
+
+    join_order = (JoinOrderSpec *) palloc0(sizeof(JoinOrderSpec));
+    join_order->node_type = BASE_REL;
+    join_order->relname = pstrdup(relname);
+
+    return join_order;
+}
+
+JoinOrderSpec *
+MakeJoinOrderSpecIntermediate(JoinOrderSpec *outer_child, JoinOrderSpec *inner_child)
+{
+    JoinOrderSpec *join_order;
+
+    join_order = (JoinOrderSpec *) palloc0(sizeof(JoinOrderSpec));
+    join_order->node_type = JOIN_REL;
+    join_order->outer_child = outer_child;
+    join_order->inner_child = inner_child;
+
+    return join_order;
+}
+
+static JoinOrder *
+BindJoinOrder(PlannerInfo *root, PlannerHints *hints, JoinOrderSpec *spec)
+{
+    JoinOrder *outer_child, *inner_child;
+
+    check_stack_depth();
+
+    if (spec->node_type == BASE_REL)
+        return MakeJoinOrderBase(root, hints, spec->relname);
+
+    outer_child = BindJoinOrder(root, hints, spec->outer_child);
+    inner_child = BindJoinOrder(root, hints, spec->inner_child);
+    return MakeJoinOrderIntermediate(root, outer_child, inner_child);
+}
+
+static void
+BindOperatorHint(PlannerInfo *root, PlannerHints *hints, HintSpec *hint)
+{
+    if (!isnan(hint->parallel_workers) && (hints->parallel_rels || hints->parallelize_entire_plan))
+    {
+        ereport(ERROR, (
+                errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("[pg_lab] Found multiple parallel hints"),
+                errdetail("Postgres only supports one parallel subplan.")));
+    }
+
+    if (hint->has_cost)
+    {
+        MakeCostHint(root, hints, hint->relnames, hint->op, hint->startup_cost, hint->total_cost);
+        return;
+    }
+
+    if (IsCostOnlyOperator(hint->op))
+    {
+        ereport(ERROR,
+                errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("[pg_lab] %s hints can only be used to set costs", PhysicalOperatorToString(hint->op)),
+                errhint("Use %s(<rels> (Cost(Start=<cost> Total=<cost>))) instead.", PhysicalOperatorToString(hint->op)));
+    }
+
+    if (hint->op == OP_MEMOIZE)
+        MakeIntermediateOpHint(root, hints, hint->relnames, false, true, hint->parallel_workers);
+    else if (hint->op == OP_MATERIALIZE)
+        MakeIntermediateOpHint(root, hints, hint->relnames, true, false, hint->parallel_workers);
+    else
+        MakeOperatorHint(root, hints, hint->relnames, hint->op, hint->parallel_workers);
+}
+
+/*
+ * Binds a parsed hint block against the current query and stores the resulting hints in the PlannerHints.
+ *
+ * Binding resolves all relation names to their range table indexes and performs the semantic checks of the hint block
+ * (e.g. conflicting join order hints). The spec itself is not modified and can be bound multiple times.
+ */
+void
+bind_hint_block(PlannerInfo *root, PlannerHints *hints, HintBlockSpec *spec)
+{
+    ListCell *lc;
+    List *cleanup_actions = NIL;
+
+    foreach (lc, spec->hints)
+    {
+        HintSpec *hint = (HintSpec *) lfirst(lc);
+
+        switch (hint->tag)
+        {
+            case HS_PLAN_MODE:
+                hints->mode = hint->mode;
+                hints->contains_hint = true;
+                break;
+
+            case HS_PARALLEL_MODE:
+                if (hints->parallel_rels || hints->parallelize_entire_plan)
+                {
+                    ereport(WARNING,
+                        errmsg("[pg_lab] Ignoring global parallelization setting"),
+                        errdetail("Global parallelization setting is overridden by operator hints"));
+                    break;
+                }
+
+                hints->parallel_mode = hint->parallel_mode;
+                hints->contains_hint = true;
+                break;
+
+            case HS_PLAN_CACHE_MODE:
+                /* Only relevant for prepared statements, see fetch_plan_cache_hint() */
+                break;
+
+            case HS_JOIN_ORDER:
+            {
+                JoinOrder *join_order;
+
+                if (hints->join_prefixes)
+                    ereport(ERROR, errmsg("Cannot combine JoinOrder hint with JoinPrefix hint"));
+
+                join_order = BindJoinOrder(root, hints, hint->join_order);
+                hints->join_order_hint = join_order;
+                hints->contains_hint = true;
+
+                #ifdef PGLAB_TRACE
+
+                StringInfo joinorder_debug = makeStringInfo();
+                joinorder_to_string(join_order, joinorder_debug);
+                ereport(INFO, (errmsg("Creating join order hint"), errdetail("%s", joinorder_debug->data)));
+                destroyStringInfo(joinorder_debug);
+
+                #endif
+
+                break;
+            }
+
+            case HS_JOIN_PREFIX:
+                if (hints->join_order_hint)
+                    ereport(ERROR, errmsg("Cannot combine JoinPrefix hint with JoinOrder hint"));
+
+                hints->join_prefixes = lappend(hints->join_prefixes, BindJoinOrder(root, hints, hint->join_order));
+                hints->contains_hint = true;
+                break;
+
+            case HS_OPERATOR:
+                BindOperatorHint(root, hints, hint);
+                break;
+
+            case HS_RESULT:
+                if (hints->parallelize_entire_plan)
+                {
+                    ereport(WARNING,
+                        errmsg("[pg_lab] Found multiple parallel hints"),
+                        errdetail("Postgres normally creates only one parallel subplan. This might break the query."));
+                }
+
+                hints->parallel_workers = hint->parallel_workers;
+                hints->parallelize_entire_plan = true;
+                hints->parallel_mode = PARMODE_PARALLEL;
+                break;
+
+            case HS_CARDINALITY:
+                MakeCardHint(root, hints, hint->relnames, hint->card);
+                break;
+
+            case HS_CARDINALITY_SCALE:
+                MakeCardScaleHint(root, hints, hint->relnames, hint->scale_factor);
+                break;
+
+            case HS_GUC:
+            {
+                TempGUC *cleanup;
+                cleanup = MakeGUCHint(hints, hint->guc_name, hint->guc_value);
+                if (cleanup)
+                    cleanup_actions = lappend(cleanup_actions, cleanup);
+                break;
+            }
+
+            default:
+                elog(ERROR, "Unknown hint type: %d", hint->tag);
+                break;
+        }
+    }
+
+    InitGucCleanup(list_length(cleanup_actions));
+    foreach (lc, cleanup_actions)
+        StoreGucCleanup((TempGUC *) lfirst(lc));
+    list_free(cleanup_actions);
+
+    if (hints->mode == HINTMODE_FULL && hints->parallel_mode == PARMODE_DEFAULT)
+        hints->parallel_mode = PARMODE_SEQUENTIAL;
+}
+
 /*
  * Generates a GUC setting along with its undo information.
  *
@@ -0,0 +1,787 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "lib/stringinfo.h"
+#include "nodes/bitmapset.h"
+#include "optimizer/joininfo.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
+#include "storage/latch.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "utils/wait_event.h"
+
+#include "model_estimator.h"
+
+/*
+ * Cardinality and cost estimates from an external estimator process.
+ *
+ * Learned estimators are typically too expensive to be called once per intermediate. Therefore, we request the estimates of
+ * an entire join level at once: once the planner asks for the size of the first intermediate with k relations, we send all
+ * connected intermediates with k relations (i.e. all connected subsets of the join graph that extend an intermediate of the
+ * previous level by one neighboring relation) in a single batch. The answers are cached for the remainder of the planner
+ * run. Intermediates that are not part of a batch (e.g. cross products) are requested individually.
+ *
+ * The estimator is reached via a Unix-domain socket and uses a simple line-based protocol. Each planner run starts with the
+ * query text:
+ *
+ *   QUERY <query id> <query level> <length in bytes>\n<query text>\n
+ *
+ * Each batch lists one intermediate per line, as the space-separated aliases of its relations:
+ *
+ *   BATCH <n>\n<aliases of intermediate 1>\n...<aliases of intermediate n>\n
+ *
+ * The estimator answers with one line per intermediate, in the same order. Each line starts with the cardinality, or "-" if
+ * the native estimate should be used. Afterwards, costs can be supplied per operator, e.g.
+ *
+ *   4200 HashJoin=100,4242.5 NestLoop=0,80000\n
+ *
+ * If the estimator cannot be reached or sends a malformed response, we fall back to the native estimates.
+ *
+ * Alternatively, another extension can provide the estimates in-process via the batch estimates hook. The hook receives the
+ * same batches as the socket, but can work directly on the RelOptInfos of the base rels and of the previous join level.
+ */
+
+/* Upper bound on the number of intermediates per batch to keep the batches of dense join graphs in check */
+#define MODEL_ESTIMATOR_MAX_BATCH 10000
+
+struct ModelEstimator
+{
+    PlannerInfo   *root;
+    pglab_batch_estimates_hook_type hook;  /* in-process estimator, NULL to use the socket */
+    MemoryContext  context;        /* the planner context, the join search might run in a short-lived context */
+    const char    *query_string;
+    bool           query_sent;
+    bool           failed;         /* the estimator could not be reached, stick with the native estimates */
+    HTAB          *estimates;      /* ModelEstimate entries, keyed by relids */
+    Relids         known_rels;     /* all base rels and other member rels of the planner run */
+    Relids        *neighbors;      /* join partners of each base rel, indexed by range table index. Built lazily. */
+    int            fetched_level;  /* largest join level that has been requested as a batch */
+    List          *frontier;       /* relids of the connected intermediates of the fetched level */
+};
+
+typedef struct EstimatorOperator
+{
+    const char       *name;
+    PhysicalOperator  op;
+} EstimatorOperator;
+
+static const EstimatorOperator estimator_operators[] =
+{
+    {"SeqScan",         OP_SEQSCAN},
+    {"IdxScan",         OP_IDXSCAN},
+    {"BitmapScan",      OP_BITMAPSCAN},
+    {"NestLoop",        OP_NESTLOOP},
+    {"HashJoin",        OP_HASHJOIN},
+    {"MergeJoin",       OP_MERGEJOIN},
+    {"Memo",            OP_MEMOIZE},
+    {"Material",        OP_MATERIALIZE},
+    {"Sort",            OP_SORT},
+    {"IncrementalSort", OP_INCSORT},
+    {"Gather",          OP_GATHER},
+    {"GatherMerge",     OP_GATHERMERGE},
+    {"Append",          OP_APPEND},
+    {NULL,              OP_UNKNOWN}
+};
+
+#define IsScanOperator(op) ((op) == OP_SEQSCAN || (op) == OP_IDXSCAN || (op) == OP_BITMAPSCAN)
+#define IsJoinOperator(op) ((op) == OP_NESTLOOP || (op) == OP_HASHJOIN || (op) == OP_MERGEJOIN)
+
+static char *pglab_estimator_socket = NULL;
+static int pglab_estimator_timeout = 1000;
+
+/* The connection to the estimator is kept open across planner runs */
+static int estimator_sock = -1;
+static char *estimator_sock_path = NULL;
+
+/* Set while a request is in flight. If it is still set on the next request, the previous one has been aborted. */
+static bool estimator_in_exchange = false;
+
+/* Point in time at which the request that is currently in flight times out (only if pglab.estimator_timeout > 0) */
+static TimestampTz estimator_deadline = 0;
+
+/* Rendezvous variable that holds the in-process estimator */
+static pglab_batch_estimates_hook_type *batch_estimates_hook = NULL;
+
+void
+init_model_estimator(void)
+{
+    DefineCustomStringVariable("pglab.estimator_socket",
+                               "Unix-domain socket of an external estimator for cardinalities and costs.",
+                               "If set, the planner requests its estimates per join level from this socket. "
+                               "Hints take precedence over the external estimates.",
+                               &pglab_estimator_socket, "",
+                               PGC_SUSET, 0,
+                               NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pglab.estimator_timeout",
+                            "Timeout for each request to the external estimator.",
+                            "Set to 0 to wait indefinitely.",
+                            &pglab_estimator_timeout, 1000,
+                            0, INT_MAX,
+                            PGC_USERSET, GUC_UNIT_MS,
+                            NULL, NULL, NULL);
+
+    batch_estimates_hook = (pglab_batch_estimates_hook_type *) find_rendezvous_variable(PGLAB_BATCH_ESTIMATES_HOOK);
+}
+
+static void
+estimator_disconnect(void)
+{
+    if (estimator_sock >= 0)
+        close(estimator_sock);
+    estimator_sock = -1;
+
+    if (estimator_sock_path)
+        pfree(estimator_sock_path);
+    estimator_sock_path = NULL;
+
+    estimator_in_exchange = false;
+}
+
+static bool
+estimator_connect(void)
+{
+    struct sockaddr_un addr;
+    int sock;
+
+    if (estimator_in_exchange)
+        estimator_disconnect();
+
+    if (estimator_sock >= 0 && strcmp(estimator_sock_path, pglab_estimator_socket) == 0)
+        return true;
+
+    estimator_disconnect();
+
+    if (strlen(pglab_estimator_socket) >= sizeof(addr.sun_path))
+    {
+        ereport(WARNING,
+                errmsg("[pg_lab] estimator socket path is too long: \"%s\"", pglab_estimator_socket));
+        return false;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        ereport(WARNING,
+                errcode_for_socket_access(),
+                errmsg("[pg_lab] could not create estimator socket: %m"));
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, pglab_estimator_socket, sizeof(addr.sun_path));
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        ereport(WARNING,
+                errcode_for_socket_access(),
+                errmsg("[pg_lab] could not connect to estimator at \"%s\": %m", pglab_estimator_socket),
+                errdetail("Falling back to the native estimates."));
+        close(sock);
+        return false;
+    }
+
+    /* All further communication waits on the latch, such that query cancels and timeouts are processed */
+    if (!pg_set_noblock(sock))
+    {
+        ereport(WARNING,
+                errcode_for_socket_access(),
+                errmsg("[pg_lab] could not set estimator socket to non-blocking mode: %m"),
+                errdetail("Falling back to the native estimates."));
+        close(sock);
+        return false;
+    }
+
+    estimator_sock = sock;
+    estimator_sock_path = MemoryContextStrdup(TopMemoryContext, pglab_estimator_socket);
+    return true;
+}
+
+static void
+estimator_start_timeout(void)
+{
+    estimator_deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), pglab_estimator_timeout);
+}
+
+/*
+ * Waits until the estimator socket becomes readable/writeable (depending on socket_event).
+ *
+ * Interrupts are processed while waiting, i.e. a query cancel or statement_timeout aborts the planner run as usual. Returns
+ * false (with errno set to ETIMEDOUT) if the pglab.estimator_timeout of the current exchange expires.
+ */
+static bool
+estimator_wait(int socket_event)
+{
+    for (;;)
+    {
+        int wakeup_events = socket_event | WL_LATCH_SET | WL_EXIT_ON_PM_DEATH;
+        long timeout = -1;
+        int rc;
+
+        if (pglab_estimator_timeout > 0)
+        {
+            timeout = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), estimator_deadline);
+            if (timeout <= 0)
+            {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            wakeup_events |= WL_TIMEOUT;
+        }
+
+        rc = WaitLatchOrSocket(MyLatch, wakeup_events, estimator_sock, timeout, PG_WAIT_EXTENSION);
+
+        if (rc & WL_LATCH_SET)
+        {
+            ResetLatch(MyLatch);
+            CHECK_FOR_INTERRUPTS();
+        }
+
+        if (rc & socket_event)
+            return true;
+    }
+}
+
+static bool
+estimator_send(const char *data, Size len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(estimator_sock, data, len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (!estimator_wait(WL_SOCKET_WRITEABLE))
+                return false;
+            continue;
+        }
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0)
+            return false;
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/*
+ * Reads from the estimator until the buffer contains n_lines complete lines.
+ */
+static bool
+estimator_receive(StringInfo buf, int n_lines)
+{
+    int scan_pos = 0;
+    int lines_seen = 0;
+
+    for (;;)
+    {
+        ssize_t n;
+
+        while (scan_pos < buf->len)
+        {
+            if (buf->data[scan_pos++] == '\n' && ++lines_seen == n_lines)
+                return true;
+        }
+
+        enlargeStringInfo(buf, 8192);
+        n = recv(estimator_sock, buf->data + buf->len, buf->maxlen - buf->len - 1, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (!estimator_wait(WL_SOCKET_READABLE))
+                return false;
+            continue;
+        }
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n == 0)
+        {
+            errno = ECONNRESET;
+            return false;
+        }
+        else if (n < 0)
+            return false;
+
+        buf->len += n;
+        buf->data[buf->len] = '\0';
+    }
+}
+
+static void
+append_relnames(ModelEstimator *estimator, StringInfo buf, Relids relids)
+{
+    int rti = -1;
+    bool first = true;
+
+    while ((rti = bms_next_member(relids, rti)) >= 0)
+    {
+        RangeTblEntry *rte = estimator->root->simple_rte_array[rti];
+
+        if (!first)
+            appendStringInfoChar(buf, ' ');
+        appendStringInfoString(buf, rte->eref->aliasname);
+        first = false;
+    }
+}
+
+static PhysicalOperator
+lookup_operator(const char *name)
+{
+    for (const EstimatorOperator *entry = estimator_operators; entry->name; ++entry)
+    {
+        if (pg_strcasecmp(entry->name, name) == 0)
+            return entry->op;
+    }
+
+    return OP_UNKNOWN;
+}
+
+/*
+ * Parses a single line of the estimator's response. Returns false if the line is malformed.
+ */
+static bool
+parse_estimate(ModelEstimate *entry, char *line)
+{
+    char *saveptr, *token, *endptr;
+    bool baserel;
+
+    baserel = bms_membership(entry->relids) == BMS_SINGLETON;
+
+    token = strtok_r(line, " \t\r", &saveptr);
+    if (!token)
+        return false;
+
+    if (strcmp(token, "-") != 0)
+    {
+        errno = 0;
+        entry->rows = strtod(token, &endptr);
+        if (*endptr != '\0' || errno != 0 || !isfinite(entry->rows) || entry->rows < 0)
+            return false;
+    }
+
+    while ((token = strtok_r(NULL, " \t\r", &saveptr)) != NULL)
+    {
+        PhysicalOperator op;
+        Cost startup_cost, total_cost;
+        char *costs;
+
+        costs = strchr(token, '=');
+        if (!costs)
+            return false;
+        *costs++ = '\0';
+
+        op = lookup_operator(token);
+        if (op == OP_UNKNOWN || (baserel && IsJoinOperator(op)) || (!baserel && IsScanOperator(op)))
+            return false;
+
+        /* The costs are used as-is for the paths, so a NaN or negative cost would break the path comparisons */
+        errno = 0;
+        startup_cost = strtod(costs, &endptr);
+        if (*endptr != ',' || errno != 0 || !isfinite(startup_cost) || startup_cost < 0)
+            return false;
+        total_cost = strtod(endptr + 1, &endptr);
+        if (*endptr != '\0' || errno != 0 || !isfinite(total_cost) || startup_cost > total_cost)
+            return false;
+
+        if (!entry->has_costs)
+        {
+            entry->costs.relids = entry->relids;
+            InitCostHint(&entry->costs, baserel);
+            entry->has_costs = true;
+        }
+
+        StoreCostHint(&entry->costs, op, startup_cost, total_cost);
+    }
+
+    return true;
+}
+
+/*
+ * Sends a batch of intermediates to the estimator socket and stores the answers in the corresponding entries.
+ */
+static void
+estimator_socket_exchange(ModelEstimator *estimator, List *batch)
+{
+    StringInfoData buf;
+    ListCell *lc;
+    char *line;
+    bool success;
+
+    if (!estimator_connect())
+    {
+        estimator->failed = true;
+        return;
+    }
+
+    initStringInfo(&buf);
+    if (!estimator->query_sent)
+    {
+        appendStringInfo(&buf, "QUERY " UINT64_FORMAT " %d %zu\n",
+                         estimator->root->parse->queryId,
+                         (int) estimator->root->query_level,
+                         strlen(estimator->query_string));
+        appendStringInfoString(&buf, estimator->query_string);
+        appendStringInfoChar(&buf, '\n');
+    }
+
+    appendStringInfo(&buf, "BATCH %d\n", list_length(batch));
+    foreach (lc, batch)
+    {
+        ModelEstimate *entry = (ModelEstimate *) lfirst(lc);
+        append_relnames(estimator, &buf, entry->relids);
+        appendStringInfoChar(&buf, '\n');
+    }
+
+    estimator_in_exchange = true;
+    estimator_start_timeout();
+
+    success = estimator_send(buf.data, buf.len);
+    if (success)
+    {
+        resetStringInfo(&buf);
+        success = estimator_receive(&buf, list_length(batch));
+    }
+
+    if (!success)
+    {
+        ereport(WARNING,
+                errcode_for_socket_access(),
+                errmsg("[pg_lab] communication with the estimator at \"%s\" failed: %m", pglab_estimator_socket),
+                errdetail("Falling back to the native estimates."));
+        estimator_disconnect();
+        estimator->failed = true;
+        pfree(buf.data);
+        return;
+    }
+
+    estimator_in_exchange = false;
+    estimator->query_sent = true;
+
+    line = buf.data;
+    foreach (lc, batch)
+    {
+        ModelEstimate *entry = (ModelEstimate *) lfirst(lc);
+        char *next_line = strchr(line, '\n');
+
+        *next_line = '\0';
+        if (!parse_estimate(entry, line))
+        {
+            ereport(WARNING,
+                    errmsg("[pg_lab] ignoring malformed estimator response: \"%s\"", line));
+            entry->rows = NAN;
+            entry->has_costs = false;
+        }
+
+        line = next_line + 1;
+    }
+
+    pfree(buf.data);
+}
+
+/*
+ * Passes a batch of intermediates to the in-process estimator.
+ */
+static void
+estimator_hook_exchange(ModelEstimator *estimator, List *batch, int level)
+{
+    ModelEstimate **estimates;
+    ListCell *lc;
+    int i = 0;
+
+    estimates = (ModelEstimate **) palloc(list_length(batch) * sizeof(ModelEstimate *));
+    foreach (lc, batch)
+        estimates[i++] = (ModelEstimate *) lfirst(lc);
+
+    (*estimator->hook)(estimator->root, level, estimates, list_length(batch));
+
+    for (i = 0; i < list_length(batch); i++)
+    {
+        if (estimates[i]->rows < 0)
+            estimates[i]->rows = NAN;
+    }
+
+    pfree(estimates);
+}
+
+static void
+estimator_exchange(ModelEstimator *estimator, List *batch, int level)
+{
+    if (batch == NIL)
+        return;
+
+    if (estimator->hook)
+        estimator_hook_exchange(estimator, batch, level);
+    else
+        estimator_socket_exchange(estimator, batch);
+}
+
+/*
+ * Registers a new intermediate for the next batch. Returns false if the intermediate is already known.
+ */
+static bool
+enter_estimate(ModelEstimator *estimator, Relids relids, RelOptInfo *outer_rel, RelOptInfo *inner_rel, List **batch)
+{
+    ModelEstimate *entry;
+    bool found;
+
+    entry = (ModelEstimate *) hash_search(estimator->estimates, &relids, HASH_ENTER, &found);
+    if (found)
+        return false;
+
+    entry->rows = NAN;
+    entry->has_costs = false;
+    entry->outer_rel = outer_rel;
+    entry->inner_rel = inner_rel;
+    *batch = lappend(*batch, entry);
+    return true;
+}
+
+static void
+build_join_graph(ModelEstimator *estimator)
+{
+    PlannerInfo *root = estimator->root;
+
+    estimator->neighbors = (Relids *) palloc0(root->simple_rel_array_size * sizeof(Relids));
+
+    for (int i = 1; i < root->simple_rel_array_size; i++)
+    {
+        RelOptInfo *outer_rel = root->simple_rel_array[i];
+        if (!outer_rel || outer_rel->reloptkind != RELOPT_BASEREL)
+            continue;
+
+        for (int j = i + 1; j < root->simple_rel_array_size; j++)
+        {
+            RelOptInfo *inner_rel = root->simple_rel_array[j];
+            if (!inner_rel || inner_rel->reloptkind != RELOPT_BASEREL)
+                continue;
+
+            if (have_relevant_joinclause(root, outer_rel, inner_rel) ||
+                have_join_order_restriction(root, outer_rel, inner_rel))
+            {
+                estimator->neighbors[i] = bms_add_member(estimator->neighbors[i], j);
+                estimator->neighbors[j] = bms_add_member(estimator->neighbors[j], i);
+            }
+        }
+    }
+}
+
+/*
+ * Removes the outer joins from the relids of an intermediate. Just like the final plan, the estimator only knows about the
+ * base rels. Since the joins of the outer query can reach the estimator of a subquery, we also make sure that all base rels
+ * belong to our planner run.
+ *
+ * Returns the relids themselves if they do not contain any outer joins (the common case), or NULL if they cannot be handled
+ * by the estimator.
+ */
+static Relids
+estimator_base_relids(ModelEstimator *estimator, Relids relids)
+{
+    PlannerInfo *root = estimator->root;
+    Relids base_relids = EMPTY_BITMAP;
+    int rti = -1;
+
+    if (bms_is_subset(relids, estimator->known_rels))
+        return relids;
+
+    while ((rti = bms_next_member(relids, rti)) >= 0)
+    {
+        if (bms_is_member(rti, estimator->known_rels))
+            base_relids = bms_add_member(base_relids, rti);
+        else if (rti < root->simple_rel_array_size && root->simple_rte_array[rti]->rtekind == RTE_JOIN)
+            continue;
+        else
+        {
+            bms_free(base_relids);
+            return NULL;
+        }
+    }
+
+    return base_relids;
+}
+
+/*
+ * Collects all connected intermediates of the next join level.
+ *
+ * For the first level, these are simply all base rels (including the children of partitioned tables). All further levels
+ * extend the intermediates of the previous level by one of their neighbors in the join graph.
+ */
+static List *
+build_level_batch(ModelEstimator *estimator, int level)
+{
+    PlannerInfo *root = estimator->root;
+    List *batch = NIL;
+    List *frontier = NIL;
+    ListCell *lc;
+
+    if (level == 1)
+    {
+        for (int rti = 1; rti < root->simple_rel_array_size; rti++)
+        {
+            RelOptInfo *rel = root->simple_rel_array[rti];
+            Relids relids;
+
+            if (!rel || (rel->reloptkind != RELOPT_BASEREL && rel->reloptkind != RELOPT_OTHER_MEMBER_REL))
+                continue;
+
+            relids = bms_make_singleton(rti);
+            if (enter_estimate(estimator, relids, NULL, NULL, &batch) && rel->reloptkind == RELOPT_BASEREL)
+                frontier = lappend(frontier, relids);
+        }
+    }
+    else
+    {
+        if (!estimator->neighbors)
+            build_join_graph(estimator);
+
+        foreach (lc, estimator->frontier)
+        {
+            Relids current = (Relids) lfirst(lc);
+            Relids candidates = EMPTY_BITMAP;
+            RelOptInfo *outer_rel;
+            int rti = -1;
+
+            if (level == 2)
+                outer_rel = root->simple_rel_array[bms_singleton_member(current)];
+            else
+                outer_rel = find_join_rel(root, current);
+
+            while ((rti = bms_next_member(current, rti)) >= 0)
+                candidates = bms_add_members(candidates, estimator->neighbors[rti]);
+            candidates = bms_del_members(candidates, current);
+
+            rti = -1;
+            while ((rti = bms_next_member(candidates, rti)) >= 0 && list_length(batch) < MODEL_ESTIMATOR_MAX_BATCH)
+            {
+                Relids relids = bms_add_member(bms_copy(current), rti);
+
+                if (enter_estimate(estimator, relids, outer_rel, root->simple_rel_array[rti], &batch))
+                    frontier = lappend(frontier, relids);
+                else
+                    bms_free(relids);
+            }
+
+            bms_free(candidates);
+        }
+    }
+
+    list_free(estimator->frontier);
+    estimator->frontier = frontier;
+    estimator->fetched_level = level;
+
+    return batch;
+}
+
+ModelEstimator *
+model_estimator_begin(PlannerInfo *root, const char *query_string)
+{
+    ModelEstimator *estimator;
+    HASHCTL hctl;
+
+    if (!*batch_estimates_hook && (!pglab_estimator_socket || pglab_estimator_socket[0] == '\0'))
+        return NULL;
+
+    estimator = (ModelEstimator *) palloc0(sizeof(ModelEstimator));
+    estimator->root = root;
+    estimator->hook = *batch_estimates_hook;
+    estimator->context = CurrentMemoryContext;
+    estimator->query_string = query_string ? query_string : "";
+    estimator->query_sent = false;
+    estimator->failed = false;
+    estimator->known_rels = EMPTY_BITMAP;
+    estimator->neighbors = NULL;
+    estimator->fetched_level = 0;
+    estimator->frontier = NIL;
+
+    for (int rti = 1; rti < root->simple_rel_array_size; rti++)
+    {
+        if (root->simple_rel_array[rti])
+            estimator->known_rels = bms_add_member(estimator->known_rels, rti);
+    }
+
+    hctl.keysize = sizeof(Relids);
+    hctl.entrysize = sizeof(ModelEstimate);
+    hctl.hcxt = CurrentMemoryContext;
+    hctl.hash = bitmap_hash;
+    hctl.match = bitmap_match;
+    estimator->estimates = hash_create("pg_lab model estimates", 4 * list_length(root->parse->rtable), &hctl,
+                                       HASH_ELEM | HASH_CONTEXT | HASH_COMPARE | HASH_FUNCTION);
+
+    return estimator;
+}
+
+ModelEstimate *
+model_estimator_fetch(ModelEstimator *estimator, Relids relids)
+{
+    ModelEstimate *entry;
+    MemoryContext oldcontext;
+    List *batch = NIL;
+    Relids base_relids;
+    bool base_relids_owned = false;
+    int level;
+    bool found;
+
+    oldcontext = MemoryContextSwitchTo(estimator->context);
+
+    base_relids = estimator_base_relids(estimator, relids);
+    if (bms_is_empty(base_relids))
+    {
+        MemoryContextSwitchTo(oldcontext);
+        return NULL;
+    }
+
+    /* The join level is determined by the base rels only, outer joins do not count */
+    level = bms_num_members(base_relids);
+
+    entry = (ModelEstimate *) hash_search(estimator->estimates, &base_relids, HASH_FIND, &found);
+    if (!found && !estimator->failed && level == estimator->fetched_level + 1)
+    {
+        batch = build_level_batch(estimator, level);
+        estimator_exchange(estimator, batch, level);
+        list_free(batch);
+        batch = NIL;
+
+        entry = (ModelEstimate *) hash_search(estimator->estimates, &base_relids, HASH_FIND, &found);
+    }
+
+    /* The intermediate is not connected (or the batch was too large), we need to request it on its own */
+    if (!found && !estimator->failed)
+    {
+        if (base_relids == relids)
+            base_relids = bms_copy(relids);
+
+        enter_estimate(estimator, base_relids, NULL, NULL, &batch);
+        base_relids_owned = true;
+        estimator_exchange(estimator, batch, level);
+        list_free(batch);
+
+        entry = (ModelEstimate *) hash_search(estimator->estimates, &base_relids, HASH_FIND, &found);
+    }
+
+    if (!base_relids_owned && base_relids != relids)
+        bms_free(base_relids);
+
+    MemoryContextSwitchTo(oldcontext);
+
+    return found ? entry : NULL;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,839 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "hints.h"
+
+/*
+ * Hand-written recursive-descent parser for hint blocks.
+ *
+ * This parser implements the same grammar as HintBlock.g4, but works directly on the raw hint text. The lexer does not
+ * allocate at all: tokens simply point into the hint text. The only allocations happen when building the HintBlockSpec
+ * and these are performed in the current memory context.
+ *
+ * In contrast to the ANTLR parser (which tries to recover from syntax errors), the native parser raises an error as soon
+ * as it encounters invalid input.
+ */
+
+typedef enum HintTokenType
+{
+    TOK_EOF,
+    TOK_HBLOCK_START,
+    TOK_HBLOCK_END,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_LBRACE,
+    TOK_RBRACE,
+    TOK_LBRACKET,
+    TOK_RBRACKET,
+    TOK_HASH,
+    TOK_EQ,
+    TOK_DOT,
+    TOK_SEM,
+    TOK_QUOTE,
+    TOK_DEFAULT,
+
+    /* Config */
+    TOK_CONFIG,
+    TOK_PLANMODE,
+    TOK_FULL,
+    TOK_ANCHORED,
+    TOK_PARMODE,
+    TOK_SEQUENTIAL,
+    TOK_PARALLEL,
+    TOK_PLANCACHE,
+    TOK_GENERIC,
+    TOK_CUSTOM,
+    TOK_SET,
+
+    /* Top-level hints */
+    TOK_JOINORDER,
+    TOK_JOINPREFIX,
+    TOK_CARD,
+    TOK_CARDSCALE,
+
+    /* Operators */
+    TOK_NESTLOOP,
+    TOK_MERGEJOIN,
+    TOK_HASHJOIN,
+    TOK_SEQSCAN,
+    TOK_IDXSCAN,
+    TOK_BITMAPSCAN,
+    TOK_MEMOIZE,
+    TOK_MATERIALIZE,
+    TOK_SORT,
+    TOK_INCSORT,
+    TOK_GATHER,
+    TOK_GATHERMERGE,
+    TOK_APPEND,
+    TOK_RESULT,
+
+    /* Operator parameters */
+    TOK_COST,
+    TOK_STARTUP,
+    TOK_TOTAL,
+    TOK_WORKERS,
+    TOK_FORCED,
+
+    TOK_IDENTIFIER,
+    TOK_FLOAT,
+    TOK_INT
+} HintTokenType;
+
+typedef struct HintKeyword
+{
+    const char   *keyword;
+    HintTokenType token;
+} HintKeyword;
+
+/* Keywords are matched case-insensitively, just like in the ANTLR grammar */
+static const HintKeyword hint_keywords[] =
+{
+    {"default",    TOK_DEFAULT},
+    {"Config",     TOK_CONFIG},
+    {"plan_mode",  TOK_PLANMODE},
+    {"full",       TOK_FULL},
+    {"anchored",   TOK_ANCHORED},
+    {"exec_mode",  TOK_PARMODE},
+    {"sequential", TOK_SEQUENTIAL},
+    {"parallel",   TOK_PARALLEL},
+    {"plan_cache", TOK_PLANCACHE},
+    {"generic",    TOK_GENERIC},
+    {"custom",     TOK_CUSTOM},
+    {"Set",        TOK_SET},
+    {"JoinOrder",  TOK_JOINORDER},
+    {"JoinPrefix", TOK_JOINPREFIX},
+    {"Card",       TOK_CARD},
+    {"CardScale",  TOK_CARDSCALE},
+    {"NestLoop",   TOK_NESTLOOP},
+    {"MergeJoin",  TOK_MERGEJOIN},
+    {"HashJoin",   TOK_HASHJOIN},
+    {"SeqScan",    TOK_SEQSCAN},
+    {"IdxScan",    TOK_IDXSCAN},
+    {"BitmapScan", TOK_BITMAPSCAN},
+    {"Memo",       TOK_MEMOIZE},
+    {"Material",   TOK_MATERIALIZE},
+    {"Sort",       TOK_SORT},
+    {"IncrementalSort", TOK_INCSORT},
+    {"Gather",     TOK_GATHER},
+    {"GatherMerge", TOK_GATHERMERGE},
+    {"Append",     TOK_APPEND},
+    {"Result",     TOK_RESULT},
+    {"Cost",       TOK_COST},
+    {"Start",      TOK_STARTUP},
+    {"Total",      TOK_TOTAL},
+    {"Workers",    TOK_WORKERS},
+    {"Forced",     TOK_FORCED},
+    {NULL,         TOK_EOF}
+};
+
+#define HBLOCK_START_TEXT "/*=pg_lab="
+#define HBLOCK_START_LEN  (sizeof(HBLOCK_START_TEXT) - 1)
+
+typedef struct HintToken
+{
+    HintTokenType type;
+    const char   *start;
+    int           length;
+} HintToken;
+
+typedef struct HintParser
+{
+    const char *input;
+    const char *pos;
+    HintToken   current;
+} HintParser;
+
+#define IsHintIdentStart(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || (c) == '_')
+#define IsHintIdentChar(c)  (IsHintIdentStart(c) || ((c) >= '0' && (c) <= '9'))
+#define IsHintDigit(c)      ((c) >= '0' && (c) <= '9')
+#define IsHintSpace(c)      ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n' || (c) == '\f')
+
+static void
+hint_syntax_error(HintParser *parser, const char *expected)
+{
+    if (parser->current.type == TOK_EOF)
+        ereport(ERROR,
+                (errcode(ERRCODE_SYNTAX_ERROR),
+                 errmsg("[pg_lab] Syntax error in hint block at end of input"),
+                 errdetail("Expected %s", expected)));
+    else
+        ereport(ERROR,
+                (errcode(ERRCODE_SYNTAX_ERROR),
+                 errmsg("[pg_lab] Syntax error in hint block at position %d",
+                        (int) (parser->current.start - parser->input)),
+                 errdetail("Expected %s, but found \"%.*s\"",
+                           expected, parser->current.length, parser->current.start)));
+}
+
+static void
+hint_token_error(HintParser *parser, const char *pos)
+{
+    ereport(ERROR,
+            (errcode(ERRCODE_SYNTAX_ERROR),
+             errmsg("[pg_lab] Syntax error in hint block at position %d", (int) (pos - parser->input)),
+             errdetail("Unexpected character \"%c\"", *pos)));
+}
+
+static HintTokenType
+lookup_keyword(const char *start, int length)
+{
+    for (const HintKeyword *kw = hint_keywords; kw->keyword; ++kw)
+    {
+        if ((int) strlen(kw->keyword) == length && pg_strncasecmp(kw->keyword, start, length) == 0)
+            return kw->token;
+    }
+
+    return TOK_IDENTIFIER;
+}
+
+/*
+ * Moves the parser to the next token.
+ */
+static void
+next_token(HintParser *parser)
+{
+    const char *pos = parser->pos;
+    HintToken  *token = &parser->current;
+
+    while (IsHintSpace(*pos))
+        ++pos;
+
+    token->start = pos;
+    token->length = 1;
+
+    switch (*pos)
+    {
+        case '\0':
+            token->type = TOK_EOF;
+            token->length = 0;
+            break;
+        case '(':
+            token->type = TOK_LPAREN;
+            break;
+        case ')':
+            token->type = TOK_RPAREN;
+            break;
+        case '{':
+            token->type = TOK_LBRACE;
+            break;
+        case '}':
+            token->type = TOK_RBRACE;
+            break;
+        case '[':
+            token->type = TOK_LBRACKET;
+            break;
+        case ']':
+            token->type = TOK_RBRACKET;
+            break;
+        case '#':
+            token->type = TOK_HASH;
+            break;
+        case '=':
+            token->type = TOK_EQ;
+            break;
+        case '.':
+            token->type = TOK_DOT;
+            break;
+        case ';':
+            token->type = TOK_SEM;
+            break;
+        case '\'':
+            token->type = TOK_QUOTE;
+            break;
+        case '*':
+            if (pos[1] != '/')
+                hint_token_error(parser, pos);
+            token->type = TOK_HBLOCK_END;
+            token->length = 2;
+            break;
+        case '/':
+            if (pg_strncasecmp(pos, HBLOCK_START_TEXT, HBLOCK_START_LEN) != 0)
+                hint_token_error(parser, pos);
+            token->type = TOK_HBLOCK_START;
+            token->length = HBLOCK_START_LEN;
+            break;
+        default:
+        {
+            const char *end = pos;
+
+            if (IsHintIdentStart(*pos))
+            {
+                while (IsHintIdentChar(*end))
+                    ++end;
+                token->length = end - pos;
+                token->type = lookup_keyword(pos, token->length);
+            }
+            else if (IsHintDigit(*pos))
+            {
+                while (IsHintDigit(*end))
+                    ++end;
+
+                if (end[0] == '.' && IsHintDigit(end[1]))
+                {
+                    ++end;
+                    while (IsHintDigit(*end))
+                        ++end;
+                    token->type = TOK_FLOAT;
+                }
+                else
+                    token->type = TOK_INT;
+
+                token->length = end - pos;
+            }
+            else
+                hint_token_error(parser, pos);
+            break;
+        }
+    }
+
+    parser->pos = pos + token->length;
+}
+
+static void
+expect_token(HintParser *parser, HintTokenType type, const char *expected)
+{
+    if (parser->current.type != type)
+        hint_syntax_error(parser, expected);
+    next_token(parser);
+}
+
+/*
+ * Converts the current numeric token to a double.
+ *
+ * We cannot pass the token directly to strtod() since the hint text might continue with characters that strtod() would
+ * interpret as part of the number (e.g. an exponent).
+ */
+static double
+token_to_double(HintToken *token)
+{
+    char   buf[64];
+    char  *numstr;
+    double result;
+
+    if (token->length < (int) sizeof(buf))
+    {
+        memcpy(buf, token->start, token->length);
+        buf[token->length] = '\0';
+        numstr = buf;
+    }
+    else
+        numstr = pnstrdup(token->start, token->length);
+
+    result = strtod(numstr, NULL);
+
+    if (numstr != buf)
+        pfree(numstr);
+    return result;
+}
+
+/*
+ * Checks whether the token can start a relation name. Keywords are only reserved where the grammar expects them, so
+ * relations and aliases such as "sort" or "custom" are still accepted.
+ */
+static bool
+is_relation_token(HintTokenType type)
+{
+    return type == TOK_IDENTIFIER || (type >= TOK_DEFAULT && type <= TOK_FORCED);
+}
+
+static char *
+parse_relation_id(HintParser *parser)
+{
+    char *relname;
+
+    if (!is_relation_token(parser->current.type))
+        hint_syntax_error(parser, "relation name");
+
+    relname = pnstrdup(parser->current.start, parser->current.length);
+    next_token(parser);
+    return relname;
+}
+
+static JoinOrderSpec *
+parse_join_order_entry(HintParser *parser)
+{
+    JoinOrderSpec *outer_child, *inner_child;
+    JoinOrderSpec *join_order;
+    char *relname;
+
+    check_stack_depth();
+
+    if (is_relation_token(parser->current.type))
+    {
+        relname = parse_relation_id(parser);
+        join_order = MakeJoinOrderSpecBase(relname);
+        pfree(relname);
+        return join_order;
+    }
+
+    expect_token(parser, TOK_LPAREN, "\"(\" or relation name");
+    outer_child = parse_join_order_entry(parser);
+    inner_child = parse_join_order_entry(parser);
+    expect_token(parser, TOK_RPAREN, "\")\"");
+
+    return MakeJoinOrderSpecIntermediate(outer_child, inner_child);
+}
+
+static void
+parse_setting(HintParser *parser, HintBlockSpec *spec)
+{
+    HintSpec *hint;
+
+    switch (parser->current.type)
+    {
+        case TOK_PLANMODE:
+            next_token(parser);
+            expect_token(parser, TOK_EQ, "\"=\"");
+
+            hint = MakeHintSpec(HS_PLAN_MODE);
+            if (parser->current.type == TOK_FULL)
+                hint->mode = HINTMODE_FULL;
+            else if (parser->current.type == TOK_ANCHORED)
+                hint->mode = HINTMODE_ANCHORED;
+            else
+                hint_syntax_error(parser, "plan mode (full or anchored)");
+            next_token(parser);
+            break;
+
+        case TOK_PARMODE:
+            next_token(parser);
+            expect_token(parser, TOK_EQ, "\"=\"");
+
+            hint = MakeHintSpec(HS_PARALLEL_MODE);
+            if (parser->current.type == TOK_DEFAULT)
+                hint->parallel_mode = PARMODE_DEFAULT;
+            else if (parser->current.type == TOK_SEQUENTIAL)
+                hint->parallel_mode = PARMODE_SEQUENTIAL;
+            else if (parser->current.type == TOK_PARALLEL)
+                hint->parallel_mode = PARMODE_PARALLEL;
+            else
+                hint_syntax_error(parser, "execution mode (default, sequential or parallel)");
+            next_token(parser);
+            break;
+
+        case TOK_PLANCACHE:
+            next_token(parser);
+            expect_token(parser, TOK_EQ, "\"=\"");
+
+            hint = MakeHintSpec(HS_PLAN_CACHE_MODE);
+            if (parser->current.type == TOK_DEFAULT)
+                hint->plan_cache_mode = PLANCACHE_DEFAULT;
+            else if (parser->current.type == TOK_GENERIC)
+                hint->plan_cache_mode = PLANCACHE_GENERIC;
+            else if (parser->current.type == TOK_CUSTOM)
+                hint->plan_cache_mode = PLANCACHE_CUSTOM;
+            else
+                hint_syntax_error(parser, "plan cache mode (default, generic or custom)");
+            next_token(parser);
+            break;
+
+        default:
+            hint_syntax_error(parser, "setting (plan_mode, exec_mode or plan_cache)");
+            return;
+    }
+
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static void
+parse_setting_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    expect_token(parser, TOK_CONFIG, "Config");
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    parse_setting(parser, spec);
+    while (parser->current.type == TOK_SEM)
+    {
+        next_token(parser);
+        parse_setting(parser, spec);
+    }
+
+    expect_token(parser, TOK_RPAREN, "\")\"");
+}
+
+static void
+parse_join_order_hint(HintParser *parser, HintBlockSpec *spec, HintSpecTag tag)
+{
+    HintSpec *hint;
+
+    next_token(parser); /* JoinOrder or JoinPrefix */
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    hint = MakeHintSpec(tag);
+    hint->join_order = parse_join_order_entry(parser);
+
+    expect_token(parser, TOK_RPAREN, "\")\"");
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static Cost
+parse_cost(HintParser *parser)
+{
+    Cost cost;
+
+    if (parser->current.type == TOK_INT)
+    {
+        char buf[32];
+        int  length = Min(parser->current.length, (int) sizeof(buf) - 1);
+
+        /* integer costs are parsed as int, just like the ANTLR parser does */
+        memcpy(buf, parser->current.start, length);
+        buf[length] = '\0';
+        cost = atoi(buf);
+    }
+    else if (parser->current.type == TOK_FLOAT)
+        cost = token_to_double(&parser->current);
+    else
+    {
+        hint_syntax_error(parser, "cost value");
+        return -1;
+    }
+
+    next_token(parser);
+    return cost;
+}
+
+/*
+ * Parses a Cost(Start=... Total=...) hint. If hint is NULL, the costs are parsed but discarded.
+ */
+static void
+parse_cost_hint(HintParser *parser, HintSpec *hint)
+{
+    Cost startup_cost, total_cost;
+
+    expect_token(parser, TOK_COST, "Cost");
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+    expect_token(parser, TOK_STARTUP, "Start");
+    expect_token(parser, TOK_EQ, "\"=\"");
+    startup_cost = parse_cost(parser);
+    expect_token(parser, TOK_TOTAL, "Total");
+    expect_token(parser, TOK_EQ, "\"=\"");
+    total_cost = parse_cost(parser);
+    expect_token(parser, TOK_RPAREN, "\")\"");
+
+    if (!hint)
+        return;
+
+    hint->has_cost = true;
+    hint->startup_cost = startup_cost;
+    hint->total_cost = total_cost;
+}
+
+static float
+parse_parallel_hint(HintParser *parser)
+{
+    float workers;
+
+    expect_token(parser, TOK_WORKERS, "Workers");
+    expect_token(parser, TOK_EQ, "\"=\"");
+
+    if (parser->current.type != TOK_INT)
+    {
+        hint_syntax_error(parser, "number of workers");
+        return NAN;
+    }
+
+    workers = token_to_double(&parser->current);
+    next_token(parser);
+    return workers;
+}
+
+static void
+parse_param_list(HintParser *parser, HintSpec *hint)
+{
+    bool empty = true;
+
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    while (parser->current.type != TOK_RPAREN)
+    {
+        switch (parser->current.type)
+        {
+            case TOK_FORCED:
+                next_token(parser);
+                break;
+            case TOK_COST:
+                parse_cost_hint(parser, hint);
+                break;
+            case TOK_WORKERS:
+                hint->parallel_workers = parse_parallel_hint(parser);
+                break;
+            default:
+                hint_syntax_error(parser, "operator option (Forced, Cost or Workers)");
+                return;
+        }
+
+        empty = false;
+    }
+
+    if (empty)
+        hint_syntax_error(parser, "operator option (Forced, Cost or Workers)");
+
+    next_token(parser);
+}
+
+static void
+parse_operator_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    HintSpec *hint;
+    HintTokenType op_token;
+    bool join_op_allowed, scan_op_allowed;
+    int nrels;
+
+    hint = MakeHintSpec(HS_OPERATOR);
+    op_token = parser->current.type;
+
+    switch (op_token)
+    {
+        case TOK_NESTLOOP:
+            hint->op = OP_NESTLOOP;
+            break;
+        case TOK_HASHJOIN:
+            hint->op = OP_HASHJOIN;
+            break;
+        case TOK_MERGEJOIN:
+            hint->op = OP_MERGEJOIN;
+            break;
+        case TOK_SEQSCAN:
+            hint->op = OP_SEQSCAN;
+            break;
+        case TOK_IDXSCAN:
+            hint->op = OP_IDXSCAN;
+            break;
+        case TOK_BITMAPSCAN:
+            hint->op = OP_BITMAPSCAN;
+            break;
+        case TOK_MEMOIZE:
+            hint->op = OP_MEMOIZE;
+            break;
+        case TOK_MATERIALIZE:
+            hint->op = OP_MATERIALIZE;
+            break;
+        case TOK_SORT:
+            hint->op = OP_SORT;
+            break;
+        case TOK_INCSORT:
+            hint->op = OP_INCSORT;
+            break;
+        case TOK_GATHER:
+            hint->op = OP_GATHER;
+            break;
+        case TOK_GATHERMERGE:
+            hint->op = OP_GATHERMERGE;
+            break;
+        case TOK_APPEND:
+            hint->op = OP_APPEND;
+            break;
+        default:
+            hint_syntax_error(parser, "operator");
+            return;
+    }
+
+    join_op_allowed = op_token != TOK_SEQSCAN && op_token != TOK_IDXSCAN && op_token != TOK_BITMAPSCAN;
+    scan_op_allowed = op_token != TOK_NESTLOOP && op_token != TOK_HASHJOIN && op_token != TOK_MERGEJOIN;
+
+    next_token(parser);
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    nrels = 0;
+    while (is_relation_token(parser->current.type))
+    {
+        if (nrels == 1 && !join_op_allowed)
+            hint_syntax_error(parser, "\")\" or operator options");
+
+        hint->relnames = lappend(hint->relnames, parse_relation_id(parser));
+        ++nrels;
+    }
+
+    if (nrels == 0 || (nrels == 1 && !scan_op_allowed))
+        hint_syntax_error(parser, "relation name");
+
+    if (parser->current.type == TOK_LPAREN)
+        parse_param_list(parser, hint);
+
+    expect_token(parser, TOK_RPAREN, "\")\"");
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static void
+parse_result_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    HintSpec *hint;
+
+    expect_token(parser, TOK_RESULT, "Result");
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    hint = MakeHintSpec(HS_RESULT);
+    hint->parallel_workers = parse_parallel_hint(parser);
+
+    expect_token(parser, TOK_RPAREN, "\")\"");
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static void
+parse_cardinality_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    HintSpec *hint;
+
+    expect_token(parser, TOK_CARD, "Card");
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    hint = MakeHintSpec(HS_CARDINALITY);
+    hint->relnames = lappend(hint->relnames, parse_relation_id(parser));
+    while (is_relation_token(parser->current.type))
+        hint->relnames = lappend(hint->relnames, parse_relation_id(parser));
+
+    expect_token(parser, TOK_HASH, "\"#\" or relation name");
+    if (parser->current.type != TOK_INT)
+        hint_syntax_error(parser, "cardinality");
+    hint->card = token_to_double(&parser->current);
+    next_token(parser);
+
+    expect_token(parser, TOK_RPAREN, "\")\"");
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static void
+parse_cardinality_scale_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    HintSpec *hint;
+
+    expect_token(parser, TOK_CARDSCALE, "CardScale");
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    hint = MakeHintSpec(HS_CARDINALITY_SCALE);
+    hint->relnames = lappend(hint->relnames, parse_relation_id(parser));
+    while (is_relation_token(parser->current.type))
+        hint->relnames = lappend(hint->relnames, parse_relation_id(parser));
+
+    expect_token(parser, TOK_HASH, "\"#\" or relation name");
+    if (parser->current.type != TOK_FLOAT && parser->current.type != TOK_INT)
+        hint_syntax_error(parser, "scale factor");
+    hint->scale_factor = token_to_double(&parser->current);
+    next_token(parser);
+
+    expect_token(parser, TOK_RPAREN, "\")\"");
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static void
+parse_guc_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    HintSpec *hint;
+
+    expect_token(parser, TOK_SET, "Set");
+    expect_token(parser, TOK_LPAREN, "\"(\"");
+
+    hint = MakeHintSpec(HS_GUC);
+
+    if (parser->current.type != TOK_IDENTIFIER)
+        hint_syntax_error(parser, "GUC name");
+    hint->guc_name = pnstrdup(parser->current.start, parser->current.length);
+    next_token(parser);
+
+    expect_token(parser, TOK_EQ, "\"=\"");
+    expect_token(parser, TOK_QUOTE, "\"'\"");
+
+    if (parser->current.type != TOK_IDENTIFIER &&
+        parser->current.type != TOK_FLOAT &&
+        parser->current.type != TOK_INT)
+        hint_syntax_error(parser, "GUC value");
+    hint->guc_value = pnstrdup(parser->current.start, parser->current.length);
+    next_token(parser);
+
+    expect_token(parser, TOK_QUOTE, "\"'\"");
+    expect_token(parser, TOK_RPAREN, "\")\"");
+    spec->hints = lappend(spec->hints, hint);
+}
+
+static void
+parse_hint(HintParser *parser, HintBlockSpec *spec)
+{
+    switch (parser->current.type)
+    {
+        case TOK_CONFIG:
+            parse_setting_hint(parser, spec);
+            break;
+        case TOK_JOINORDER:
+            parse_join_order_hint(parser, spec, HS_JOIN_ORDER);
+            break;
+        case TOK_JOINPREFIX:
+            parse_join_order_hint(parser, spec, HS_JOIN_PREFIX);
+            break;
+        case TOK_NESTLOOP:
+        case TOK_HASHJOIN:
+        case TOK_MERGEJOIN:
+        case TOK_SEQSCAN:
+        case TOK_IDXSCAN:
+        case TOK_BITMAPSCAN:
+        case TOK_MEMOIZE:
+        case TOK_MATERIALIZE:
+        case TOK_SORT:
+        case TOK_INCSORT:
+        case TOK_GATHER:
+        case TOK_GATHERMERGE:
+        case TOK_APPEND:
+            parse_operator_hint(parser, spec);
+            break;
+        case TOK_RESULT:
+            parse_result_hint(parser, spec);
+            break;
+        case TOK_CARD:
+            parse_cardinality_hint(parser, spec);
+            break;
+        case TOK_CARDSCALE:
+            parse_cardinality_scale_hint(parser, spec);
+            break;
+        case TOK_COST:
+            /* Top-level cost hints are allowed by the grammar, but they are not attached to any operator. */
+            parse_cost_hint(parser, NULL);
+            break;
+        case TOK_SET:
+            parse_guc_hint(parser, spec);
+            break;
+        default:
+            hint_syntax_error(parser, "hint");
+            break;
+    }
+}
+
+/*
+ * Parses the raw hint text (including the surrounding comment markers) into a HintBlockSpec using the native parser.
+ *
+ * The spec is allocated in the current memory context.
+ */
+HintBlockSpec *
+native_parse_hint_text(const char *hint_text)
+{
+    HintParser parser;
+    HintBlockSpec *spec;
+
+    spec = (HintBlockSpec *) palloc0(sizeof(HintBlockSpec));
+    spec->hints = NIL;
+
+    parser.input = hint_text;
+    parser.pos = hint_text;
+    next_token(&parser);
+
+    expect_token(&parser, TOK_HBLOCK_START, "start of hint block");
+    while (parser.current.type != TOK_HBLOCK_END)
+        parse_hint(&parser, spec);
+    expect_token(&parser, TOK_HBLOCK_END, "end of hint block");
+
+    if (parser.current.type != TOK_EOF)
+        hint_syntax_error(&parser, "end of input");
+
+    return spec;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -12,6 +12,8 @@ extern "C" {
 
 #include "access/parallel.h"
 #include "commands/explain.h"
+#include "commands/prepare.h"
+#include "common/hashfn.h"
 #include "executor/executor.h"
 #include "lib/stringinfo.h"
 #include "nodes/bitmapset.h"
@@ -22,12 +24,22 @@ extern "C" {
 #include "optimizer/planmain.h"
 #include "optimizer/planner.h"
 #include "parser/parsetree.h"
+#include "tcop/utility.h"
 #include "utils/guc.h"
 #include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/plancache.h"
 
+#include "card_feedback.h"
+#include "dpccp.h"
+#include "hint_pinning.h"
 #include "hints.h"
+#include "model_estimator.h"
+#include "plan_capture.h"
+#include "planner_stats.h"
 
 char* JOIN_ORDER_TYPE_FORCED  = (char*) "Forced";
+char* JOIN_ORDER_TYPE_DPCCP   = (char*) "DPccp";
 
 #if PG_VERSION_NUM < 170000
 void destroyStringInfo(StringInfo);
@@ -51,6 +63,8 @@ static planner_hook_type prev_planner_hook = NULL;
 extern ExecutorEnd_hook_type ExecutorEnd_hook;
 static ExecutorEnd_hook_type prev_executor_end_hook = NULL;
 
+static ProcessUtility_hook_type prev_process_utility_hook = NULL;
+
 /* pg_lab hook additions */
 extern prepare_make_one_rel_callback_type prepare_make_one_rel_callback;
 static prepare_make_one_rel_callback_type prev_prepare_make_one_rel_hook = NULL;
@@ -112,6 +126,15 @@ static initial_cost_mergejoin_hook_type prev_initial_cost_mergejoin_hook = NULL;
 extern final_cost_mergejoin_hook_type final_cost_mergejoin_hook;
 static final_cost_mergejoin_hook_type prev_final_cost_mergejoin_hook = NULL;
 
+extern cost_memoize_rescan_hook_type cost_memoize_rescan_hook;
+static cost_memoize_rescan_hook_type prev_cost_memoize_rescan_hook = NULL;
+
+extern cost_gather_hook_type cost_gather_hook;
+static cost_gather_hook_type prev_cost_gather_hook = NULL;
+
+extern cost_gather_merge_hook_type cost_gather_merge_hook;
+static cost_gather_merge_hook_type prev_cost_gather_merge_hook = NULL;
+
 /* extension boilerplate */
 
 extern char **current_planner_type;
@@ -143,6 +166,11 @@ extern PGDLLEXPORT void hint_aware_final_cost_nestloop(PlannerInfo *root, NestPa
 
 extern PGDLLEXPORT void hint_aware_ExecutorEnd(QueryDesc *queryDesc);
 
+extern PGDLLEXPORT void hint_aware_ProcessUtility(PlannedStmt *pstmt, const char *queryString, bool readOnlyTree,
+                                                  ProcessUtilityContext context, ParamListInfo params,
+                                                  QueryEnvironment *queryEnv, DestReceiver *dest,
+                                                  QueryCompletion *qc);
+
 extern TempGUC **guc_cleanup_actions;
 extern int n_cleanup_actions;
 
@@ -153,13 +181,54 @@ typedef struct PGLabPathInfo
     Cost original_cost;
 } PGLabPathInfo;
 
+/*
+ * Bookkeeping for the (partial) pathlist of a single RelOptInfo. See update_pathlist_penalty() for details.
+ */
+typedef struct PGLabPathlistState
+{
+    Cost max_valid_cost;  /* the highest cost of any valid path that we have seen so far */
+    Cost penalty;         /* the cost that is added to the original cost of each invalid path */
+    int  n_invalid;       /* the number of invalid paths we added. Postgres might have pruned some of them by now. */
+} PGLabPathlistState;
+
+typedef struct PGLabRelInfo
+{
+    PGLabPathlistState pathlist;
+    PGLabPathlistState partial_pathlist;
+
+    bool constraint_checked;  /* whether is_constrained has already been computed */
+    bool is_constrained;      /* whether any hint can invalidate paths of this relation, see rel_is_constrained() */
+} PGLabRelInfo;
+
+static const struct config_enum_entry hint_parser_options[] = {
+    {"antlr", HINT_PARSER_ANTLR, false},
+    {"native", HINT_PARSER_NATIVE, false},
+    {NULL, 0, false}
+};
+
+static const struct config_enum_entry join_enumerator_options[] = {
+    {"standard", JOIN_ENUMERATOR_STANDARD, false},
+    {"dpccp", JOIN_ENUMERATOR_DPCCP, false},
+    {NULL, 0, false}
+};
+
 static bool enable_pglab = true;
 static bool pglab_check_final_path = true;
 static bool trace_pruning = false;
+static bool pglab_direct_join_build = true;
 
 /* Stores the raw query that is currently being optimized in this backend. */
 char *current_query_string = NULL;
 
+/* The SQL text of the current query. Unlike current_query_string, this is never replaced by a pinned hint block. */
+static const char *current_sql_string = NULL;
+
+/*
+ * Number of planner runs that are currently active in this backend. Nested runs are caused by SPI queries during planning,
+ * e.g. when the pinned hint blocks are loaded or when a function is evaluated for the estimates.
+ */
+static int planner_nesting_level = 0;
+
 /*
 * We explicitly store the PlannerInfo as a static variable because some low-level routines in the planner do not
 * receive it as an argument. But, some of our hint-aware variants of these routines need it.
@@ -169,6 +238,9 @@ static PlannerInfo  *current_planner_root = NULL;
 /* The hints that are available for the current query. */
 static PlannerHints *current_hints = NULL;
 
+/* Whether the final path of the current query violates the hints (only if pglab.check_final_path is disabled). */
+static bool final_path_fallback = false;
+
 #define IS_HINTED() (current_hints != NULL && current_hints->contains_hint)
 
 #define PathRelids(pathptr) (IS_UPPER_REL(pathptr->parent) \
@@ -910,10 +982,21 @@ path_satisfies_joinorder(Path *path, JoinOrder *join_order, OperatorHint **op_hi
     jpath = (JoinPath *) path;
 
     /* we cannot be in an upper rel, yet. Therefore it is safe to access relids directly. */
-    correct_outer = bms_equal(jpath->outerjoinpath->parent->relids,
-                              current_node->outer_child->relids);
-    correct_inner = bms_equal(jpath->innerjoinpath->parent->relids,
-                              current_node->inner_child->relids);
+    if (current_node->flat)
+    {
+        FlatJoinOrderNode *flat_node = &current_node->flat->nodes[current_node->flat_index];
+        correct_outer = flat_join_order_relids_equal(current_node->flat, flat_node->outer_child,
+                                                     jpath->outerjoinpath->parent->relids);
+        correct_inner = flat_join_order_relids_equal(current_node->flat, flat_node->inner_child,
+                                                     jpath->innerjoinpath->parent->relids);
+    }
+    else
+    {
+        correct_outer = bms_equal(jpath->outerjoinpath->parent->relids,
+                                  current_node->outer_child->relids);
+        correct_inner = bms_equal(jpath->innerjoinpath->parent->relids,
+                                  current_node->inner_child->relids);
+    }
     return correct_outer && correct_inner;
 }
 
@@ -1661,10 +1744,292 @@ path_satisfies_joinprefixes(Path *path, List *prefixes)
 }
 
 
+/*
+ * The result of the hint checks that only depend on the "shape" of a path, see path_satisfies_hints().
+ */
+typedef enum PathVerdict
+{
+    PATH_VALID,
+    PATH_INVALID_JOIN_ORDER,
+    PATH_INVALID_OPERATORS,
+    PATH_INVALID_PARALLEL
+} PathVerdict;
+
+/*
+ * The shape of a path consists of all properties that the join order, operator and parallelization checks look at.
+ *
+ * These checks skip through all intermediate nodes (sorts, aggregations, materialization, etc.) until they reach the first
+ * scan or join. We call this node the anchor of the path. Paths that only differ in their pathkeys, parameterization or in the
+ * upper nodes that have been stacked on top of the same kind of anchor share the same shape and hence, the same verdict.
+ */
+typedef struct PathShapeKey
+{
+    Relids   relids;            /* relids of the anchor */
+    Relids   outer_relids;      /* relids of the anchor's outer child (joins only) */
+    Relids   inner_relids;      /* relids of the anchor's inner child (joins only) */
+    Relids   parallel_relids;   /* relids of the gathered portion, see find_parallel_subpath() */
+    NodeTag  pathtype;          /* operator of the anchor */
+    NodeTag  inner_pathtype;    /* T_Memoize or T_Material if the inner child is memoized/materialized, T_Invalid otherwise */
+    bool     upper_rel;         /* whether the path itself belongs to an upper rel */
+    bool     is_partial;
+    bool     parallel;          /* whether the (non-partial) path contains a Gather/GatherMerge */
+    bool     parallel_upper;    /* whether the gathered portion belongs to an upper rel */
+} PathShapeKey;
+
+typedef struct PathShapeEntry
+{
+    PathShapeKey key;
+    PathVerdict  verdict;
+} PathShapeEntry;
+
+static uint32
+path_shape_hash(const void *key, Size keysize)
+{
+    const PathShapeKey *shape = (const PathShapeKey *) key;
+    uint32 hash;
+
+    hash = bms_hash_value(shape->relids);
+    hash = hash_combine(hash, bms_hash_value(shape->outer_relids));
+    hash = hash_combine(hash, bms_hash_value(shape->inner_relids));
+    hash = hash_combine(hash, bms_hash_value(shape->parallel_relids));
+    hash = hash_combine(hash, hash_bytes_uint32((uint32) shape->pathtype));
+    hash = hash_combine(hash, hash_bytes_uint32((uint32) shape->inner_pathtype));
+    hash = hash_combine(hash, hash_bytes_uint32((shape->upper_rel << 3) | (shape->is_partial << 2)
+                                                | (shape->parallel << 1) | shape->parallel_upper));
+    return hash;
+}
+
+static int
+path_shape_match(const void *key1, const void *key2, Size keysize)
+{
+    const PathShapeKey *shape1 = (const PathShapeKey *) key1;
+    const PathShapeKey *shape2 = (const PathShapeKey *) key2;
+
+    if (shape1->pathtype != shape2->pathtype ||
+        shape1->inner_pathtype != shape2->inner_pathtype ||
+        shape1->upper_rel != shape2->upper_rel ||
+        shape1->is_partial != shape2->is_partial ||
+        shape1->parallel != shape2->parallel ||
+        shape1->parallel_upper != shape2->parallel_upper)
+        return 1;
+
+    if (!bms_equal(shape1->relids, shape2->relids) ||
+        !bms_equal(shape1->outer_relids, shape2->outer_relids) ||
+        !bms_equal(shape1->inner_relids, shape2->inner_relids) ||
+        !bms_equal(shape1->parallel_relids, shape2->parallel_relids))
+        return 1;
+
+    return 0;
+}
+
+/*
+ * Skips through all intermediate nodes of a path until the first scan or join is reached.
+ *
+ * Returns NULL if there is no unique scan/join, e.g. for set operations, appends or result nodes. Such paths are not
+ * memoized.
+ */
+static Path *
+fetch_anchor_path(Path *path)
+{
+    for (;;)
+    {
+        switch (path->pathtype)
+        {
+            case T_SeqScan:
+            case T_IndexScan:
+            case T_IndexOnlyScan:
+            case T_BitmapHeapScan:
+            case T_NestLoop:
+            case T_MergeJoin:
+            case T_HashJoin:
+                return path;
+            case T_Material:
+                path = ((MaterialPath *) path)->subpath;
+                break;
+            case T_Memoize:
+                path = ((MemoizePath *) path)->subpath;
+                break;
+            case T_Gather:
+                path = ((GatherPath *) path)->subpath;
+                break;
+            case T_GatherMerge:
+                path = ((GatherMergePath *) path)->subpath;
+                break;
+            case T_Unique:
+                path = ((UniquePath *) path)->subpath;
+                break;
+            case T_ProjectSet:
+                path = ((ProjectSetPath *) path)->subpath;
+                break;
+            case T_Sort:
+                path = ((SortPath *) path)->subpath;
+                break;
+            case T_IncrementalSort:
+                path = ((IncrementalSortPath *) path)->spath.subpath;
+                break;
+            case T_Group:
+                path = ((GroupPath *) path)->subpath;
+                break;
+            case T_Agg:
+                path = ((AggPath *) path)->subpath;
+                break;
+            case T_GroupingSet:
+                path = ((GroupingSetsPath *) path)->subpath;
+                break;
+            case T_WindowAgg:
+                path = ((WindowAggPath *) path)->subpath;
+                break;
+            case T_Limit:
+                path = ((LimitPath *) path)->subpath;
+                break;
+            case T_Result:
+                if (!IsA(path, ProjectionPath))
+                    return NULL;
+                path = ((ProjectionPath *) path)->subpath;
+                break;
+            default:
+                return NULL;
+        }
+    }
+}
+
+/*
+ * Determines the shape of a path. Returns false if the path cannot be memoized.
+ */
 static bool
-check_path_recursive(PlannerHints *hints, Path *path, bool is_partial)
+fetch_path_shape(PlannerHints *hints, Path *path, bool is_partial, PathShapeKey *shape)
+{
+    Path *anchor;
+
+    anchor = fetch_anchor_path(path);
+    if (!anchor)
+        return false;
+
+    memset(shape, 0, sizeof(PathShapeKey));
+    shape->relids = anchor->parent->relids;
+    shape->pathtype = anchor->pathtype;
+    shape->inner_pathtype = T_Invalid;
+    shape->upper_rel = IS_UPPER_REL(path->parent);
+    shape->is_partial = is_partial;
+
+    if (IsAJoinPath(anchor))
+    {
+        JoinPath *jpath = (JoinPath *) anchor;
+        Path *inner_child = jpath->innerjoinpath;
+
+        shape->outer_relids = jpath->outerjoinpath->parent->relids;
+        shape->inner_relids = inner_child->parent->relids;
+
+        if (PathIsA(inner_child, Memoize))
+            shape->inner_pathtype = T_Memoize;
+        else if (PathIsA(inner_child, Material) ||
+                 (PathIsA(anchor, MergeJoin) && ((MergePath *) anchor)->materialize_inner))
+            shape->inner_pathtype = T_Material;
+    }
+
+    /*
+     * The parallelization check for plain paths needs to know which part of the path has been gathered. Notice that the
+     * check for partial paths only depends on the path's relation.
+     */
+    if (!is_partial && hints->parallel_mode != PARMODE_DEFAULT)
+    {
+        Path *par_subpath = find_parallel_subpath(path);
+        if (par_subpath)
+        {
+            shape->parallel = true;
+            shape->parallel_upper = IS_UPPER_REL(par_subpath->parent);
+            shape->parallel_relids = shape->parallel_upper ? NULL : par_subpath->parent->relids;
+        }
+    }
+
+    return true;
+}
+
+static PathVerdict
+compute_path_verdict(PlannerHints *hints, Path *path, bool is_partial)
 {
     OperatorHint *op_hint;
+
+    op_hint = NULL;
+    if (!path_satisfies_joinorder(path, hints->join_order_hint, &op_hint))
+        return PATH_INVALID_JOIN_ORDER;
+
+    if (!path_satisfies_operators(hints, path, op_hint))
+        return PATH_INVALID_OPERATORS;
+
+    if (is_partial && !partial_path_satisfies_parallelization(hints, path))
+        return PATH_INVALID_PARALLEL;
+    else if (!is_partial && !path_satisfies_parallelization(hints, path))
+        return PATH_INVALID_PARALLEL;
+
+    return PATH_VALID;
+}
+
+/*
+ * Checks, whether a path satisfies the join order, operator and parallelization hints.
+ *
+ * In contrast to the join prefix check, these checks do not look at the entire path, but only at its shape (see
+ * PathShapeKey). Since the optimizer usually creates many paths with the same shape (e.g. with different pathkeys or
+ * parameterizations), we memoize the verdict per shape for the entire planner run. This is especially helpful for upper
+ * rel paths, where each check would otherwise need to traverse all the intermediate nodes of the path again.
+ *
+ * The validity of the children is not part of the verdict and needs to be checked separately.
+ */
+static PathVerdict
+path_satisfies_hints(PlannerHints *hints, Path *path, bool is_partial)
+{
+    PathShapeKey shape;
+    PathShapeEntry *entry;
+    PathVerdict verdict;
+    MemoryContext oldcxt;
+    bool found;
+
+    if (!fetch_path_shape(hints, path, is_partial, &shape))
+        return compute_path_verdict(hints, path, is_partial);
+
+    if (!hints->path_verdicts)
+    {
+        HASHCTL hctl;
+
+        hctl.keysize = sizeof(PathShapeKey);
+        hctl.entrysize = sizeof(PathShapeEntry);
+        hctl.hash = path_shape_hash;
+        hctl.match = path_shape_match;
+        hctl.hcxt = GetMemoryChunkContext(hints);
+        hints->path_verdicts = hash_create("PathVerdicts", 256, &hctl,
+                                           HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+    }
+
+    entry = (PathShapeEntry *) hash_search(hints->path_verdicts, &shape, HASH_FIND, NULL);
+    if (entry)
+    {
+        PlannerStatsCount(memoized_verdicts);
+        return entry->verdict;
+    }
+
+    verdict = compute_path_verdict(hints, path, is_partial);
+
+    /*
+     * The relids of the shape belong to the RelOptInfos of the paths. These might be short-lived (e.g. when using GEQO), so
+     * we need our own copy.
+     */
+    oldcxt = MemoryContextSwitchTo(GetMemoryChunkContext(hints));
+    shape.relids = bms_copy(shape.relids);
+    shape.outer_relids = bms_copy(shape.outer_relids);
+    shape.inner_relids = bms_copy(shape.inner_relids);
+    shape.parallel_relids = bms_copy(shape.parallel_relids);
+    MemoryContextSwitchTo(oldcxt);
+
+    entry = (PathShapeEntry *) hash_search(hints->path_verdicts, &shape, HASH_ENTER, &found);
+    Assert(!found);
+    entry->verdict = verdict;
+
+    return verdict;
+}
+
+static bool
+check_path_recursive(PlannerHints *hints, Path *path, bool is_partial)
+{
     const char *path_type;
 
     /*
@@ -1688,36 +2053,20 @@ check_path_recursive(PlannerHints *hints, Path *path, bool is_partial)
         return false;
     }
 
-    op_hint = NULL;
-    if (!path_satisfies_joinorder(path, hints->join_order_hint, &op_hint))
-    {
-        pglab_trace("Check failed for %s path %s - does not satisfy join order", path_type, path_to_string(path));
-        return false;
-    }
-
-    if (!path_satisfies_operators(hints, path, op_hint))
-    {
-        pglab_trace("Check failed for %s path %s - does not satisfy operator hints", path_type, path_to_string(path));
-        return false;
-    }
-
-    if (is_partial)
+    switch (path_satisfies_hints(hints, path, is_partial))
     {
-        if (!partial_path_satisfies_parallelization(hints, path))
-        {
-            pglab_trace("Check failed for %s path %s - does not satisfy parallelization hints",
-                        path_type, path_to_string(path));
+        case PATH_VALID:
+            break;
+        case PATH_INVALID_JOIN_ORDER:
+            pglab_trace("Check failed for %s path %s - does not satisfy join order", path_type, path_to_string(path));
             return false;
-        }
-    }
-    else
-    {
-        if (!path_satisfies_parallelization(hints, path))
-        {
+        case PATH_INVALID_OPERATORS:
+            pglab_trace("Check failed for %s path %s - does not satisfy operator hints", path_type, path_to_string(path));
+            return false;
+        case PATH_INVALID_PARALLEL:
             pglab_trace("Check failed for %s path %s - does not satisfy parallelization hints",
                         path_type, path_to_string(path));
             return false;
-        }
     }
 
     switch (path->pathtype)
@@ -1910,6 +2259,22 @@ check_path_recursive(PlannerHints *hints, Path *path, bool is_partial)
 }
 
 
+/*
+ * Wrapper around check_path_recursive() that keeps track of the time spent in the check.
+ */
+static bool
+check_path_timed(PlannerHints *hints, Path *path, bool is_partial)
+{
+    instr_time check_start;
+    bool valid;
+
+    PlannerStatsTimerStart(check_start);
+    valid = check_path_recursive(hints, path, is_partial);
+    PlannerStatsTimerStop(check_time, check_start);
+
+    return valid;
+}
+
 /*
  * Our custom planner hook is required because this is the last point during the Postgres planning phase where the raw query
  * string is available. Everywhere down the line, only the parsed Query* node is available. However, the Query* does not
@@ -1922,26 +2287,63 @@ PlannedStmt *
 hint_aware_planner(Query* parse, const char* query_string, int cursorOptions, ParamListInfo boundParams)
 {
     PlannedStmt *result;
+    PlannerStats *prev_stats;
 
-    current_hints        = NULL;
-    current_planner_root = NULL;
-    current_query_string = (char*) query_string;
+    /*
+     * The planner can be entered recursively (e.g. for SQL functions that are inlined or SPI queries), so we need to restore
+     * the statistics of the outer run - even if planning fails.
+     */
+    prev_stats = current_planner_stats;
+    planner_nesting_level++;
 
-    if (prev_planner_hook)
+    PG_TRY();
     {
-        current_planner_type = &PLANNER_TYPE_CUSTOM;
-        result = prev_planner_hook(parse, query_string, cursorOptions, boundParams);
+        char *pinned_hints = NULL;
+
+        /*
+         * Queries without a hint block of their own use the hint block that is pinned to them (if any). Loading the pinned
+         * hint blocks might plan queries of its own, so we need to do this before we set up our state.
+         */
+        if (enable_pglab && query_string && !strstr(query_string, "/*=pg_lab="))
+            pinned_hints = fetch_pinned_hints(parse->queryId);
+
+        current_hints        = NULL;
+        current_planner_root = NULL;
+        current_query_string = pinned_hints ? pinned_hints : (char*) query_string;
+        current_sql_string   = query_string;
+        final_path_fallback  = false;
+
+        current_planner_stats = planner_stats_begin(query_string, planner_nesting_level == 1);
+
+        if (prev_planner_hook)
+        {
+            current_planner_type = &PLANNER_TYPE_CUSTOM;
+            result = prev_planner_hook(parse, query_string, cursorOptions, boundParams);
+        }
+        else
+        {
+            current_planner_type = &PLANNER_TYPE_DEFAULT;
+            result = standard_planner(parse, query_string, cursorOptions, boundParams);
+        }
+
+        planner_stats_end(current_planner_stats);
+        if (IS_HINTED() && current_planner_stats)
+            hint_stats_record(current_hints->raw_hint,
+                              INSTR_TIME_GET_MILLISEC(current_planner_stats->planning_time),
+                              false, final_path_fallback);
     }
-    else
+    PG_FINALLY();
     {
-        current_planner_type = &PLANNER_TYPE_DEFAULT;
-        result = standard_planner(parse, query_string, cursorOptions, boundParams);
+        planner_nesting_level--;
+        current_planner_stats = prev_stats;
+
+        /* we let the context-based memory manager of PG take care of properly freeing our stuff */
+        current_hints        = NULL;
+        current_planner_root = NULL;
+        current_query_string = NULL;
+        current_sql_string   = NULL;
     }
-
-    /* we let the context-based memory manager of PG take care of properly freeing our stuff */
-    current_hints        = NULL;
-    current_planner_root = NULL;
-    current_query_string = NULL;
+    PG_END_TRY();
 
     return result;
 }
@@ -1968,12 +2370,77 @@ hint_aware_ExecutorEnd(QueryDesc *queryDesc)
 
     FreeGucCleanup();
 
+    /* The instrumentation is released by standard_ExecutorEnd(), so we need to collect the feedback first */
+    card_feedback_record(queryDesc);
+
     if (prev_executor_end_hook)
         prev_executor_end_hook(queryDesc);
     else
         standard_ExecutorEnd(queryDesc);
 }
 
+/*
+ * Applies the plan cache setting of the hint block to a freshly prepared statement.
+ *
+ * Postgres decides between a generic and a custom plan before the planner is invoked, so we cannot do this while the hints
+ * are bound. Instead, we adjust the cursor options of the cached plan source right after the statement has been prepared.
+ */
+static void
+apply_plan_cache_hint(const char *stmt_name, HintPlanCacheMode mode)
+{
+    PreparedStatement *prepared;
+    CachedPlanSource *plansource;
+
+    if (mode == PLANCACHE_DEFAULT)
+        return;
+
+    prepared = FetchPreparedStatement(stmt_name, false);
+    if (!prepared)
+        return;
+
+    plansource = prepared->plansource;
+    switch (mode)
+    {
+        case PLANCACHE_GENERIC:
+            plansource->cursor_options &= ~CURSOR_OPT_CUSTOM_PLAN;
+            plansource->cursor_options |= CURSOR_OPT_GENERIC_PLAN;
+            break;
+        case PLANCACHE_CUSTOM:
+            plansource->cursor_options &= ~CURSOR_OPT_GENERIC_PLAN;
+            plansource->cursor_options |= CURSOR_OPT_CUSTOM_PLAN;
+            break;
+        case PLANCACHE_DEFAULT:
+            break;
+    }
+}
+
+void
+hint_aware_ProcessUtility(PlannedStmt *pstmt, const char *queryString, bool readOnlyTree,
+                          ProcessUtilityContext context, ParamListInfo params, QueryEnvironment *queryEnv,
+                          DestReceiver *dest, QueryCompletion *qc)
+{
+    HintPlanCacheMode plan_cache_mode = PLANCACHE_DEFAULT;
+    bool prepare_stmt;
+
+    /*
+     * The hint block of a PREPARE is parsed before the statement is stored. Otherwise, a malformed hint block would raise
+     * its error after the prepared statement already exists and the failed PREPARE would leave it behind.
+     * The prepared statement keeps the entire query string as its source text, so this is the same hint block that we
+     * would find in the plan source later on.
+     */
+    prepare_stmt = enable_pglab && IsA(pstmt->utilityStmt, PrepareStmt);
+    if (prepare_stmt)
+        plan_cache_mode = fetch_plan_cache_hint(queryString);
+
+    if (prev_process_utility_hook)
+        prev_process_utility_hook(pstmt, queryString, readOnlyTree, context, params, queryEnv, dest, qc);
+    else
+        standard_ProcessUtility(pstmt, queryString, readOnlyTree, context, params, queryEnv, dest, qc);
+
+    if (prepare_stmt)
+        apply_plan_cache_hint(((PrepareStmt *) pstmt->utilityStmt)->name, plan_cache_mode);
+}
+
 /*
  * The make_one_rel_prep() hook is called before the actual planning starts. We use it to extract the hints from our raw
  * query string.
@@ -1983,6 +2450,7 @@ hint_aware_make_one_rel_prep(PlannerInfo *root, List *joinlist)
 {
     PlannerHints *hints;
     ListCell *lc;
+    instr_time parse_start;
 
     if (!enable_pglab)
     {
@@ -1991,9 +2459,30 @@ hint_aware_make_one_rel_prep(PlannerInfo *root, List *joinlist)
         return;
     }
 
+    PlannerStatsTimerStart(parse_start);
     hints = init_hints(current_query_string);
     parse_hint_block(root, hints);
+
+    /*
+     * Cardinalities from pg_lab_set_cardinalities() belong to the top-level query of the next statement, not to any of its
+     * subqueries or to internal queries that are planned on the way (e.g. to load the pinned hint blocks).
+     */
+    if (root->query_level == 1 && planner_nesting_level == 1)
+    {
+        BulkCardinalities *bulk_cards = consume_bulk_cardinalities();
+        if (bulk_cards)
+            bind_bulk_cardinalities(root, hints, bulk_cards);
+    }
+
     post_process_hint_block(hints);
+    PlannerStatsTimerStop(parse_time, parse_start);
+
+    /* The estimator needs the actual SQL, not the hint block that might have been pinned to the query */
+    hints->estimator = model_estimator_begin(root, current_sql_string);
+    hints->card_feedback = card_feedback_applicable(root);
+
+    if (current_planner_stats)
+        current_planner_stats->contains_hint |= hints->contains_hint;
 
     foreach (lc, hints->temp_gucs)
     {
@@ -2011,26 +2500,134 @@ hint_aware_make_one_rel_prep(PlannerInfo *root, List *joinlist)
 Path *
 hint_aware_final_path_callback(PlannerInfo *root, RelOptInfo *rel, Path *best_path)
 {
-    if (current_hints && current_hints->contains_hint)
+    /* Without pglab.check_final_path, the check is only needed to count the fallbacks in the hint statistics */
+    if (current_hints && current_hints->contains_hint &&
+        (pglab_check_final_path || hint_stats_enabled()) &&
+        !check_path_timed(current_hints, best_path, false))
     {
-        if (pglab_check_final_path &&
-            !check_path_recursive(current_hints, best_path, false))
+        if (pglab_check_final_path)
+        {
+            hint_stats_record(current_hints->raw_hint, planner_stats_elapsed(current_planner_stats), true, false);
             ereport(ERROR,
                     errmsg("pg_lab could not find a valid path that satisfies all hints."),
                     errdetail("Final path was %s", path_to_string(best_path)),
                     errhint("If you are certain that the hinted query should be valid, please open an issue at https://github.com/Optimizer-Playground/pg_lab/issues."));
+        }
+
+        /* The user explicitly asked us to continue with the invalid path */
+        final_path_fallback = true;
     }
 
     if (prev_final_path_callback)
         best_path = (*prev_final_path_callback)(root, rel, best_path);
 
+    if (plan_capture_requested())
+        capture_plan_hints(root, best_path);
+
     return best_path;
 }
 
+static PGLabRelInfo *
+fetch_rel_info(RelOptInfo *rel)
+{
+    PGLabRelInfo *rel_info;
+
+    rel_info = (PGLabRelInfo *) rel->pglab_private;
+    if (rel_info == NULL)
+    {
+        rel_info = (PGLabRelInfo *) palloc0(sizeof(PGLabRelInfo));
+        rel->pglab_private = rel_info;
+    }
+
+    return rel_info;
+}
+
+/*
+ * Checks, whether the hints could invalidate some (but not all) paths of the given relation.
+ *
+ * This is the case for
+ * - all relations that overlap with a join prefix,
+ * - all nodes of the join order hint, as well as all relations that contain the entire join order, and
+ * - all relations that contain a relation with an operator hint or the parallel relations (since their paths might be
+ *   built on top of invalid child paths)
+ *
+ * Relations that are not constrained are either not affected by the hints at all, or they can only contain invalid
+ * paths (e.g. joins that are not part of the join order hint).
+ */
+static bool
+compute_rel_constraint(PlannerHints *hints, RelOptInfo *rel)
+{
+    ListCell *lc;
+
+    if (IS_UPPER_REL(rel))
+        return true;
+
+    foreach (lc, hints->join_prefixes)
+    {
+        JoinOrder *prefix = (JoinOrder *) lfirst(lc);
+        if (bms_overlap(prefix->relids, rel->relids))
+            return true;
+    }
+
+    if (hints->join_order_hint)
+    {
+        if (bms_is_subset(hints->join_order_hint->relids, rel->relids))
+            return true;
+        if (traverse_join_order(hints->join_order_hint, rel->relids) != NULL)
+            return true;
+    }
+
+    if (hints->parallel_rels && bms_is_subset(hints->parallel_rels, rel->relids))
+        return true;
+
+    if (hints->operator_hints)
+    {
+        HASH_SEQ_STATUS hstat;
+        OperatorHint *op_hint;
+
+        hash_seq_init(&hstat, hints->operator_hints);
+        while ((op_hint = (OperatorHint *) hash_seq_search(&hstat)) != NULL)
+        {
+            if (bms_is_subset(op_hint->relids, rel->relids))
+            {
+                hash_seq_term(&hstat);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Determines whether the add_path_precheck() can reject paths of the given relation without endangering our hints.
+ * The result is computed once per relation and stored in its pglab_private data.
+ */
+static bool
+rel_is_constrained(PlannerHints *hints, RelOptInfo *rel)
+{
+    PGLabRelInfo *rel_info;
+
+    if (!hints->contains_hint)
+        return false;
+
+    rel_info = fetch_rel_info(rel);
+    if (!rel_info->constraint_checked)
+    {
+        rel_info->is_constrained = compute_rel_constraint(hints, rel);
+        rel_info->constraint_checked = true;
+    }
+
+    return rel_info->is_constrained;
+}
+
 /*
  * We need a custom hook for the add_path_precheck(), because the original function is used to skip access paths if they are
  * definitely not useful (at least according to the native cost model). We need to overwrite this behavior to enforce our
  * current hints.
+ *
+ * We only bypass the precheck for relations that are actually constrained by a hint. All other relations can safely use
+ * the standard precheck.
  */
 bool
 hint_aware_add_path_precheck(RelOptInfo *parent_rel,
@@ -2040,8 +2637,7 @@ hint_aware_add_path_precheck(RelOptInfo *parent_rel,
                              Cost startup_cost, Cost total_cost,
                              List *pathkeys, Relids required_outer)
 {
-    if (current_hints && (current_hints->join_order_hint || current_hints->join_prefixes || current_hints->operator_hints))
-        /* XXX: we could be smarter and try to check, whether there actually is a hint concerning the current path */
+    if (current_hints && rel_is_constrained(current_hints, parent_rel))
         return true;
 
     if (prev_add_path_precheck_hook)
@@ -2064,6 +2660,8 @@ hint_aware_add_path_precheck(RelOptInfo *parent_rel,
  * We need a custom hook for the add_partial_path_precheck(), because the original function is used to skip access paths if
  * they are definitely not useful (at least according to the native cost model). We need to overwrite this behavior to enforce
  * our current hints.
+ *
+ * Just like for the add_path_precheck(), we only bypass the precheck for constrained relations.
  */
 bool
 hint_aware_add_partial_path_precheck(RelOptInfo *parent_rel,
@@ -2072,8 +2670,7 @@ hint_aware_add_partial_path_precheck(RelOptInfo *parent_rel,
                                      #endif
                                      Cost total_cost, List *pathkeys)
 {
-    if (current_hints && (current_hints->join_order_hint || current_hints->join_prefixes || current_hints->operator_hints))
-        /* XXX: we could be smarter and try to check, whether there actually is a hint concerning the current path */
+    if (current_hints && rel_is_constrained(current_hints, parent_rel))
         return true;
 
     if (prev_add_partial_path_precheck_hook)
@@ -2130,7 +2727,7 @@ make_path_info(PlannerHints *hints, Path *path, bool is_partial)
         return path_info;
     }
 
-    valid = check_path_recursive(hints, path, is_partial);
+    valid = check_path_timed(hints, path, is_partial);
 
     path_info = (PGLabPathInfo *) palloc0(sizeof(PGLabPathInfo));
     path_info->valid = valid;
@@ -2140,119 +2737,339 @@ make_path_info(PlannerHints *hints, Path *path, bool is_partial)
     return path_info;
 }
 
-
-void
-hint_aware_add_path(RelOptInfo *parent_rel, Path *path)
+/*
+ * Applies the penalty of the pathlist to all invalid paths that are currently contained in the pathlist.
+ *
+ * We never keep our own references to the invalid paths, because Postgres might prune (and free) them without telling us.
+ * Instead, the pathlist itself is the single source of truth for which paths are still alive.
+ */
+static void
+apply_pathlist_penalty(PGLabPathlistState *state, List *pathlist, bool is_partial)
+{
+    ListCell *lc;
+
+    state->n_invalid = 0;
+    foreach (lc, pathlist)
+    {
+        Path *candidate;
+        PGLabPathInfo *candidate_info;
+
+        candidate = (Path *) lfirst(lc);
+        candidate_info = (PGLabPathInfo *) candidate->pglab_private;
+        if (candidate_info == NULL)
+        {
+            /*
+             * This can only happen if we encouter an upprel path that Postgres stuffed another
+             * Path on top without going through add_path().
+             */
+            candidate_info = make_path_info(current_hints, candidate, is_partial);
+        }
+        Assert(candidate_info != NULL);
+
+        if (candidate_info->valid)
+            continue;
+
+        candidate->total_cost = candidate_info->original_cost + state->penalty;
+        state->n_invalid++;
+    }
+}
+
+/*
+ * Determines the penalty of the pathlist based on the paths that are currently contained in it.
+ */
+static void
+rebuild_pathlist_state(PGLabPathlistState *state, List *pathlist, bool is_partial)
+{
+    ListCell *lc;
+
+    state->max_valid_cost = 0;
+    foreach (lc, pathlist)
+    {
+        Path *candidate;
+        PGLabPathInfo *candidate_info;
+
+        candidate = (Path *) lfirst(lc);
+        candidate_info = (PGLabPathInfo *) candidate->pglab_private;
+        if (candidate_info == NULL)
+            candidate_info = make_path_info(current_hints, candidate, is_partial);
+
+        if (candidate_info->valid)
+            state->max_valid_cost = Max(candidate->total_cost, state->max_valid_cost);
+    }
+
+    state->penalty = 2 * state->max_valid_cost;
+    apply_pathlist_penalty(state, pathlist, is_partial);
+}
+
+/*
+ * Postgres only modifies pathlists behind our back once the scan/join planning is done. This happens for the upper rels,
+ * as well as for the final scan/join rel (and its children in case of partitionwise planning) when the final target list
+ * is applied. For these relations we cannot trust our bookkeeping and rather inspect the entire pathlist.
+ */
+#define RequiresPathlistRescan(rel) (IS_UPPER_REL(rel) || IS_OTHER_REL(rel) || \
+                                     bms_is_subset(current_planner_root->all_baserels, (rel)->relids))
+
+/*
+ * Ensures that all invalid paths of a relation are more expensive than all valid paths after the new path has been
+ * inserted.
+ *
+ * Each invalid path has a penalty added to its original cost. The penalty is always larger than the cost of any valid
+ * path of the relation. Since we add this penalty to all invalid paths of the relation, their relative order is not
+ * affected.
+ *
+ * We keep track of the highest cost of all valid paths and the current penalty in the pglab_private field of the
+ * RelOptInfo. This makes adding an invalid path a constant-time operation: we just need to apply the current penalty.
+ * Only if a new valid path exceeds the current penalty, we need to re-apply an increased penalty to all invalid paths that
+ * are still in the pathlist. Since we always double the penalty in this case, this happens rarely enough to make adding
+ * paths O(1) amortized.
+ */
+static void
+update_pathlist_penalty(RelOptInfo *parent_rel, Path *path, bool is_partial)
+{
+    PGLabRelInfo *rel_info;
+    PGLabPathlistState *state;
+    PGLabPathInfo *path_info;
+    List *pathlist;
+
+    rel_info = fetch_rel_info(parent_rel);
+
+    state = is_partial ? &rel_info->partial_pathlist : &rel_info->pathlist;
+    pathlist = is_partial ? parent_rel->partial_pathlist : parent_rel->pathlist;
+    path_info = (PGLabPathInfo *) path->pglab_private;
+
+    if (RequiresPathlistRescan(parent_rel))
+        rebuild_pathlist_state(state, pathlist, is_partial);
+
+    if (!path_info->valid)
+    {
+        path->total_cost = path_info->original_cost + state->penalty;
+        state->n_invalid++;
+        return;
+    }
+
+    state->max_valid_cost = Max(path->total_cost, state->max_valid_cost);
+    if (path->total_cost < state->penalty)
+        return;
+
+    state->penalty = 2 * path->total_cost;
+    if (state->n_invalid > 0)
+        apply_pathlist_penalty(state, pathlist, is_partial);
+}
+
+
+/*
+ * Checks whether the cost hints could contain an entry for the given intermediate, without touching the hash table.
+ */
+static inline bool
+may_have_cost_hint(Relids relids, int n_members)
+{
+    return bms_is_member(n_members, current_hints->cost_hint_sizes) &&
+           bms_is_subset(relids, current_hints->cost_hint_rels);
+}
+
+/*
+ * Determines the costs of an intermediate. Explicit cost hints take precedence over the external estimator.
+ */
+static CostHint *
+fetch_cost_hint(Relids relids)
+{
+    CostHint *hint_entry;
+    ModelEstimate *estimate;
+
+    if (current_hints->cost_hints && may_have_cost_hint(relids, bms_num_members(relids)))
+    {
+        hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &relids, HASH_FIND, NULL);
+        if (hint_entry)
+            return hint_entry;
+    }
+
+    if (!current_hints->estimator)
+        return NULL;
+
+    estimate = model_estimator_fetch(current_hints->estimator, relids);
+    return estimate && estimate->has_costs ? &(estimate->costs) : NULL;
+}
+
+/*
+ * Determines the costs of a join between two intermediates.
+ *
+ * The initial join costs are computed for each pair of input paths, i.e. extremely often for large queries. Therefore, we
+ * only build the relids of the join if some cost hint might apply to it (or if the external estimator needs them).
+ */
+static CostHint *
+fetch_join_cost_hint(Relids outer_relids, Relids inner_relids)
+{
+    CostHint *hint_entry;
+    Relids join_relids;
+
+    if (!current_hints->estimator)
+    {
+        int n_members = bms_num_members(outer_relids) + bms_num_members(inner_relids);
+        if (!may_have_cost_hint(outer_relids, n_members) ||
+            !bms_is_subset(inner_relids, current_hints->cost_hint_rels))
+            return NULL;
+    }
+
+    join_relids = bms_union(outer_relids, inner_relids);
+    hint_entry = fetch_cost_hint(join_relids);
+    bms_free(join_relids);
+
+    return hint_entry;
+}
+
+/*
+ * Determines the cardinality of an intermediate if it is provided by the external estimator. Returns NAN otherwise.
+ */
+static double
+fetch_estimator_rows(Relids relids)
+{
+    ModelEstimate *estimate;
+
+    if (!current_hints->estimator)
+        return NAN;
+
+    estimate = model_estimator_fetch(current_hints->estimator, relids);
+    return estimate && !isnan(estimate->rows) ? clamp_row_est(estimate->rows) : NAN;
+}
+
+
+/*
+ * Applies the cost hints for Sort, IncrementalSort, Material and Append paths.
+ *
+ * Postgres also calls the corresponding cost functions with uninitialized dummy paths (e.g. to estimate the explicit
+ * sorts of a merge join). Therefore, we cannot use the cost hooks for these operators since they cannot tell which
+ * relation the costs belong to. Instead, we overwrite the costs of the actual paths as soon as they are used, i.e. once
+ * they are added to their relation or once they become the input of a Gather (Merge) or a nested loop join. Hence, this
+ * function must be idempotent.
+ *
+ * Paths that have already been added to a relation (i.e. that have their pglab_private data set) are skipped: their hinted
+ * costs were applied before they were added and their total cost might contain the penalty of invalid paths by now.
+ * Overwriting it would drop the penalty and break the sort order of the pathlist.
+ */
+static void
+apply_path_cost_hint(Path *path)
+{
+    CostHint *hint_entry;
+    Relids relids;
+    Cost startup_cost, total_cost;
+
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
+        return;
+
+    if (!IsA(path, SortPath) && !IsA(path, IncrementalSortPath) && !IsA(path, MaterialPath) && !IsA(path, AppendPath))
+        return;
+
+    if (path->pglab_private != NULL)
+        return;
+
+    relids = PathRelids(path);
+    hint_entry = fetch_cost_hint(relids);
+    if (!hint_entry)
+        return;
+
+    switch (nodeTag(path))
+    {
+        case T_SortPath:
+            startup_cost = hint_entry->intermediate_costs.sort_startup;
+            total_cost = hint_entry->intermediate_costs.sort_total;
+            break;
+        case T_IncrementalSortPath:
+            startup_cost = hint_entry->intermediate_costs.incsort_startup;
+            total_cost = hint_entry->intermediate_costs.incsort_total;
+            break;
+        case T_MaterialPath:
+            startup_cost = hint_entry->intermediate_costs.material_startup;
+            total_cost = hint_entry->intermediate_costs.material_total;
+            break;
+        default:
+            startup_cost = hint_entry->intermediate_costs.append_startup;
+            total_cost = hint_entry->intermediate_costs.append_total;
+            break;
+    }
+
+    if (!isnan(startup_cost))
+        path->startup_cost = startup_cost;
+    if (!isnan(total_cost))
+        path->total_cost = total_cost;
+}
+
+void
+hint_aware_add_path(RelOptInfo *parent_rel, Path *path)
 {
-    OperatorHint *op_hint;
     bool satisfies_hints;
+    PathVerdict verdict;
     PGLabPathInfo *path_info;
-    List *invalid_paths;
-    ListCell *lc;
-    Cost max_valid_cost;
 
     CHECK_FOR_INTERRUPTS();
+    PlannerStatsCount(add_path_calls);
     if (!current_hints || !current_hints->contains_hint)
     {
         PG_ADD_PATH(parent_rel, path);
         return;
     }
 
+    apply_path_cost_hint(path);
+
     satisfies_hints = path_has_valid_children(path);
     if (!satisfies_hints)
     {
         pglab_trace("Rejecting path %s - has invalid children", path_to_string(path));
+        PlannerStatsCount(rejected_children);
     }
 
     if (satisfies_hints && !path_satisfies_joinprefixes(path, current_hints->join_prefixes))
     {
         pglab_trace("Rejecting path %s - does not satisfy join prefixes", path_to_string(path));
+        PlannerStatsCount(rejected_prefix);
         satisfies_hints = false;
     }
 
-    op_hint = NULL;
-    if (satisfies_hints && !path_satisfies_joinorder(path, current_hints->join_order_hint, &op_hint))
-    {
-        pglab_trace("Rejecting path %s - does not satisfy join order", path_to_string(path));
-        satisfies_hints = false;
-    }
-
-    if (satisfies_hints && !path_satisfies_operators(current_hints, path, op_hint))
-    {
-        pglab_trace("Rejecting path %s - does not satisfy operator hints", path_to_string(path));
-        satisfies_hints = false;
-    }
-
-    if (satisfies_hints && !path_satisfies_parallelization(current_hints, path))
+    verdict = satisfies_hints ? path_satisfies_hints(current_hints, path, false) : PATH_VALID;
+    switch (verdict)
     {
-        pglab_trace("Rejecting path %s - does not satisfy parallelization hints", path_to_string(path));
-        satisfies_hints = false;
+        case PATH_VALID:
+            break;
+        case PATH_INVALID_JOIN_ORDER:
+            pglab_trace("Rejecting path %s - does not satisfy join order", path_to_string(path));
+            PlannerStatsCount(rejected_join_order);
+            satisfies_hints = false;
+            break;
+        case PATH_INVALID_OPERATORS:
+            pglab_trace("Rejecting path %s - does not satisfy operator hints", path_to_string(path));
+            PlannerStatsCount(rejected_operators);
+            satisfies_hints = false;
+            break;
+        case PATH_INVALID_PARALLEL:
+            pglab_trace("Rejecting path %s - does not satisfy parallelization hints", path_to_string(path));
+            PlannerStatsCount(rejected_parallel);
+            satisfies_hints = false;
+            break;
     }
 
     /*
      * Once we have determined whether our new path is valid or invalid, we need to adjust the costs of the existing paths
      * This ensures that valid paths are always cheaper than invalid ones and hence, that the planner will always pick a
      * valid path if there is one.
-     * We achieve this by using the maximum cost of any valid path as a baseline. Each invalid path gets this cost added
-     * to its original cost.
-     * 
+     * We achieve this by adding a penalty to the original cost of each invalid path. The penalty is always larger than the
+     * cost of any valid path.
+     *
      * An apparently simpler solution would be to just evict the invalid paths.
      * See description of commit da1e9916cf9284abe2f5fee540727596d3400934 for why this is not possible.
-     * 
-     * What is even worse, we also cannot really cache the valid/invalid paths.
-     * Instead, we need to re-compute the respective list each time. This is because the Postgres optimizer might itself
-     * prune inferior paths and there isn't really a good way for us to keep track of this. Therefore, our list might
-     * contain dangling pointers. To stay safe, we always re-compute the list of valid/invalid paths.
+     *
+     * See update_pathlist_penalty() for how we keep track of the penalty.
      */
 
-    path_info = (PGLabPathInfo *) palloc0(sizeof(PGLabPathInfo));
-    path_info->valid = satisfies_hints;
-    path_info->original_cost = path->total_cost;
-    path->pglab_private = path_info;
-
     if (satisfies_hints)
     {
-        invalid_paths = NIL;
-        max_valid_cost = path->total_cost;
-    }
-    else
-    {
-        invalid_paths = list_make1(path);
-        max_valid_cost = 0;
-    }
-
-    foreach (lc, parent_rel->pathlist)
-    {
-        Path *candidate;
-        PGLabPathInfo *candidate_info;
-
-        candidate = (Path *) lfirst(lc);
-        candidate_info = (PGLabPathInfo *) candidate->pglab_private;
-        if (candidate_info == NULL)
-        {
-            /*
-             * This can only happen if we encouter an upprel path that Postgres stuffed another
-             * Path on top without going through add_path().
-             */
-            candidate_info = make_path_info(current_hints, candidate, false);
-        }
-        Assert(candidate_info != NULL);
-
-        if (candidate_info->valid)
-            max_valid_cost = Max(candidate->total_cost, max_valid_cost);
-        else
-            invalid_paths = lappend(invalid_paths, candidate);
+        PlannerStatsCount(accepted_paths);
     }
 
-    foreach (lc, invalid_paths)
-    {
-        Path *invalid;
-        PGLabPathInfo *invalid_info;
+    path_info = (PGLabPathInfo *) palloc0(sizeof(PGLabPathInfo));
+    path_info->valid = satisfies_hints;
+    path_info->original_cost = path->total_cost;
+    path->pglab_private = path_info;
 
-        invalid = (Path *) lfirst(lc);
-        invalid_info = (PGLabPathInfo *) invalid->pglab_private;
-        invalid->total_cost = invalid_info->original_cost + 1.01 * max_valid_cost;
-    }
+    update_pathlist_penalty(parent_rel, path, false);
 
     PG_ADD_PATH(parent_rel, path);
 }
@@ -2260,104 +3077,72 @@ hint_aware_add_path(RelOptInfo *parent_rel, Path *path)
 void
 hint_aware_add_partial_path(RelOptInfo *parent_rel, Path *path)
 {
-    OperatorHint *op_hint;
     bool satisfies_hints;
+    PathVerdict verdict;
     PGLabPathInfo *path_info;
-    List *invalid_paths;
-    ListCell *lc;
-    Cost max_valid_cost;
 
     CHECK_FOR_INTERRUPTS();
+    PlannerStatsCount(add_partial_path_calls);
     if (!current_hints || !current_hints->contains_hint)
     {
         PG_ADD_PARTIAL_PATH(parent_rel, path);
         return;
     }
 
+    apply_path_cost_hint(path);
+
     satisfies_hints = path_has_valid_children(path);
     if (!satisfies_hints)
     {
         pglab_trace("Rejecting partial path %s - has invalid children", path_to_string(path));
+        PlannerStatsCount(rejected_children);
     }
 
 
-    if (!path_satisfies_joinprefixes(path, current_hints->join_prefixes))
+    if (satisfies_hints && !path_satisfies_joinprefixes(path, current_hints->join_prefixes))
     {
         pglab_trace("Rejecting partial path %s - does not satisfy join prefixes", path_to_string(path));
+        PlannerStatsCount(rejected_prefix);
         satisfies_hints = false;
     }
 
-    op_hint = NULL;
-    if (satisfies_hints && !path_satisfies_joinorder(path, current_hints->join_order_hint, &op_hint))
-    {
-        pglab_trace("Rejecting partial path %s - does not satisfy join order", path_to_string(path));
-        satisfies_hints = false;
-    }
-
-    if (satisfies_hints && !path_satisfies_operators(current_hints, path, op_hint))
-    {
-        pglab_trace("Rejecting partial path %s - does not satisfy operator hints", path_to_string(path));
-        satisfies_hints = false;
-    }
-
-    if (satisfies_hints && !partial_path_satisfies_parallelization(current_hints, path))
+    verdict = satisfies_hints ? path_satisfies_hints(current_hints, path, true) : PATH_VALID;
+    switch (verdict)
     {
-        pglab_trace("Rejecting partial path %s - does not satisfy parallelization hints", path_to_string(path));
-        satisfies_hints = false;
+        case PATH_VALID:
+            break;
+        case PATH_INVALID_JOIN_ORDER:
+            pglab_trace("Rejecting partial path %s - does not satisfy join order", path_to_string(path));
+            PlannerStatsCount(rejected_join_order);
+            satisfies_hints = false;
+            break;
+        case PATH_INVALID_OPERATORS:
+            pglab_trace("Rejecting partial path %s - does not satisfy operator hints", path_to_string(path));
+            PlannerStatsCount(rejected_operators);
+            satisfies_hints = false;
+            break;
+        case PATH_INVALID_PARALLEL:
+            pglab_trace("Rejecting partial path %s - does not satisfy parallelization hints", path_to_string(path));
+            PlannerStatsCount(rejected_parallel);
+            satisfies_hints = false;
+            break;
     }
 
     /*
      * See the comment in hint_aware_add_path() for what is going on next and why.
      */
 
-    path_info = (PGLabPathInfo *) palloc0(sizeof(PGLabPathInfo));
-    path_info->valid = satisfies_hints;
-    path_info->original_cost = path->total_cost;
-    path->pglab_private = path_info;
-
     if (satisfies_hints)
     {
-        invalid_paths = NIL;
-        max_valid_cost = path->total_cost;
-    }
-    else
-    {
-        invalid_paths = list_make1(path);
-        max_valid_cost = 0;
+        PlannerStatsCount(accepted_paths);
     }
 
-    foreach (lc, parent_rel->partial_pathlist)
-    {
-        Path *candidate;
-        PGLabPathInfo *candidate_info;
-
-        candidate = (Path *) lfirst(lc);
-        candidate_info = (PGLabPathInfo *) candidate->pglab_private;
-        if (candidate_info == NULL)
-        {
-            /*
-             * This can only happen if we encouter an upprel path that Postgres stuffed another
-             * Path on top without going through add_path().
-             */
-            candidate_info = make_path_info(current_hints, candidate, true);
-        }
-        Assert(candidate_info != NULL);
-
-        if (candidate_info->valid)
-            max_valid_cost = Max(candidate->total_cost, max_valid_cost);
-        else
-            invalid_paths = lappend(invalid_paths, candidate);
-    }
-
-    foreach (lc, invalid_paths)
-    {
-        Path *invalid;
-        PGLabPathInfo *invalid_info;
+    path_info = (PGLabPathInfo *) palloc0(sizeof(PGLabPathInfo));
+    path_info->valid = satisfies_hints;
+    path_info->original_cost = path->total_cost;
+    path->pglab_private = path_info;
 
-        invalid = (Path *) lfirst(lc);
-        invalid_info = (PGLabPathInfo *) invalid->pglab_private;
-        invalid->total_cost = invalid_info->original_cost + 1.01 * max_valid_cost;
-    }
+    update_pathlist_penalty(parent_rel, path, true);
 
     PG_ADD_PARTIAL_PATH(parent_rel, path);
 }
@@ -2399,15 +3184,35 @@ hint_aware_baserel_size_estimates(PlannerInfo *root, RelOptInfo *rel)
 {
     bool hint_found = false;
     CardinalityHint *hint_entry;
+    double rows;
 
-    if (!current_hints || !current_hints->cardinality_hints)
+    if (!current_hints || (!current_hints->cardinality_hints && current_hints->cardinality_scales == NIL &&
+                           !current_hints->estimator && !current_hints->card_feedback))
         return set_baserel_size_fallback(root, rel);
 
-    hint_entry = (CardinalityHint*) hash_search(current_hints->cardinality_hints, &(rel->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
-        return set_baserel_size_fallback(root, rel);
+    if (current_hints->cardinality_hints)
+    {
+        hint_entry = (CardinalityHint*) hash_search(current_hints->cardinality_hints, &(rel->relids), HASH_FIND, &hint_found);
+        if (hint_found)
+            return hint_entry->card;
+    }
 
-    return hint_entry->card;
+    if (current_hints->card_feedback)
+    {
+        /* Actual cardinalities are used as-is, just like Card hints */
+        rows = card_feedback_lookup(root, rel);
+        if (!isnan(rows))
+            return rows;
+    }
+
+    rows = fetch_estimator_rows(rel->relids);
+    if (isnan(rows))
+        rows = set_baserel_size_fallback(root, rel);
+
+    if (current_hints->cardinality_scales == NIL)
+        return rows;
+
+    return clamp_row_est(rows * cardinality_scale_factor(current_hints, rel->relids, NULL, NULL));
 }
 
 
@@ -2425,16 +3230,49 @@ hint_aware_joinrel_size_estimates(PlannerInfo *root, RelOptInfo *rel, RelOptInfo
                                  RelOptInfo *inner_rel, SpecialJoinInfo *sjinfo, List *restrictlist)
 {
     bool hint_found = false;
+    bool estimate_from_inputs = false;
     CardinalityHint *hint_entry;
+    double rows, scale_factor;
 
-    if (!current_hints || !current_hints->cardinality_hints)
+    if (!current_hints || (!current_hints->cardinality_hints && current_hints->cardinality_scales == NIL &&
+                           !current_hints->estimator && !current_hints->card_feedback))
         return set_joinrel_size_fallback(root, rel, outer_rel, inner_rel, sjinfo, restrictlist);
 
-    hint_entry = (CardinalityHint*) hash_search(current_hints->cardinality_hints, &(rel->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
-        return set_joinrel_size_fallback(root, rel, outer_rel, inner_rel, sjinfo, restrictlist);
+    if (current_hints->cardinality_hints)
+    {
+        hint_entry = (CardinalityHint*) hash_search(current_hints->cardinality_hints, &(rel->relids), HASH_FIND, &hint_found);
+        if (hint_found)
+            return hint_entry->card;
+    }
+
+    if (current_hints->card_feedback)
+    {
+        /* Actual cardinalities are used as-is, just like Card hints */
+        rows = card_feedback_lookup(root, rel);
+        if (!isnan(rows))
+            return rows;
+    }
+
+    rows = fetch_estimator_rows(rel->relids);
+    if (isnan(rows))
+    {
+        rows = set_joinrel_size_fallback(root, rel, outer_rel, inner_rel, sjinfo, restrictlist);
+        estimate_from_inputs = true;
+    }
+
+    if (current_hints->cardinality_scales == NIL)
+        return rows;
+
+    /*
+     * The native estimate already contains the corrections of the input rels. The external estimate does not depend on the
+     * inputs at all, so all CardScale hints of the intermediate need to be applied.
+     */
+    if (estimate_from_inputs)
+        scale_factor = cardinality_scale_factor(current_hints, rel->relids, outer_rel->relids, inner_rel->relids);
+    else
+        scale_factor = cardinality_scale_factor(current_hints, rel->relids, NULL, NULL);
 
-    return hint_entry->card;
+    return clamp_row_est(rows * scale_factor);
 }
 
 static Index
@@ -2458,7 +3296,7 @@ forced_geqo(PlannerInfo *root, int levels_needed, List *initial_rels)
 {
     int nrels;
     RelOptInfo *result;
-    JoinOrder *current_node;
+    FlatJoinOrderNode *current_node;
     JoinOrderIterator *join_order_it;
     int gene_idx;
     Gene *forced_tour;
@@ -2474,12 +3312,13 @@ forced_geqo(PlannerInfo *root, int levels_needed, List *initial_rels)
     Assert(current_hints->join_order_hint);
     joinorder_it_init(join_order_it, current_hints->join_order_hint);
 
+    /* the iterator provides the base rels with the shallowest ones first, but we need to start with the deepest ones */
     gene_idx = 0;
-    for (int lc_idx = nrels - 1; lc_idx >= 0; --lc_idx)
+    for (int node_idx = nrels - 1; node_idx >= 0; --node_idx)
     {
-        current_node = (JoinOrder*) list_nth(join_order_it->current_nodes, lc_idx);
+        current_node = joinorder_it_node(join_order_it, node_idx);
         Assert(current_node->node_type == BASE_REL);
-        forced_tour[gene_idx++] = locate_reloptinfo(initial_rels, current_node->relids);
+        forced_tour[gene_idx++] = locate_reloptinfo(initial_rels, current_node->node->relids);
     }
 
     result = gimme_tree(root, forced_tour, nrels);
@@ -2500,8 +3339,21 @@ join_search_fallback(PlannerInfo *root, int levels_needed, List *initial_rels)
     {
         current_join_ordering_type = &JOIN_ORDER_TYPE_CUSTOM;
         result = prev_join_search_hook(root, levels_needed, initial_rels);
+        return result;
     }
-    else if (enable_geqo && levels_needed >= geqo_threshold)
+
+    if (pglab_join_enumerator == JOIN_ENUMERATOR_DPCCP)
+    {
+        /* DPccp only works on connected join graphs, otherwise we continue with the normal policies */
+        result = dpccp_join_search(root, levels_needed, initial_rels);
+        if (result)
+        {
+            current_join_ordering_type = &JOIN_ORDER_TYPE_DPCCP;
+            return result;
+        }
+    }
+
+    if (enable_geqo && levels_needed >= geqo_threshold)
     {
         current_join_ordering_type = &JOIN_ORDER_TYPE_GEQO;
         result = geqo(root, levels_needed, initial_rels);
@@ -2516,26 +3368,240 @@ join_search_fallback(PlannerInfo *root, int levels_needed, List *initial_rels)
 }
 
 /*
- * While we normally enforce the join order in the hint_aware_add_path function, there is one corner-case that is handled here:
- * If the user only supplied a join order and no operator hints, and if additionally the query would be optimized using GEQO,
- * we still want the operator selection to be handled by GEQO. Therefore, we use a special GEQO-style join "search" to generate
- * the final RelOptInfo. In all other cases, we simply fall back to the standard policies.
+ * Builds the join rel for a node of the join order hint, as well as all of the join rels below it.
+ *
+ * Returns NULL if the join order cannot be built from the initial rels, e.g. because it contains an illegal join.
+ */
+static RelOptInfo *
+build_hinted_join_rel(PlannerInfo *root, JoinOrder *join_order, List *initial_rels)
+{
+    ListCell *lc;
+    RelOptInfo *outer_rel, *inner_rel, *joinrel;
+
+    check_stack_depth();
+
+    /*
+     * The initial rels are usually base rels. But if the join problem has been split up into multiple sub-problems, the
+     * intermediates of those sub-problems are also part of the initial rels.
+     */
+    foreach (lc, initial_rels)
+    {
+        RelOptInfo *initial_rel = (RelOptInfo *) lfirst(lc);
+        if (bms_equal(initial_rel->relids, join_order->relids))
+            return initial_rel;
+    }
+
+    if (join_order->node_type == BASE_REL)
+        return NULL;
+
+    outer_rel = build_hinted_join_rel(root, join_order->outer_child, initial_rels);
+    if (!outer_rel)
+        return NULL;
+
+    inner_rel = build_hinted_join_rel(root, join_order->inner_child, initial_rels);
+    if (!inner_rel)
+        return NULL;
+
+    joinrel = make_join_rel(root, outer_rel, inner_rel);
+    if (!joinrel)
+        return NULL;
+
+    /* This is the same post-processing that standard_join_search() performs for each new join rel. */
+    generate_partitionwise_join_paths(root, joinrel);
+    if (!bms_equal(joinrel->relids, root->all_query_rels))
+        generate_useful_gather_paths(root, joinrel, false);
+    set_cheapest(joinrel);
+
+    return joinrel;
+}
+
+/*
+ * Removes all join rels that have been created after the join rel list had the given length.
+ *
+ * This is the same cleanup as in geqo_eval(). The join rel hash will be re-created from the join rel list when necessary.
+ */
+static void
+discard_join_rels(PlannerInfo *root, int savelength)
+{
+    root->join_rel_list = list_truncate(root->join_rel_list, savelength);
+    root->join_rel_hash = NULL;
+}
+
+/*
+ * Builds the join tree of the join order hint directly, without enumerating any other join pairs.
+ *
+ * standard_join_search() considers all (connected) pairs of relations at each level and only prunes the paths that do not
+ * satisfy the join order later on in add_path(). If the join order is fully specified, we already know which intermediates
+ * we need. Therefore, we just call make_join_rel() for each of them. This makes the join search linear in the number of
+ * joins.
+ *
+ * If the join order cannot be built (e.g. because the hint contains joins that would violate outer join semantics), all join
+ * rels that have been created so far are discarded and NULL is returned.
+ */
+static RelOptInfo *
+direct_join_build(PlannerInfo *root, List *initial_rels)
+{
+    ListCell *lc;
+    Relids relids;
+    JoinOrder *join_order;
+    RelOptInfo *result;
+    int savelength;
+
+    relids = NULL;
+    foreach (lc, initial_rels)
+    {
+        RelOptInfo *initial_rel = (RelOptInfo *) lfirst(lc);
+        relids = bms_add_members(relids, initial_rel->relids);
+    }
+
+    /*
+     * The join search might only be concerned with a part of the query, e.g. if join_collapse_limit is exceeded. We just
+     * need to build the corresponding portion of the hinted join order.
+     */
+    join_order = traverse_join_order(current_hints->join_order_hint, relids);
+    if (!join_order)
+    {
+        bms_free(relids);
+        return NULL;
+    }
+
+    savelength = list_length(root->join_rel_list);
+    result = build_hinted_join_rel(root, join_order, initial_rels);
+
+    if (!result)
+    {
+        pglab_trace("Direct join build failed, falling back to the normal join search");
+        discard_join_rels(root, savelength);
+    }
+
+    bms_free(relids);
+    return result;
+}
+
+/*
+ * Builds the join rel of the join prefix and uses it as an initial rel for the join search.
+ *
+ * The prefix is fixed by the hint, so there is no need to enumerate any other intermediates for the relations of the prefix.
+ * Instead, we build the prefix first and let the normal join search treat it like a single relation. This reduces the
+ * search space from 2^n to 2^(n-k+1) for a prefix of k relations.
+ *
+ * Returns the new initial rels or NIL if the prefix cannot be collapsed. This is the case if there are multiple prefixes
+ * (since the final plan only needs to satisfy one of them, see path_satisfies_joinprefixes()), if the prefix is not part of
+ * the current join problem, or if the prefix cannot be built.
+ */
+static List *
+collapse_join_prefix(PlannerInfo *root, List *initial_rels)
+{
+    ListCell *lc;
+    JoinOrder *prefix;
+    RelOptInfo *prefix_rel;
+    Relids relids;
+    List *collapsed_rels;
+    int savelength;
+
+    if (list_length(current_hints->join_prefixes) != 1)
+        return NIL;
+
+    prefix = (JoinOrder *) linitial(current_hints->join_prefixes);
+    if (prefix->node_type == BASE_REL)
+        return NIL;
+
+    /*
+     * We can only collapse the prefix if it consists entirely of initial rels. Otherwise, it either belongs to a different
+     * part of the join problem, or to a sub-problem that has already been planned.
+     */
+    relids = NULL;
+    foreach (lc, initial_rels)
+    {
+        RelOptInfo *initial_rel = (RelOptInfo *) lfirst(lc);
+        if (bms_overlap(initial_rel->relids, prefix->relids) && !bms_is_subset(initial_rel->relids, prefix->relids))
+        {
+            bms_free(relids);
+            return NIL;
+        }
+        relids = bms_add_members(relids, initial_rel->relids);
+    }
+
+    if (!bms_is_subset(prefix->relids, relids))
+    {
+        bms_free(relids);
+        return NIL;
+    }
+    bms_free(relids);
+
+    savelength = list_length(root->join_rel_list);
+    prefix_rel = build_hinted_join_rel(root, prefix, initial_rels);
+    if (!prefix_rel)
+    {
+        pglab_trace("Could not build join prefix, falling back to the normal join search");
+        discard_join_rels(root, savelength);
+        return NIL;
+    }
+
+    collapsed_rels = list_make1(prefix_rel);
+    foreach (lc, initial_rels)
+    {
+        RelOptInfo *initial_rel = (RelOptInfo *) lfirst(lc);
+        if (!bms_is_subset(initial_rel->relids, prefix_rel->relids))
+            collapsed_rels = lappend(collapsed_rels, initial_rel);
+    }
+
+    return collapsed_rels;
+}
+
+/*
+ * If the query has a join order hint, we build the hinted join tree directly (see direct_join_build()). The operators for
+ * each join are still selected by the normal path generation, we just skip all intermediates that are not part of the hint.
+ *
+ * If the direct build is disabled, we only build the join tree directly if the query would be optimized using GEQO. For
+ * linear join orders, this uses a special GEQO-style join "search" with a fixed tour. Bushy join orders cannot be expressed
+ * as a GEQO tour, so these are always built directly. Otherwise, we rely on the standard join search and prune all paths that
+ * do not match the join order in hint_aware_add_path().
+ *
+ * Join prefixes are built directly as well (see collapse_join_prefix()), the remaining relations are joined using the
+ * standard policies. Without any join order or join prefix hints, we simply fall back to the standard policies.
  */
 RelOptInfo *
 hint_aware_join_search(PlannerInfo *root, int levels_needed, List *initial_rels)
 {
     RelOptInfo *result;
-    bool can_geqo;
+    List *collapsed_rels;
+    bool can_geqo, linear_join_order;
 
     if (current_hints && current_hints->join_order_hint)
     {
         current_join_ordering_type = &JOIN_ORDER_TYPE_FORCED;
-        can_geqo = enable_geqo && levels_needed >= geqo_threshold && is_linear_join_order(current_hints->join_order_hint);
-        if (can_geqo)
+        can_geqo = enable_geqo && levels_needed >= geqo_threshold;
+        linear_join_order = is_linear_join_order(current_hints->join_order_hint);
+
+        if (pglab_direct_join_build || (can_geqo && !linear_join_order))
+        {
+            result = direct_join_build(root, initial_rels);
+            if (result)
+                return result;
+        }
+
+        if (can_geqo && linear_join_order)
             result = forced_geqo(root, levels_needed, initial_rels);
         else
             result = standard_join_search(root, levels_needed, initial_rels);
     }
+    else if (current_hints && current_hints->join_prefixes && pglab_direct_join_build)
+    {
+        collapsed_rels = collapse_join_prefix(root, initial_rels);
+        if (collapsed_rels)
+        {
+            if (list_length(collapsed_rels) == 1)
+            {
+                /* The prefix covers the entire join problem, which makes it a join order hint in all but name */
+                current_join_ordering_type = &JOIN_ORDER_TYPE_FORCED;
+                return (RelOptInfo *) linitial(collapsed_rels);
+            }
+            initial_rels = collapsed_rels;
+            levels_needed = list_length(collapsed_rels);
+        }
+        result = join_search_fallback(root, levels_needed, initial_rels);
+    }
     else
         result = join_search_fallback(root, levels_needed, initial_rels);
 
@@ -2545,7 +3611,6 @@ hint_aware_join_search(PlannerInfo *root, int levels_needed, List *initial_rels)
 void
 hint_aware_cost_seqscan(Path *path, PlannerInfo *root, RelOptInfo *baserel, ParamPathInfo *param_info)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
     Cost startup_cost, total_cost;
 
@@ -2554,11 +3619,11 @@ hint_aware_cost_seqscan(Path *path, PlannerInfo *root, RelOptInfo *baserel, Para
     else
         standard_cost_seqscan(path, root, baserel, param_info);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &(baserel->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_cost_hint(baserel->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.scan_cost.seqscan_startup;
@@ -2573,7 +3638,6 @@ hint_aware_cost_seqscan(Path *path, PlannerInfo *root, RelOptInfo *baserel, Para
 void
 hint_aware_cost_idxscan(IndexPath *path, PlannerInfo *root, double loop_count, bool partial_path)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
     Cost startup_cost, total_cost;
 
@@ -2582,11 +3646,11 @@ hint_aware_cost_idxscan(IndexPath *path, PlannerInfo *root, double loop_count, b
     else
         standard_cost_index(path, root, loop_count, partial_path);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &(path->path.parent->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_cost_hint(path->path.parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.scan_cost.idxscan_startup;
@@ -2602,7 +3666,6 @@ void
 hint_aware_cost_bitmapscan(Path *path, PlannerInfo *root, RelOptInfo *baserel, ParamPathInfo *param_info,
                            Path *bitmapqual, double loop_count)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
     Cost startup_cost, total_cost;
 
@@ -2611,11 +3674,11 @@ hint_aware_cost_bitmapscan(Path *path, PlannerInfo *root, RelOptInfo *baserel, P
     else
         standard_cost_bitmap_heap_scan(path, root, baserel, param_info, bitmapqual, loop_count);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &(baserel->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_cost_hint(baserel->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.scan_cost.bitmap_startup;
@@ -2634,23 +3697,22 @@ hint_aware_initial_cost_nestloop(PlannerInfo *root,
 								 Path *outer_path, Path *inner_path,
 								 JoinPathExtraData *extra)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
-    Relids join_relids = EMPTY_BITMAP;
     Cost startup_cost, total_cost;
 
+    /* Nested loops are the only place where Material paths are used, so this is our chance to apply their costs */
+    apply_path_cost_hint(inner_path);
+
     if (prev_initial_cost_nestloop_hook)
         (*prev_initial_cost_nestloop_hook)(root, workspace, jointype, outer_path, inner_path, extra);
     else
         standard_initial_cost_nestloop(root, workspace, jointype, outer_path, inner_path, extra);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
-    join_relids = bms_add_members(join_relids, outer_path->parent->relids);
-    join_relids = bms_add_members(join_relids, inner_path->parent->relids);
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &join_relids, HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_join_cost_hint(outer_path->parent->relids, inner_path->parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.join_cost.nestloop_startup;
@@ -2667,7 +3729,6 @@ hint_aware_final_cost_nestloop(PlannerInfo *root, NestPath *path,
                                JoinCostWorkspace *workspace,
 							   JoinPathExtraData *extra)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
     Path *raw_path;
     Cost startup_cost, total_cost;
@@ -2677,12 +3738,12 @@ hint_aware_final_cost_nestloop(PlannerInfo *root, NestPath *path,
     else
         standard_final_cost_nestloop(root, path, workspace, extra);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
     raw_path = &(path->jpath.path);
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &(raw_path->parent->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_cost_hint(raw_path->parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.join_cost.nestloop_startup;
@@ -2704,9 +3765,7 @@ hint_aware_initial_cost_hashjoin(PlannerInfo *root,
 								 JoinPathExtraData *extra,
 								 bool parallel_hash)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
-    Relids join_relids = EMPTY_BITMAP;
     Cost startup_cost, total_cost;
 
     if (prev_initial_cost_hashjoin_hook)
@@ -2714,13 +3773,11 @@ hint_aware_initial_cost_hashjoin(PlannerInfo *root,
     else
         standard_initial_cost_hashjoin(root, workspace, jointype, hashclauses, outer_path, inner_path, extra, parallel_hash);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
-    join_relids = bms_add_members(join_relids, outer_path->parent->relids);
-    join_relids = bms_add_members(join_relids, inner_path->parent->relids);
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &join_relids, HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_join_cost_hint(outer_path->parent->relids, inner_path->parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.join_cost.hash_startup;
@@ -2737,7 +3794,6 @@ hint_aware_final_cost_hashjoin(PlannerInfo *root, HashPath *path,
                                JoinCostWorkspace *workspace,
                                JoinPathExtraData *extra)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
     Path *raw_path;
     Cost startup_cost, total_cost;
@@ -2747,12 +3803,12 @@ hint_aware_final_cost_hashjoin(PlannerInfo *root, HashPath *path,
     else
         standard_final_cost_hashjoin(root, path, workspace, extra);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
     raw_path = &(path->jpath.path);
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &(raw_path->parent->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_cost_hint(raw_path->parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.join_cost.hash_startup;
@@ -2776,9 +3832,7 @@ hint_aware_intial_cost_mergejoin(PlannerInfo *root,
                                  #endif
                                  JoinPathExtraData *extra)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
-    Relids join_relids = EMPTY_BITMAP;
     Cost startup_cost, total_cost;
 
     if (prev_initial_cost_mergejoin_hook)
@@ -2804,13 +3858,11 @@ hint_aware_intial_cost_mergejoin(PlannerInfo *root,
                                         #endif
                                         extra);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
-    join_relids = bms_add_members(join_relids, outer_path->parent->relids);
-    join_relids = bms_add_members(join_relids, inner_path->parent->relids);
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &join_relids, HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_join_cost_hint(outer_path->parent->relids, inner_path->parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.join_cost.merge_startup;
@@ -2827,7 +3879,6 @@ hint_aware_final_cost_mergejoin(PlannerInfo *root, MergePath *path,
                                 JoinCostWorkspace *workspace,
                                 JoinPathExtraData *extra)
 {
-    bool hint_found = false;
     CostHint *hint_entry;
     Path *raw_path;
     Cost startup_cost, total_cost;
@@ -2837,12 +3888,12 @@ hint_aware_final_cost_mergejoin(PlannerInfo *root, MergePath *path,
     else
         standard_final_cost_mergejoin(root, path, workspace, extra);
 
-    if (!current_hints || !current_hints->cost_hints)
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
         return;
 
     raw_path = &(path->jpath.path);
-    hint_entry = (CostHint*) hash_search(current_hints->cost_hints, &(raw_path->parent->relids), HASH_FIND, &hint_found);
-    if (!hint_found)
+    hint_entry = fetch_cost_hint(raw_path->parent->relids);
+    if (!hint_entry)
         return;
 
     startup_cost = hint_entry->costs.join_cost.merge_startup;
@@ -2854,6 +3905,121 @@ hint_aware_final_cost_mergejoin(PlannerInfo *root, MergePath *path,
         raw_path->total_cost = total_cost;
 }
 
+void
+hint_aware_cost_memoize_rescan(PlannerInfo *root, MemoizePath *mpath, Cost *rescan_startup_cost, Cost *rescan_total_cost)
+{
+    CostHint *hint_entry;
+    Cost startup_cost, total_cost;
+
+    if (prev_cost_memoize_rescan_hook)
+        (*prev_cost_memoize_rescan_hook)(root, mpath, rescan_startup_cost, rescan_total_cost);
+    else
+        standard_cost_memoize_rescan(root, mpath, rescan_startup_cost, rescan_total_cost);
+
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
+        return;
+
+    hint_entry = fetch_cost_hint(mpath->path.parent->relids);
+    if (!hint_entry)
+        return;
+
+    startup_cost = hint_entry->intermediate_costs.memoize_startup;
+    total_cost = hint_entry->intermediate_costs.memoize_total;
+
+    if (!isnan(startup_cost))
+        *rescan_startup_cost = startup_cost;
+    if (!isnan(total_cost))
+        *rescan_total_cost = total_cost;
+}
+
+void
+hint_aware_cost_gather(GatherPath *path, PlannerInfo *root, RelOptInfo *rel, ParamPathInfo *param_info, double *rows)
+{
+    CostHint *hint_entry;
+    Path *raw_path;
+    Relids relids;
+    Cost startup_cost, total_cost;
+
+    /* The Gather costs are derived from its input, which might be an Append (or Sort) path with hinted costs */
+    apply_path_cost_hint(path->subpath);
+
+    if (prev_cost_gather_hook)
+        (*prev_cost_gather_hook)(path, root, rel, param_info, rows);
+    else
+        standard_cost_gather(path, root, rel, param_info, rows);
+
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
+        return;
+
+    raw_path = &(path->path);
+    relids = PathRelids(raw_path);
+    hint_entry = fetch_cost_hint(relids);
+    if (!hint_entry)
+        return;
+
+    startup_cost = hint_entry->intermediate_costs.gather_startup;
+    total_cost = hint_entry->intermediate_costs.gather_total;
+
+    if (!isnan(startup_cost))
+        raw_path->startup_cost = startup_cost;
+    if (!isnan(total_cost))
+        raw_path->total_cost = total_cost;
+}
+
+void
+hint_aware_cost_gather_merge(GatherMergePath *path, PlannerInfo *root, RelOptInfo *rel, ParamPathInfo *param_info,
+                             #if PG_VERSION_NUM >= 180000
+                             int input_disabled_nodes,
+                             #endif
+                             Cost input_startup_cost, Cost input_total_cost, double *rows)
+{
+    CostHint *hint_entry;
+    Path *raw_path;
+    Relids relids;
+    Cost startup_cost, total_cost;
+    Cost subpath_startup, subpath_total;
+
+    /*
+     * The input costs have already been derived from the subpath (which is typically a Sort path that has not been added to
+     * any relation). If the subpath has hinted costs, we shift the input costs accordingly.
+     */
+    subpath_startup = path->subpath->startup_cost;
+    subpath_total = path->subpath->total_cost;
+    apply_path_cost_hint(path->subpath);
+    input_startup_cost += path->subpath->startup_cost - subpath_startup;
+    input_total_cost += path->subpath->total_cost - subpath_total;
+
+    if (prev_cost_gather_merge_hook)
+        (*prev_cost_gather_merge_hook)(path, root, rel, param_info,
+                                       #if PG_VERSION_NUM >= 180000
+                                       input_disabled_nodes,
+                                       #endif
+                                       input_startup_cost, input_total_cost, rows);
+    else
+        standard_cost_gather_merge(path, root, rel, param_info,
+                                   #if PG_VERSION_NUM >= 180000
+                                   input_disabled_nodes,
+                                   #endif
+                                   input_startup_cost, input_total_cost, rows);
+
+    if (!current_hints || (!current_hints->cost_hints && !current_hints->estimator))
+        return;
+
+    raw_path = &(path->path);
+    relids = PathRelids(raw_path);
+    hint_entry = fetch_cost_hint(relids);
+    if (!hint_entry)
+        return;
+
+    startup_cost = hint_entry->intermediate_costs.gathermerge_startup;
+    total_cost = hint_entry->intermediate_costs.gathermerge_total;
+
+    if (!isnan(startup_cost))
+        raw_path->startup_cost = startup_cost;
+    if (!isnan(total_cost))
+        raw_path->total_cost = total_cost;
+}
+
 static char *
 debug_reloptinfo(RelOptInfo *rel)
 {
@@ -2920,6 +4086,43 @@ _PG_init(void)
                              PGC_USERSET, 0,
                              NULL, NULL, NULL);
 
+    DefineCustomBoolVariable("pglab.direct_join_build",
+                             "Build the join tree of JoinOrder and JoinPrefix hints directly instead of running the normal join search.", NULL,
+                             &pglab_direct_join_build, true,
+                             PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    DefineCustomEnumVariable("pglab.hint_parser",
+                             "Selects the parser that is used to read hint blocks.", NULL,
+                             &pglab_hint_parser, HINT_PARSER_ANTLR,
+                             hint_parser_options,
+                             PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    DefineCustomEnumVariable("pglab.join_enumerator",
+                             "Selects the join enumeration algorithm for join problems without a join order hint.",
+                             "standard uses the normal Postgres policies (dynamic programming or GEQO), dpccp only "
+                             "enumerates connected subgraphs of the join graph.",
+                             &pglab_join_enumerator, JOIN_ENUMERATOR_STANDARD,
+                             join_enumerator_options,
+                             PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pglab.hint_cache_size",
+                            "Number of parsed hint blocks that are cached per backend.",
+                            "Set to 0 to disable the cache.",
+                            &pglab_hint_cache_size, 128,
+                            0, INT_MAX,
+                            PGC_USERSET, 0,
+                            NULL, NULL, NULL);
+
+    init_planner_stats();
+    init_hint_stats();
+    init_hint_pinning();
+    init_plan_capture();
+    init_model_estimator();
+    init_card_feedback();
+
     prev_planner_hook = planner_hook;
     planner_hook = hint_aware_planner;
 
@@ -2977,8 +4180,20 @@ _PG_init(void)
     prev_final_cost_mergejoin_hook = final_cost_mergejoin_hook;
     final_cost_mergejoin_hook = hint_aware_final_cost_mergejoin;
 
+    prev_cost_memoize_rescan_hook = cost_memoize_rescan_hook;
+    cost_memoize_rescan_hook = hint_aware_cost_memoize_rescan;
+
+    prev_cost_gather_hook = cost_gather_hook;
+    cost_gather_hook = hint_aware_cost_gather;
+
+    prev_cost_gather_merge_hook = cost_gather_merge_hook;
+    cost_gather_merge_hook = hint_aware_cost_gather_merge;
+
     prev_executor_end_hook = ExecutorEnd_hook;
     ExecutorEnd_hook = hint_aware_ExecutorEnd;
+
+    prev_process_utility_hook = ProcessUtility_hook;
+    ProcessUtility_hook = hint_aware_ProcessUtility;
 }
 
 void
@@ -3003,8 +4218,12 @@ _PG_fini(void)
     final_cost_hashjoin_hook = prev_final_cost_hashjoin_hook;
     initial_cost_mergejoin_hook = prev_initial_cost_mergejoin_hook;
     final_cost_mergejoin_hook = prev_final_cost_mergejoin_hook;
+    cost_memoize_rescan_hook = prev_cost_memoize_rescan_hook;
+    cost_gather_hook = prev_cost_gather_hook;
+    cost_gather_merge_hook = prev_cost_gather_merge_hook;
     compute_parallel_worker_hook = prev_compute_parallel_workers_hook;
     ExecutorEnd_hook = prev_executor_end_hook;
+    ProcessUtility_hook = prev_process_utility_hook;
 }
 
 
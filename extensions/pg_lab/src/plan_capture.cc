@@ -0,0 +1,423 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/xact.h"
+#include "lib/stringinfo.h"
+#include "nodes/bitmapset.h"
+#include "nodes/pathnodes.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+
+#if PG_VERSION_NUM >= 180000
+#include "commands/defrem.h"
+#include "commands/explain.h"
+#include "commands/explain_format.h"
+#include "commands/explain_state.h"
+#endif
+
+#include "plan_capture.h"
+
+/*
+ * Plan capture exports the final path of a query as a pg_lab hint block. Planning the same query with the captured hint
+ * block yields the same join order, the same physical operators, the same parallel workers and the same cardinality
+ * estimates. The hint block follows the same format as extract_hint_set() from our test suite.
+ *
+ * The hint block of the most recent query is stored per backend and can be retrieved via pg_lab_captured_hints().
+ * Starting with PG 18, it can also be shown directly in the output of EXPLAIN (PGLAB_HINTS).
+ *
+ * Only plans that consist of scans, joins, memoization, materialization and parallel portions can be expressed as hints.
+ * If the plan contains any other node that affects the join tree (e.g. an append or a subquery scan), no hint block is
+ * captured. Sorts, aggregations, limits and projections are skipped since pg_lab does not hint them.
+ */
+
+typedef struct PlanCapture
+{
+    PlannerInfo    *root;
+    StringInfoData  join_order;
+    StringInfoData  operators;
+    StringInfoData  cardinalities;
+    int             n_joins;
+    bool            parallel;      /* whether the plan contains a Gather or Gather Merge */
+} PlanCapture;
+
+bool pglab_capture_plan = false;
+
+/* The hint block of the most recently captured plan, allocated in TopMemoryContext */
+static char *captured_hints = NULL;
+
+/* Whether an EXPLAIN (PGLAB_HINTS) statement is waiting for its hint block */
+static bool explain_capture_requested = false;
+
+PG_FUNCTION_INFO_V1(pg_lab_captured_hints);
+
+static void
+append_relnames(PlanCapture *ctx, StringInfo buf, Relids relids)
+{
+    int i = -1;
+    bool first = true;
+
+    while ((i = bms_next_member(relids, i)) >= 0)
+    {
+        RangeTblEntry *rte = ctx->root->simple_rte_array[i];
+
+        /* Since PG 16, the relids of join rels also contain the RT indexes of outer joins */
+        if (rte->rtekind != RTE_RELATION)
+            continue;
+
+        if (!first)
+            appendStringInfoChar(buf, ' ');
+        appendStringInfoString(buf, rte->eref->aliasname);
+        first = false;
+    }
+}
+
+static void
+append_operator(PlanCapture *ctx, const char *op, Relids relids, int workers)
+{
+    appendStringInfo(&ctx->operators, "%s(", op);
+    append_relnames(ctx, &ctx->operators, relids);
+    if (workers > 0)
+        appendStringInfo(&ctx->operators, " (workers=%d)", workers);
+    appendStringInfoString(&ctx->operators, ")\n");
+}
+
+static void
+append_cardinality(PlanCapture *ctx, RelOptInfo *rel)
+{
+    appendStringInfoString(&ctx->cardinalities, "Card(");
+    append_relnames(ctx, &ctx->cardinalities, rel->relids);
+    appendStringInfo(&ctx->cardinalities, " #%.0f)\n", rel->rows);
+}
+
+static bool capture_path(PlanCapture *ctx, Path *path, int workers);
+
+static bool
+capture_scan(PlanCapture *ctx, Path *path, const char *op, int workers)
+{
+    RangeTblEntry *rte;
+
+    if (!IS_SIMPLE_REL(path->parent))
+        return false;
+
+    rte = ctx->root->simple_rte_array[path->parent->relid];
+    if (rte->rtekind != RTE_RELATION)
+        return false;
+
+    appendStringInfoString(&ctx->join_order, rte->eref->aliasname);
+    append_operator(ctx, op, path->parent->relids, workers);
+    append_cardinality(ctx, path->parent);
+
+    return true;
+}
+
+static bool
+capture_join(PlanCapture *ctx, JoinPath *path, const char *op, int workers)
+{
+    Path *outer_path = path->outerjoinpath;
+    Path *inner_path = path->innerjoinpath;
+
+    if (!IS_JOIN_REL(path->path.parent))
+        return false;
+
+    ctx->n_joins++;
+    append_operator(ctx, op, path->path.parent->relids, workers);
+    append_cardinality(ctx, path->path.parent);
+
+    /* Merge joins materialize their inner relation internally, without a dedicated path */
+    if (IsA(path, MergePath) && ((MergePath *) path)->materialize_inner)
+        append_operator(ctx, "Material", inner_path->parent->relids, 0);
+
+    appendStringInfoChar(&ctx->join_order, '(');
+    if (!capture_path(ctx, outer_path, 0))
+        return false;
+    appendStringInfoChar(&ctx->join_order, ' ');
+    if (!capture_path(ctx, inner_path, 0))
+        return false;
+    appendStringInfoChar(&ctx->join_order, ')');
+
+    return true;
+}
+
+/*
+ * Appends the hints for a (sub-)path to the capture. Returns false if the path cannot be expressed as hints.
+ *
+ * workers is the number of parallel workers if the path is the immediate child of a Gather or Gather Merge node.
+ */
+static bool
+capture_path(PlanCapture *ctx, Path *path, int workers)
+{
+    Path *subpath;
+
+    check_stack_depth();
+
+    switch (path->pathtype)
+    {
+        case T_SeqScan:
+            return capture_scan(ctx, path, "SeqScan", workers);
+        case T_IndexScan:
+        case T_IndexOnlyScan:
+            return capture_scan(ctx, path, "IdxScan", workers);
+        case T_BitmapHeapScan:
+            return capture_scan(ctx, path, "BitmapScan", workers);
+        case T_NestLoop:
+            return capture_join(ctx, (JoinPath *) path, "NestLoop", workers);
+        case T_HashJoin:
+            return capture_join(ctx, (JoinPath *) path, "HashJoin", workers);
+        case T_MergeJoin:
+            return capture_join(ctx, (JoinPath *) path, "MergeJoin", workers);
+        case T_Material:
+            append_operator(ctx, "Material", path->parent->relids, workers);
+            return capture_path(ctx, ((MaterialPath *) path)->subpath, 0);
+        case T_Memoize:
+            append_operator(ctx, "Memo", path->parent->relids, workers);
+            return capture_path(ctx, ((MemoizePath *) path)->subpath, 0);
+        case T_Gather:
+            if (ctx->parallel)
+                return false;
+            ctx->parallel = true;
+            return capture_path(ctx, ((GatherPath *) path)->subpath, ((GatherPath *) path)->num_workers);
+        case T_GatherMerge:
+            if (ctx->parallel)
+                return false;
+            ctx->parallel = true;
+            return capture_path(ctx, ((GatherMergePath *) path)->subpath, ((GatherMergePath *) path)->num_workers);
+        case T_Unique:
+            subpath = ((UniquePath *) path)->subpath;
+            break;
+        case T_ProjectSet:
+            subpath = ((ProjectSetPath *) path)->subpath;
+            break;
+        case T_Sort:
+            subpath = ((SortPath *) path)->subpath;
+            break;
+        case T_IncrementalSort:
+            subpath = ((IncrementalSortPath *) path)->spath.subpath;
+            break;
+        case T_Group:
+            subpath = ((GroupPath *) path)->subpath;
+            break;
+        case T_Agg:
+            subpath = ((AggPath *) path)->subpath;
+            break;
+        case T_GroupingSet:
+            subpath = ((GroupingSetsPath *) path)->subpath;
+            break;
+        case T_WindowAgg:
+            subpath = ((WindowAggPath *) path)->subpath;
+            break;
+        case T_Limit:
+            subpath = ((LimitPath *) path)->subpath;
+            break;
+        case T_Result:
+            if (!IsA(path, ProjectionPath))
+                return false;
+            subpath = ((ProjectionPath *) path)->subpath;
+            break;
+        default:
+            return false;
+    }
+
+    /*
+     * If the parallel portion starts above the join tree (e.g. with a partial aggregate), we need to parallelize the entire
+     * plan. Otherwise, the node is part of the join tree (e.g. a sort below a Gather Merge) and the workers belong to the
+     * scan or join below.
+     */
+    if (workers > 0 && IS_UPPER_REL(path->parent))
+    {
+        appendStringInfo(&ctx->operators, "Result(workers=%d)\n", workers);
+        workers = 0;
+    }
+
+    return capture_path(ctx, subpath, workers);
+}
+
+static bool
+query_has_base_tables(PlannerInfo *root)
+{
+    for (int i = 1; i < root->simple_rel_array_size; i++)
+    {
+        RelOptInfo *rel = root->simple_rel_array[i];
+        if (rel && rel->reloptkind == RELOPT_BASEREL && rel->rtekind == RTE_RELATION)
+            return true;
+    }
+
+    return false;
+}
+
+bool
+plan_capture_requested(void)
+{
+    return pglab_capture_plan || explain_capture_requested;
+}
+
+/*
+ * Exports the final path of the current query as a hint block.
+ *
+ * Only the top-level query is captured. Queries that do not scan any tables (such as SELECT pg_lab_captured_hints())
+ * do not replace the current hint block.
+ */
+void
+capture_plan_hints(PlannerInfo *root, Path *best_path)
+{
+    PlanCapture ctx;
+    StringInfoData hints;
+
+    if (root->query_level > 1 || !query_has_base_tables(root))
+        return;
+
+    if (captured_hints)
+    {
+        pfree(captured_hints);
+        captured_hints = NULL;
+    }
+
+    memset(&ctx, 0, sizeof(PlanCapture));
+    ctx.root = root;
+    initStringInfo(&ctx.join_order);
+    initStringInfo(&ctx.operators);
+    initStringInfo(&ctx.cardinalities);
+
+    if (!capture_path(&ctx, best_path, 0))
+    {
+        ereport(DEBUG1,
+                errmsg("[pg_lab] Could not capture the final plan"),
+                errdetail("The plan contains nodes that cannot be expressed as hints."));
+        return;
+    }
+
+    initStringInfo(&hints);
+    appendStringInfoString(&hints, "/*=pg_lab=\n");
+    if (ctx.parallel)
+        appendStringInfoString(&hints, "Config(plan_mode=full)\n");
+    else
+        appendStringInfoString(&hints, "Config(plan_mode=full; exec_mode=sequential)\n");
+    if (ctx.n_joins > 0)
+        appendStringInfo(&hints, "JoinOrder(%s)\n", ctx.join_order.data);
+    appendStringInfoString(&hints, ctx.operators.data);
+    appendStringInfoString(&hints, ctx.cardinalities.data);
+    appendStringInfoString(&hints, "*/");
+
+    captured_hints = MemoryContextStrdup(TopMemoryContext, hints.data);
+}
+
+#if PG_VERSION_NUM >= 180000
+
+static int explain_extension_id = -1;
+static explain_per_plan_hook_type prev_explain_per_plan_hook = NULL;
+
+static void
+explain_hints_handler(ExplainState *es, DefElem *opt, ParseState *pstate)
+{
+    bool *show_hints;
+
+    show_hints = (bool *) GetExplainExtensionState(es, explain_extension_id);
+    if (!show_hints)
+    {
+        show_hints = (bool *) palloc0(sizeof(bool));
+        SetExplainExtensionState(es, explain_extension_id, show_hints);
+    }
+
+    *show_hints = defGetBoolean(opt);
+
+    /*
+     * The options are parsed before the query is planned. If the plan is not created by this statement (e.g. EXPLAIN
+     * EXECUTE with a cached plan), we must not show the hints of some earlier query.
+     */
+    if (*show_hints)
+    {
+        explain_capture_requested = true;
+        if (captured_hints)
+        {
+            pfree(captured_hints);
+            captured_hints = NULL;
+        }
+    }
+}
+
+static void
+hint_aware_explain_per_plan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
+                            const char *queryString, ParamListInfo params, QueryEnvironment *queryEnv)
+{
+    bool *show_hints;
+
+    if (prev_explain_per_plan_hook)
+        prev_explain_per_plan_hook(plannedstmt, into, es, queryString, params, queryEnv);
+
+    show_hints = (bool *) GetExplainExtensionState(es, explain_extension_id);
+    if (!show_hints || !*show_hints)
+        return;
+
+    explain_capture_requested = false;
+    if (!captured_hints)
+        return;
+
+    if (es->format == EXPLAIN_FORMAT_TEXT)
+    {
+        /* Multi-line properties would break the indentation of the text format */
+        char *hints = pstrdup(captured_hints);
+        for (char *c = hints; *c; c++)
+        {
+            if (*c == '\n')
+                *c = ' ';
+        }
+        ExplainPropertyText("pg_lab Hints", hints, es);
+        pfree(hints);
+    }
+    else
+        ExplainPropertyText("pg_lab Hints", captured_hints, es);
+}
+
+#endif
+
+static void
+plan_capture_xact_callback(XactEvent event, void *arg)
+{
+    /*
+     * If an EXPLAIN (PGLAB_HINTS) fails before its plan is shown (e.g. due to a planning error), the request would stay
+     * active and all later queries would be captured.
+     */
+    if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT)
+        explain_capture_requested = false;
+}
+
+void
+init_plan_capture(void)
+{
+    DefineCustomBoolVariable("pglab.capture_plan",
+                             "Export the final plan of each query as a pg_lab hint block.",
+                             "The hint block of the most recent query is available via pg_lab_captured_hints().",
+                             &pglab_capture_plan, false,
+                             PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    RegisterXactCallback(plan_capture_xact_callback, NULL);
+
+    #if PG_VERSION_NUM >= 180000
+
+    explain_extension_id = GetExplainExtensionId("pg_lab");
+    RegisterExtensionExplainOption("pglab_hints", explain_hints_handler);
+
+    prev_explain_per_plan_hook = explain_per_plan_hook;
+    explain_per_plan_hook = hint_aware_explain_per_plan;
+
+    #endif
+}
+
+Datum
+pg_lab_captured_hints(PG_FUNCTION_ARGS)
+{
+    if (!captured_hints)
+        PG_RETURN_NULL();
+
+    PG_RETURN_TEXT_P(cstring_to_text(captured_hints));
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
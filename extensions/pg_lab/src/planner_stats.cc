@@ -0,0 +1,299 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "access/xact.h"
+#include "mb/pg_wchar.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#if PG_VERSION_NUM >= 180000
+#include "commands/defrem.h"
+#include "commands/explain.h"
+#include "commands/explain_format.h"
+#include "commands/explain_state.h"
+#endif
+
+#include "planner_stats.h"
+
+/*
+ * Per-backend history of the most recent planner runs.
+ *
+ * The history is a simple ring buffer that lives in the TopMemoryContext and is only filled if pglab.track_planner_stats is
+ * enabled. Query strings are truncated to PLANNER_STATS_QUERY_LEN bytes to keep the history small. Notice that querying
+ * the statistics also requires a planner run, hence the query that calls pg_lab_planner_stats() will always show up as the
+ * most recent entry.
+ *
+ * Starting with PG 18, the statistics of a single query can also be shown via EXPLAIN (PGLAB_STATS). This does not require
+ * pglab.track_planner_stats.
+ */
+
+#define PLANNER_STATS_HISTORY 32
+#define PLANNER_STATS_COLS 15
+#define PLANNER_STATS_QUERY_LEN 1024
+
+bool pglab_track_planner_stats = false;
+
+PlannerStats *current_planner_stats = NULL;
+
+static PlannerStats planner_stats_history[PLANNER_STATS_HISTORY];
+static int64 n_planner_runs = 0;
+
+/*
+ * Whether an EXPLAIN (PGLAB_STATS) statement is waiting for the statistics of its query. Once the outermost planner run has
+ * completed, its statistics are stored in explain_stats.
+ */
+static bool explain_stats_requested = false;
+static bool explain_stats_valid = false;
+static PlannerStats explain_stats;
+
+PG_FUNCTION_INFO_V1(pg_lab_planner_stats);
+PG_FUNCTION_INFO_V1(pg_lab_reset_planner_stats);
+
+/*
+ * Starts the instrumentation of a new planner run. The statistics are allocated in the current memory context.
+ *
+ * The instrumentation is skipped (and NULL is returned) if neither the planner statistics nor the hint statistics are
+ * enabled and no EXPLAIN (PGLAB_STATS) is active. toplevel indicates whether this is the outermost planner run, i.e. not
+ * a run for some SPI query that is planned while the actual query is planned.
+ */
+PlannerStats *
+planner_stats_begin(const char *query_string, bool toplevel)
+{
+    PlannerStats *stats;
+
+    if (!pglab_track_planner_stats && !hint_stats_enabled() && !explain_stats_requested)
+        return NULL;
+
+    stats = (PlannerStats *) palloc0(sizeof(PlannerStats));
+    stats->query = (char *) query_string;
+    stats->toplevel = toplevel;
+    INSTR_TIME_SET_CURRENT(stats->start_time);
+
+    return stats;
+}
+
+/*
+ * Completes the instrumentation of a planner run and stores the statistics in the history.
+ */
+void
+planner_stats_end(PlannerStats *stats)
+{
+    PlannerStats *entry;
+    instr_time end_time;
+
+    if (!stats)
+        return;
+
+    INSTR_TIME_SET_CURRENT(end_time);
+    INSTR_TIME_ACCUM_DIFF(stats->planning_time, end_time, stats->start_time);
+
+    if (explain_stats_requested && stats->toplevel)
+    {
+        /* Queries that are planned while the EXPLAIN ANALYZE is executed must not replace the stats */
+        explain_stats = *stats;
+        explain_stats.query = NULL;
+        explain_stats_valid = true;
+        explain_stats_requested = false;
+    }
+
+    if (!pglab_track_planner_stats)
+        return;
+
+    entry = &planner_stats_history[n_planner_runs % PLANNER_STATS_HISTORY];
+    if (entry->query)
+        pfree(entry->query);
+
+    *entry = *stats;
+    entry->statement_no = ++n_planner_runs;
+    entry->query = NULL;
+    if (stats->query)
+    {
+        int query_len;
+
+        query_len = pg_mbcliplen(stats->query, strlen(stats->query), PLANNER_STATS_QUERY_LEN);
+        entry->query = (char *) MemoryContextAlloc(TopMemoryContext, query_len + 1);
+        memcpy(entry->query, stats->query, query_len);
+        entry->query[query_len] = '\0';
+    }
+}
+
+/*
+ * Determines the time since the start of the planner run (in ms).
+ */
+double
+planner_stats_elapsed(PlannerStats *stats)
+{
+    instr_time now;
+
+    if (!stats)
+        return 0.0;
+
+    INSTR_TIME_SET_CURRENT(now);
+    INSTR_TIME_SUBTRACT(now, stats->start_time);
+    return INSTR_TIME_GET_MILLISEC(now);
+}
+
+#if PG_VERSION_NUM >= 180000
+
+static int explain_extension_id = -1;
+static explain_per_plan_hook_type prev_explain_per_plan_hook = NULL;
+
+static void
+explain_stats_handler(ExplainState *es, DefElem *opt, ParseState *pstate)
+{
+    bool *show_stats;
+
+    show_stats = (bool *) GetExplainExtensionState(es, explain_extension_id);
+    if (!show_stats)
+    {
+        show_stats = (bool *) palloc0(sizeof(bool));
+        SetExplainExtensionState(es, explain_extension_id, show_stats);
+    }
+
+    *show_stats = defGetBoolean(opt);
+
+    /* If the plan is not created by this statement (e.g. EXPLAIN EXECUTE with a cached plan), there are no stats to show */
+    explain_stats_requested = *show_stats;
+    explain_stats_valid = false;
+}
+
+static void
+hint_aware_explain_stats(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
+                         const char *queryString, ParamListInfo params, QueryEnvironment *queryEnv)
+{
+    bool *show_stats;
+
+    if (prev_explain_per_plan_hook)
+        prev_explain_per_plan_hook(plannedstmt, into, es, queryString, params, queryEnv);
+
+    show_stats = (bool *) GetExplainExtensionState(es, explain_extension_id);
+    if (!show_stats || !*show_stats)
+        return;
+
+    explain_stats_requested = false;
+    if (!explain_stats_valid)
+        return;
+    explain_stats_valid = false;
+
+    ExplainOpenGroup("pg_lab Planner Stats", "pg_lab Planner Stats", true, es);
+    ExplainPropertyFloat("pg_lab Planning Time", "ms", INSTR_TIME_GET_MILLISEC(explain_stats.planning_time), 3, es);
+    ExplainPropertyFloat("pg_lab Hint Parse Time", "ms", INSTR_TIME_GET_MILLISEC(explain_stats.parse_time), 3, es);
+    ExplainPropertyFloat("pg_lab Path Check Time", "ms", INSTR_TIME_GET_MILLISEC(explain_stats.check_time), 3, es);
+    ExplainPropertyInteger("pg_lab Add Path Calls", NULL, explain_stats.add_path_calls, es);
+    ExplainPropertyInteger("pg_lab Add Partial Path Calls", NULL, explain_stats.add_partial_path_calls, es);
+    ExplainPropertyInteger("pg_lab Accepted Paths", NULL, explain_stats.accepted_paths, es);
+    ExplainPropertyInteger("pg_lab Rejected Children", NULL, explain_stats.rejected_children, es);
+    ExplainPropertyInteger("pg_lab Rejected Prefix", NULL, explain_stats.rejected_prefix, es);
+    ExplainPropertyInteger("pg_lab Rejected Join Order", NULL, explain_stats.rejected_join_order, es);
+    ExplainPropertyInteger("pg_lab Rejected Operators", NULL, explain_stats.rejected_operators, es);
+    ExplainPropertyInteger("pg_lab Rejected Parallel", NULL, explain_stats.rejected_parallel, es);
+    ExplainPropertyInteger("pg_lab Memoized Verdicts", NULL, explain_stats.memoized_verdicts, es);
+    ExplainCloseGroup("pg_lab Planner Stats", "pg_lab Planner Stats", true, es);
+}
+
+#endif
+
+static void
+planner_stats_xact_callback(XactEvent event, void *arg)
+{
+    /* An EXPLAIN that failed before its plan was shown must not keep the instrumentation alive */
+    if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT)
+    {
+        explain_stats_requested = false;
+        explain_stats_valid = false;
+    }
+}
+
+void
+init_planner_stats(void)
+{
+    DefineCustomBoolVariable("pglab.track_planner_stats",
+                             "Record the statistics of each planner run for pg_lab_planner_stats().", NULL,
+                             &pglab_track_planner_stats, false,
+                             PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    RegisterXactCallback(planner_stats_xact_callback, NULL);
+
+    #if PG_VERSION_NUM >= 180000
+
+    /* The plan capture already uses the "pg_lab" extension state, so we need our own */
+    explain_extension_id = GetExplainExtensionId("pg_lab_stats");
+    RegisterExtensionExplainOption("pglab_stats", explain_stats_handler);
+
+    prev_explain_per_plan_hook = explain_per_plan_hook;
+    explain_per_plan_hook = hint_aware_explain_stats;
+
+    #endif
+}
+
+Datum
+pg_lab_planner_stats(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo;
+    int64 first_run;
+
+    InitMaterializedSRF(fcinfo, 0);
+    rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+    first_run = Max(n_planner_runs - PLANNER_STATS_HISTORY, 0);
+    for (int64 run = first_run; run < n_planner_runs; run++)
+    {
+        PlannerStats *entry;
+        Datum values[PLANNER_STATS_COLS];
+        bool nulls[PLANNER_STATS_COLS];
+        int i = 0;
+
+        entry = &planner_stats_history[run % PLANNER_STATS_HISTORY];
+        memset(nulls, 0, sizeof(nulls));
+
+        values[i++] = Int64GetDatum(entry->statement_no);
+        if (entry->query)
+            values[i++] = CStringGetTextDatum(entry->query);
+        else
+            nulls[i++] = true;
+        values[i++] = BoolGetDatum(entry->contains_hint);
+        values[i++] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(entry->planning_time));
+        values[i++] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(entry->parse_time));
+        values[i++] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(entry->check_time));
+        values[i++] = Int64GetDatum(entry->add_path_calls);
+        values[i++] = Int64GetDatum(entry->add_partial_path_calls);
+        values[i++] = Int64GetDatum(entry->accepted_paths);
+        values[i++] = Int64GetDatum(entry->rejected_children);
+        values[i++] = Int64GetDatum(entry->rejected_prefix);
+        values[i++] = Int64GetDatum(entry->rejected_join_order);
+        values[i++] = Int64GetDatum(entry->rejected_operators);
+        values[i++] = Int64GetDatum(entry->rejected_parallel);
+        values[i++] = Int64GetDatum(entry->memoized_verdicts);
+        Assert(i == PLANNER_STATS_COLS);
+
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+    }
+
+    return (Datum) 0;
+}
+
+Datum
+pg_lab_reset_planner_stats(PG_FUNCTION_ARGS)
+{
+    for (int i = 0; i < PLANNER_STATS_HISTORY; i++)
+    {
+        if (planner_stats_history[i].query)
+            pfree(planner_stats_history[i].query);
+    }
+
+    memset(planner_stats_history, 0, sizeof(planner_stats_history));
+    n_planner_runs = 0;
+
+    PG_RETURN_VOID();
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Test module for the in-process estimator of pg_lab.
+ *
+ * Once the module is loaded (LOAD 'batch_estimates'), it installs a batch estimates hook via the rendezvous variable of
+ * pg_lab. The hook estimates BATCH_ESTIMATES_ROWS rows per relation of each intermediate, e.g. a join of two base rels
+ * is estimated to produce 2 * BATCH_ESTIMATES_ROWS rows.
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "model_estimator.h"
+
+PG_MODULE_MAGIC;
+
+#define BATCH_ESTIMATES_ROWS 4200
+
+void _PG_init(void);
+
+static void
+batch_estimates(PlannerInfo *root, int level, ModelEstimate **estimates, int n_estimates)
+{
+    for (int i = 0; i < n_estimates; i++)
+        estimates[i]->rows = BATCH_ESTIMATES_ROWS * bms_num_members(estimates[i]->relids);
+}
+
+void
+_PG_init(void)
+{
+    pglab_batch_estimates_hook_type *hook;
+
+    hook = (pglab_batch_estimates_hook_type *) find_rendezvous_variable(PGLAB_BATCH_ESTIMATES_HOOK);
+    *hook = batch_estimates;
+}
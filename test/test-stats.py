@@ -2,7 +2,10 @@ from __future__ import annotations
 
 import argparse
 import os
+import socket
+import tempfile
 import textwrap
+import threading
 import unittest
 import warnings
 from pathlib import Path
@@ -97,6 +100,33 @@ class FullPlanHinting(core.PostgresTestCase):
                 self._check_query(query, label=label)
             self.conn.rollback()
 
+    def test_captured_hints(self) -> None:
+        for label, query in self.workload.items():
+            with self.subTest(label=label):
+                self._check_captured_hints(query, label=label)
+            self.conn.rollback()
+
+    def test_failed_explain_capture(self) -> None:
+        if self.conn.info.server_version < 180000:
+            self.skipTest("EXPLAIN (PGLAB_HINTS) requires PG 18")
+
+        query = "SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id"
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute("SET pglab.capture_plan = off")
+            self.conn.commit()
+
+            # the division by zero is raised while planning, i.e. before the hint block is shown
+            with self.assertRaises(psycopg.errors.DivisionByZero):
+                cur.execute(f"EXPLAIN (PGLAB_HINTS) {query} WHERE 1 / 0 = 1")
+            self.conn.rollback()
+
+            cur.execute(query)
+            cur.execute("SELECT pg_lab_captured_hints();")
+            hints = cur.fetchone()[0]
+
+        self.assertIsNone(hints)
+
     def _filter_workload(self) -> None:
         if not self._queries:
             return
@@ -124,6 +154,30 @@ class FullPlanHinting(core.PostgresTestCase):
                 msg=f"Plans differ for query {label}\n\n{hinted_query}",
             )
 
+    def _check_captured_hints(self, query: str, *, label: str) -> None:
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute("SET pglab.capture_plan = on")
+            native_plan = core.explain_plan(query, cur)
+            cur.execute("SELECT pg_lab_captured_hints();")
+            hints = cur.fetchone()[0]
+            cur.execute("SET pglab.capture_plan = off")
+
+            if hints is None:
+                self.skipTest(f"Plan of query {label} cannot be captured")
+
+            hinted_query = f"{hints}\n{query}"
+            try:
+                hinted_plan = core.explain_plan(hinted_query, cur)
+            except psycopg.errors.InternalError as e:
+                self.fail(f"Query {label}\n\n{hinted_query}\nFailed with error: {e}")
+
+            self.assertPlansEqual(
+                native_plan,
+                hinted_plan,
+                msg=f"Plans differ for query {label}\n\n{hinted_query}",
+            )
+
 
 class CardinalityHinting(core.PostgresTestCase):
     def setUp(self) -> None:
@@ -154,6 +208,71 @@ class CardinalityHinting(core.PostgresTestCase):
         with self.conn.cursor() as cur:
             self._check_query(query, card=target_card, intermediate="p u", cur=cur)
 
+    def test_card_scale_superset(self) -> None:
+        query = """
+            SELECT *
+            FROM posts p
+            JOIN users u ON p.owneruserid = u.id
+            JOIN badges b ON u.id = b.userid
+            WHERE u.id > 3000
+        """
+        hints = "/*=pg_lab= CardScale(p u #0.5) CardScale(b #4) */"
+        with self.conn.cursor() as cur:
+            native_plan = core.explain_plan(query, cur)
+            scaled_plan = core.explain_plan(f"{hints}\n{query}", cur)
+
+        # Both factors apply to the (p u b) superset and compose multiplicatively. Each intermediate is rounded on its own,
+        # so we allow for a small error.
+        expected_rows = native_plan["Plan Rows"] * 0.5 * 4
+        self.assertAlmostEqual(scaled_plan["Plan Rows"], expected_rows, delta=max(1, 0.01 * expected_rows))
+
+    def test_bulk_cardinalities(self) -> None:
+        query = "SELECT * FROM posts p JOIN users u ON p.owneruserid = u.id WHERE u.id > 3000"
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute(
+                "SELECT pg_lab_set_cardinalities(%s, %s);",
+                (["p", "u", "p u"], [100.0, 10.0, 5678.0]),
+            )
+            bulk_plan = core.explain_plan(query, cur)
+            native_plan = core.explain_plan(query, cur)
+
+        self.assertEqual(bulk_plan["Plan Rows"], 5678)
+        self.assertNotEqual(native_plan["Plan Rows"], 5678)
+
+    def test_bulk_cardinalities_nested_planner(self) -> None:
+        # The function is evaluated while the query is planned and its SPI query needs to be planned as well. The
+        # cardinalities must still be used by the outer query.
+        query = "SELECT * FROM posts p JOIN users u ON p.owneruserid = u.id WHERE u.id > pg_temp.min_user_id()"
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute("""
+                CREATE FUNCTION pg_temp.min_user_id() RETURNS int LANGUAGE plpgsql IMMUTABLE
+                AS $$ BEGIN RETURN (SELECT 3000 FROM users LIMIT 1); END $$;
+            """)
+            cur.execute(
+                "SELECT pg_lab_set_cardinalities(%s, %s);",
+                (["p", "u", "p u"], [100.0, 10.0, 5678.0]),
+            )
+            bulk_plan = core.explain_plan(query, cur)
+
+        self.assertEqual(bulk_plan["Plan Rows"], 5678)
+
+    def test_card_feedback(self) -> None:
+        query = "SELECT * FROM posts p JOIN users u ON p.owneruserid = u.id WHERE u.id > 3000"
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute("SELECT pg_lab_reset_card_feedback();")
+            cur.execute("SET pglab.card_feedback = on")
+
+            cur.execute(f"EXPLAIN (ANALYZE, FORMAT JSON) {query}")
+            actual_rows = cur.fetchone()[0][0]["Plan"]["Actual Rows"]
+            feedback_plan = core.explain_plan(query, cur)
+
+            cur.execute("SET pglab.card_feedback = off")
+
+        self.assertEqual(feedback_plan["Plan Rows"], max(actual_rows, 1))
+
     def _check_query(
         self, query: str, *, card: int, intermediate: str, cur: psycopg.Cursor
     ) -> None:
@@ -177,6 +296,732 @@ class CardinalityHinting(core.PostgresTestCase):
         )
 
 
+def _serve_estimates(server: socket.socket, estimates: dict[str, str]) -> None:
+    """Answers the requests of a single planner connection with fixed estimates."""
+    conn, _ = server.accept()
+    with conn, conn.makefile("rw", newline="\n") as stream:
+        for line in stream:
+            if line.startswith("QUERY"):
+                stream.read(int(line.split()[-1]) + 1)
+            elif line.startswith("BATCH"):
+                intermediates = [stream.readline().strip() for _ in range(int(line.split()[1]))]
+                for intermediate in intermediates:
+                    key = " ".join(sorted(intermediate.split()))
+                    stream.write(estimates.get(key, "-") + "\n")
+                stream.flush()
+
+
+class ExternalEstimator(core.PostgresTestCase):
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    query = "SELECT * FROM posts p JOIN users u ON p.owneruserid = u.id WHERE u.id > 3000"
+
+    def test_join_estimates(self) -> None:
+        estimated_plan = self._explain_with_estimator({"p u": "5678 HashJoin=0,42"})
+        self.assertEqual(estimated_plan["Plan Rows"], 5678)
+
+    def test_invalid_costs(self) -> None:
+        with self.conn.cursor() as cur:
+            native_plan = core.explain_plan(self.query, cur)
+
+        for costs in ["nan,42", "0,inf", "-1,42", "50,42", "0,1e999"]:
+            with self.subTest(costs=costs):
+                # the entire response line is rejected, including the cardinality
+                estimated_plan = self._explain_with_estimator({"p u": f"5678 HashJoin={costs}"})
+                self.assertEqual(estimated_plan["Plan Rows"], native_plan["Plan Rows"])
+
+    def test_nested_card_scale(self) -> None:
+        # the factor of u must be applied to the external estimate of the join, even though it is contained in an input
+        estimated_plan = self._explain_with_estimator({"p u": "5678"}, hints="/*=pg_lab= CardScale(u #0.5) */")
+        self.assertEqual(estimated_plan["Plan Rows"], 2839)
+
+    def _explain_with_estimator(self, estimates: dict[str, str], *, hints: str = "") -> dict:
+        socket_path = Path(tempfile.mkdtemp()) / "estimator.sock"
+
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as server:
+            server.bind(str(socket_path))
+            server.listen(1)
+            worker = threading.Thread(target=_serve_estimates, args=(server, estimates))
+            worker.start()
+
+            # the connection to the estimator is only closed once the backend terminates
+            with psycopg.connect(dbname=DB_NAME, host="localhost") as conn, conn.cursor() as cur:
+                cur.execute(f"SET pglab.estimator_socket = '{socket_path}'")
+                estimated_plan = core.explain_plan(f"{hints}\n{self.query}", cur)
+            worker.join()
+
+        return estimated_plan
+
+
+class BatchEstimatesHook(core.PostgresTestCase):
+    """Uses the batch_estimates test module (see batch_estimates/) to install an in-process estimator."""
+
+    rows_per_relation = 4200
+
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+        with self.conn.cursor() as cur:
+            try:
+                cur.execute("LOAD 'batch_estimates'")
+            except psycopg.errors.UndefinedFile:
+                self.conn.close()
+                self.skipTest("batch_estimates module is not installed (run make install in test/batch_estimates)")
+
+    def tearDown(self):
+        try:
+            # the hook stays installed for the remainder of the backend
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_join_estimates(self) -> None:
+        # the hook estimates 4200 rows per base rel of an intermediate
+        query = """
+            SELECT *
+            FROM posts p
+            JOIN users u ON p.owneruserid = u.id
+            JOIN badges b ON u.id = b.userid
+            WHERE u.id > 3000
+        """
+        with self.conn.cursor() as cur:
+            plan = core.explain_plan(query, cur)
+
+        self.assertEqual(plan["Plan Rows"], 3 * self.rows_per_relation)
+
+    def test_base_rel_estimates(self) -> None:
+        query = "SELECT * FROM users u WHERE u.id > 3000"
+        with self.conn.cursor() as cur:
+            plan = core.explain_plan(query, cur)
+
+        self.assertEqual(plan["Plan Rows"], self.rows_per_relation)
+
+    def test_hints_take_precedence(self) -> None:
+        query = """
+            /*=pg_lab= Card(p u #5678) */
+            SELECT *
+            FROM posts p
+            JOIN users u ON p.owneruserid = u.id
+        """
+        with self.conn.cursor() as cur:
+            plan = core.explain_plan(query, cur)
+
+        self.assertEqual(plan["Plan Rows"], 5678)
+
+
+class HintParserConformance(core.PostgresTestCase):
+    """Ensures that the ANTLR parser and the native parser produce the same hints and plans."""
+
+    corpus = [
+        """
+        /*=pg_lab= Config(plan_mode=full; exec_mode=sequential)
+          JoinOrder(((p u) b)) HashJoin(p u b) NestLoop(p u)
+          SeqScan(p) IdxScan(u) BitmapScan(b) Memo(u) */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id JOIN badges b ON u.id = b.userid
+        """,
+        """
+        /*=pg_lab= JoinPrefix((b u)) Card(b u #4200) Card(p #42) Set(enable_material = 'off') */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id JOIN badges b ON u.id = b.userid
+        """,
+        """
+        /*=pg_lab= CONFIG(EXEC_MODE=PARALLEL) MergeJoin(p u (Forced)) SeqScan(u (Workers=2)) */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id
+        """,
+        """
+        /*=pg_lab= Result(workers=3) HashJoin(p u) Material(u) */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id
+        """,
+        """
+        /*=pg_lab= NestLoop(p u (Cost(Start=1 Total=4.2))) HashJoin(p u (Cost(Start=4200 Total=42000.5))) */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id
+        """,
+        """
+        /*=pg_lab= CardScale(p u #0.25) CardScale(b #3) */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id JOIN badges b ON u.id = b.userid
+        """,
+        """
+        /*=pg_lab= Gather(p u (Cost(Start=10 Total=420))) Memo(u (Cost(Start=0 Total=1.5)))
+          Sort(p u (Cost(Start=4200 Total=4242))) Append(p (Cost(Start=0 Total=42))) */
+        SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id JOIN badges b ON u.id = b.userid
+        """,
+        """
+        /*=pg_lab= JoinOrder(((sort append) custom)) HashJoin(sort append) SeqScan(custom) Card(sort append #42) */
+        SELECT count(*) FROM posts sort JOIN users append ON sort.owneruserid = append.id
+          JOIN badges custom ON append.id = custom.userid
+        """,
+    ]
+
+    # The ANTLR parser recovers from these errors (and should produce the second spec), the native parser raises an error.
+    malformed = [
+        ("/*=pg_lab= SequentialScan(p) */", ""),
+        ("/*=pg_lab= HashJoin(p u) IndexScan(u) */", "HashJoin(p u)\n"),
+    ]
+
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+        self.workload = _load_workload()
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_corpus_specs(self) -> None:
+        for i, query in enumerate(self.corpus):
+            hint_block = query[: query.index("*/") + 2].strip()
+            with self.subTest(label=f"corpus-{i}"):
+                antlr_spec = self._parse_hints(hint_block, parser="antlr")
+                native_spec = self._parse_hints(hint_block, parser="native")
+                self.assertTrue(antlr_spec, f"No hints parsed for corpus-{i}")
+                self.assertEqual(antlr_spec, native_spec)
+            self.conn.rollback()
+
+    def test_malformed_hints(self) -> None:
+        query = "SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id"
+        for i, (hint_block, expected_spec) in enumerate(self.malformed):
+            with self.subTest(label=f"malformed-{i}"):
+                antlr_spec = self._parse_hints(hint_block, parser="antlr")
+                self.assertEqual(antlr_spec, expected_spec)
+
+                with self.conn.cursor() as cur:
+                    cur.execute("SET pglab.hint_parser = 'antlr'")
+                    core.explain_plan(f"{hint_block}\n{query}", cur)
+
+                    cur.execute("SET pglab.hint_parser = 'native'")
+                    with self.assertRaises(psycopg.errors.SyntaxError):
+                        core.explain_plan(f"{hint_block}\n{query}", cur)
+            self.conn.rollback()
+
+    def test_keyword_aliases(self) -> None:
+        query = """
+            /*=pg_lab= Card(sort append #42) */
+            SELECT * FROM posts sort JOIN users append ON sort.owneruserid = append.id
+        """
+        for parser in ("antlr", "native"):
+            with self.subTest(parser=parser), self.conn.cursor() as cur:
+                cur.execute(f"SET pglab.hint_parser = '{parser}'")
+                plan = core.explain_plan(query, cur)
+                self.assertEqual(plan["Plan Rows"], 42)
+            self.conn.rollback()
+
+    def test_corpus(self) -> None:
+        for i, query in enumerate(self.corpus):
+            with self.subTest(label=f"corpus-{i}"):
+                self._check_query(query, label=f"corpus-{i}")
+            self.conn.rollback()
+
+    def test_full_plan_hints(self) -> None:
+        for label, query in self.workload.items():
+            with self.conn.cursor() as cur:
+                native_plan = core.explain_plan(query, cur)
+            hints = core.extract_hint_set(native_plan, plan_mode="full")
+
+            with self.subTest(label=label):
+                self._check_query(f"{hints}\n{query}", label=label)
+            self.conn.rollback()
+
+    def _check_query(self, query: str, *, label: str) -> None:
+        with self.conn.cursor() as cur:
+            # we only care about the parsers, not whether the hints can actually be satisfied
+            cur.execute("SET pglab.check_final_path = off")
+
+            cur.execute("SET pglab.hint_parser = 'antlr'")
+            antlr_plan = core.explain_plan(query, cur)
+
+            cur.execute("SET pglab.hint_parser = 'native'")
+            native_plan = core.explain_plan(query, cur)
+
+        self.assertPlansEqual(
+            antlr_plan,
+            native_plan,
+            msg=f"Parsers disagree for query {label}\n\n{query}",
+        )
+        self.assertEqual(antlr_plan["Plan Rows"], native_plan["Plan Rows"])
+        self.assertEqual(antlr_plan["Total Cost"], native_plan["Total Cost"])
+
+    def _parse_hints(self, hint_block: str, *, parser: str) -> str:
+        with self.conn.cursor() as cur:
+            cur.execute(f"SET pglab.hint_parser = '{parser}'")
+            cur.execute("SELECT pg_lab_parse_hints(%s)", (hint_block,))
+            return cur.fetchone()[0]
+
+
+class JoinTreeBuild(core.PostgresTestCase):
+    query = """
+        SELECT count(*)
+        FROM posts p
+        JOIN users u ON p.owneruserid = u.id
+        JOIN badges b ON u.id = b.userid
+        JOIN comments c ON c.postid = p.id
+    """
+
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_join_prefix_above_geqo_threshold(self) -> None:
+        # the collapsed prefix and the remaining two relations still need GEQO
+        self._check_join_prefix(geqo_threshold=2, direct_join_build=True)
+
+    def test_join_prefix_without_direct_build(self) -> None:
+        self._check_join_prefix(geqo_threshold=12, direct_join_build=False)
+
+    def test_join_prefix_covers_all_rels(self) -> None:
+        hints = "/*=pg_lab= JoinPrefix((((b u) p) c)) */"
+        with self.conn.cursor() as cur:
+            plan = core.explain_plan(f"{hints}\n{self.query}", cur)
+
+        self.assertEqual(core.determine_join_order(plan), "(((b u) p) c)")
+
+    def test_bushy_join_order_above_geqo_threshold(self) -> None:
+        # bushy join orders cannot be expressed as a GEQO tour and must be built directly, even if this is disabled
+        hints = "/*=pg_lab= JoinOrder(((p c) (u b))) */"
+        with self.conn.cursor() as cur:
+            cur.execute("SET geqo_threshold = 2")
+            cur.execute("SET pglab.direct_join_build = off")
+            plan = core.explain_plan(f"{hints}\n{self.query}", cur)
+
+        self.assertEqual(core.determine_join_order(plan), "((p c) (u b))")
+
+    def _check_join_prefix(self, *, geqo_threshold: int, direct_join_build: bool) -> None:
+        hints = "/*=pg_lab= JoinPrefix((b u)) */"
+        with self.conn.cursor() as cur:
+            cur.execute(f"SET geqo_threshold = {geqo_threshold}")
+            cur.execute(f"SET pglab.direct_join_build = {'on' if direct_join_build else 'off'}")
+            plan = core.explain_plan(f"{hints}\n{self.query}", cur)
+
+        core._build_intermediates(plan)
+        self.assertTrue(
+            self._has_subtree(plan, {"b", "u"}),
+            f"Join prefix is not a subtree of the plan: {core.determine_join_order(plan)}",
+        )
+
+    def _has_subtree(self, plan: dict, rels: set[str]) -> bool:
+        if len(plan.get("Plans", [])) == 2 and set(plan["Intermediates"]) == rels:
+            return True
+        return any(self._has_subtree(child, rels) for child in plan.get("Plans", []))
+
+
+class JoinEnumeration(core.PostgresTestCase):
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+        self.workload = _load_workload()
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_dpccp_plan_equivalence(self) -> None:
+        for label, query in self.workload.items():
+            with self.subTest(label=label):
+                self._check_query(query, label=label)
+            self.conn.rollback()
+
+    def _check_query(self, query: str, *, label: str) -> None:
+        with self.conn.cursor() as cur:
+            # make sure that we compare against the exhaustive dynamic programming
+            cur.execute("SET geqo_threshold = 20")
+
+            cur.execute("SET pglab.join_enumerator = 'standard'")
+            standard_plan = core.explain_plan(query, cur)
+
+            cur.execute("SET pglab.join_enumerator = 'dpccp'")
+            dpccp_plan = core.explain_plan(query, cur)
+
+        self.assertAlmostEqual(
+            standard_plan["Total Cost"],
+            dpccp_plan["Total Cost"],
+            places=2,
+            msg=f"DPccp did not find the optimal plan for query {label}",
+        )
+        self.assertPlansEqual(
+            standard_plan,
+            dpccp_plan,
+            msg=f"Plans differ for query {label}\n\n{query}",
+        )
+
+
+class PlannerStatistics(core.PostgresTestCase):
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_hinted_query(self) -> None:
+        query = """
+            /*=pg_lab=
+              JoinOrder((p u))
+              HashJoin(p u)
+             */
+            SELECT count(*)
+            FROM posts p
+            JOIN users u ON p.owneruserid = u.id;
+        """
+
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute("SET pglab.track_planner_stats = on;")
+            cur.execute("SELECT pg_lab_reset_planner_stats();")
+            cur.execute(query)
+            cur.execute("""
+                SELECT query, add_path_calls, accepted_paths,
+                       rejected_join_order + rejected_operators
+                FROM pg_lab_planner_stats()
+                WHERE hinted
+                ORDER BY statement_no DESC
+                LIMIT 1;
+            """)
+            hinted_query, add_path_calls, accepted, rejected = cur.fetchone()
+
+        self.assertIn("JoinOrder((p u))", hinted_query)
+        self.assertGreater(add_path_calls, 0)
+        self.assertGreater(accepted, 0)
+        self.assertGreater(rejected, 0)
+
+    def test_explain_stats(self) -> None:
+        if self.conn.info.server_version < 180000:
+            self.skipTest("EXPLAIN (PGLAB_STATS) requires PG 18")
+
+        query = """
+            /*=pg_lab= JoinOrder((p u)) HashJoin(p u) */
+            SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id
+        """
+        with self.conn.cursor() as cur:
+            cur.execute("SET pglab.track_planner_stats = off")
+            cur.execute(f"EXPLAIN (PGLAB_STATS, FORMAT JSON) {query}")
+            explain_json = cur.fetchone()[0][0]
+
+        stats = explain_json["pg_lab Planner Stats"]
+        self.assertGreater(stats["pg_lab Add Path Calls"], 0)
+        self.assertGreater(stats["pg_lab Accepted Paths"], 0)
+        self.assertGreater(stats["pg_lab Rejected Join Order"] + stats["pg_lab Rejected Operators"], 0)
+
+    def test_hint_stats(self) -> None:
+        query = """
+            /*=pg_lab=
+              HashJoin(p u)
+             */
+            SELECT count(*)
+            FROM posts p
+            JOIN users u ON p.owneruserid = u.id;
+        """
+
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute("SELECT pg_lab_reset_hint_stats();")
+            cur.execute(query)
+            cur.execute(query)
+            cur.execute("""
+                SELECT calls, check_failures, fallbacks
+                FROM pg_lab_hint_stats
+                WHERE hint_block LIKE '%HashJoin(p u)%';
+            """)
+            calls, failures, fallbacks = cur.fetchone()
+
+        self.assertEqual(calls, 2)
+        self.assertEqual(failures, 0)
+        self.assertEqual(fallbacks, 0)
+
+
+class CostHinting(core.PostgresTestCase):
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_cost_hints_with_conflicting_join_order(self) -> None:
+        # The cost hints make the (u p) join order very attractive, but the join order hint must still win.
+        query = """
+            /*=pg_lab=
+              JoinOrder((p u))
+              Material(p (Cost(Start=0 Total=0.01)))
+              Sort(p (Cost(Start=0 Total=0.01)))
+              Sort(u (Cost(Start=0 Total=0.01)))
+              Gather(p u (Cost(Start=0 Total=0.01)))
+             */
+            SELECT count(*)
+            FROM posts p
+            JOIN users u ON p.owneruserid = u.id;
+        """
+
+        with self.conn.cursor() as cur:
+            cur.execute("SET pglab.check_final_path = on")
+            try:
+                plan = core.explain_plan(query, cur)
+            except psycopg.errors.InternalError as e:
+                self.fail(f"Cost hints invalidated the join order hint: {e}")
+
+        self.assertEqual(core.determine_join_order(plan), "(p u)")
+
+    def test_sort_costs(self) -> None:
+        query = """
+            /*=pg_lab= Sort(u (Cost(Start=42 Total=4242))) */
+            SELECT * FROM users u ORDER BY u.reputation
+        """
+        self._check_node_costs(query, "Sort", startup=42, total=4242)
+
+    def test_incremental_sort_costs(self) -> None:
+        query = """
+            /*=pg_lab= IdxScan(u) IncrementalSort(u (Cost(Start=1 Total=42))) */
+            SELECT * FROM users u ORDER BY u.id, u.reputation
+        """
+        self._check_node_costs(query, "Incremental Sort", startup=1, total=42)
+
+    def test_material_costs(self) -> None:
+        # Material paths are costed lazily once they become the inner input of a nested loop
+        query = """
+            /*=pg_lab= JoinOrder((p u)) NestLoop(p u) SeqScan(p) SeqScan(u) Material(u (Cost(Start=0 Total=1))) */
+            SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id
+        """
+        self._check_node_costs(query, "Materialize", startup=0, total=1)
+
+    def test_memoize_costs(self) -> None:
+        # Memo costs are rescan costs, which do not show up in the plan directly. Instead, they make the nested loop cheaper.
+        query = """
+            /*=pg_lab= JoinOrder((p u)) NestLoop(p u) SeqScan(p) IdxScan(u) {memo} */
+            SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id
+        """
+        with self.conn.cursor() as cur:
+            native_plan = core.explain_plan(query.format(memo="Memo(u)"), cur)
+            hinted_plan = core.explain_plan(query.format(memo="Memo(u (Cost(Start=0 Total=0)))"), cur)
+
+        native_join = self._find_node(native_plan, "Nested Loop")
+        hinted_join = self._find_node(hinted_plan, "Nested Loop")
+        self.assertIsNotNone(self._find_node(hinted_plan, "Memoize"))
+        self.assertLess(hinted_join["Total Cost"], native_join["Total Cost"])
+
+    def test_gather_costs(self) -> None:
+        query = """
+            /*=pg_lab= SeqScan(p (workers=2)) Gather(p (Cost(Start=10 Total=420))) */
+            SELECT * FROM posts p WHERE p.score > 10
+        """
+        self._check_node_costs(query, "Gather", startup=10, total=420)
+
+    def test_gather_merge_costs(self) -> None:
+        query = """
+            /*=pg_lab= SeqScan(p (workers=2)) GatherMerge(p (Cost(Start=10 Total=420))) */
+            SELECT * FROM posts p ORDER BY p.score
+        """
+        self._check_node_costs(query, "Gather Merge", startup=10, total=420)
+
+    def test_append_costs(self) -> None:
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE TEMP TABLE measurements (id int, val int) PARTITION BY RANGE (id)")
+            cur.execute("CREATE TEMP TABLE measurements_1 PARTITION OF measurements FOR VALUES FROM (0) TO (1000)")
+            cur.execute("CREATE TEMP TABLE measurements_2 PARTITION OF measurements FOR VALUES FROM (1000) TO (2000)")
+            cur.execute("INSERT INTO measurements SELECT i, i FROM generate_series(0, 1999) i")
+            cur.execute("ANALYZE measurements")
+
+        query = """
+            /*=pg_lab= Append(m (Cost(Start=4 Total=42))) */
+            SELECT * FROM measurements m
+        """
+        self._check_node_costs(query, "Append", startup=4, total=42)
+
+    def _check_node_costs(self, query: str, node_type: str, *, startup: float, total: float) -> None:
+        with self.conn.cursor() as cur:
+            plan = core.explain_plan(query, cur)
+
+        node = self._find_node(plan, node_type)
+        self.assertIsNotNone(node, f"No {node_type} node in plan {plan}")
+        self.assertAlmostEqual(node["Startup Cost"], startup, places=2)
+        self.assertAlmostEqual(node["Total Cost"], total, places=2)
+
+    def _find_node(self, plan: dict, node_type: str) -> Optional[dict]:
+        if plan["Node Type"] == node_type:
+            return plan
+        for child in plan.get("Plans", []):
+            node = self._find_node(child, node_type)
+            if node is not None:
+                return node
+        return None
+
+
+class PlanCacheHinting(core.PostgresTestCase):
+    query = """
+        SELECT count(*)
+        FROM posts p
+        JOIN users u ON p.owneruserid = u.id
+        WHERE u.reputation > $1
+    """
+
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+
+    def tearDown(self):
+        try:
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_generic_plan(self) -> None:
+        generic_plans, custom_plans = self._execute_prepared("generic")
+        self.assertGreater(generic_plans, 0)
+        self.assertEqual(custom_plans, 0)
+
+    def test_custom_plan(self) -> None:
+        # Postgres would switch to a generic plan after 5 executions if it is not more expensive than the custom plans
+        generic_plans, custom_plans = self._execute_prepared("custom")
+        self.assertEqual(generic_plans, 0)
+        self.assertEqual(custom_plans, 10)
+
+    def test_malformed_hints(self) -> None:
+        # prepared statements are not transactional, so a failed PREPARE must not store the statement in the first place
+        with self.conn.cursor() as cur:
+            cur.execute("SET pglab.hint_parser = 'native'")
+            with self.assertRaises(psycopg.errors.SyntaxError):
+                cur.execute(f"PREPARE q(int) AS /*=pg_lab= Config(plan_cache=generic) IndexScan(u) */ {self.query}")
+        self.conn.rollback()
+
+        with self.conn.cursor() as cur:
+            cur.execute("SELECT count(*) FROM pg_prepared_statements WHERE name = 'q'")
+            self.assertEqual(cur.fetchone()[0], 0)
+
+    def _execute_prepared(self, plan_cache: str) -> tuple[int, int]:
+        with self.conn.cursor() as cur:
+            cur.execute("SET plan_cache_mode = auto")
+            cur.execute(
+                f"PREPARE q(int) AS /*=pg_lab= Config(plan_cache={plan_cache}) HashJoin(p u) */ {self.query}"
+            )
+            for _ in range(10):
+                cur.execute("EXECUTE q(100)")
+            cur.execute(
+                "SELECT generic_plans, custom_plans FROM pg_prepared_statements WHERE name = 'q'"
+            )
+            generic_plans, custom_plans = cur.fetchone()
+            cur.execute("DEALLOCATE q")
+        return generic_plans, custom_plans
+
+
+class HintPinning(core.PostgresTestCase):
+    query = "SELECT count(*) FROM posts p JOIN users u ON p.owneruserid = u.id"
+    pinned_hints = "/*=pg_lab= JoinOrder((p u)) NestLoop(p u) */"
+
+    def setUp(self) -> None:
+        _init_db()
+        self.conn = psycopg.connect(dbname=DB_NAME, host="localhost")
+        with self.conn.cursor() as cur:
+            cur.execute("CREATE EXTENSION IF NOT EXISTS pg_lab;")
+            cur.execute(f"EXPLAIN (VERBOSE, FORMAT JSON) {self.query}")
+            self.queryid = cur.fetchone()[0][0]["Query Identifier"]
+        self.conn.commit()
+
+    def tearDown(self):
+        try:
+            self.conn.rollback()
+            with self.conn.cursor() as cur:
+                cur.execute("SELECT pg_lab_unpin_hints(%s);", (self.queryid,))
+            self.conn.commit()
+            self.conn.close()
+        except psycopg.DatabaseError:
+            pass
+
+    def test_pinned_hints(self) -> None:
+        with self.conn.cursor() as cur:
+            cur.execute("SELECT pg_lab_pin_hints(%s, %s);", (self.queryid, self.pinned_hints))
+        self.conn.commit()
+
+        with self.conn.cursor() as cur:
+            pinned_plan = core.explain_plan(self.query, cur)
+
+            # an explicit hint block takes precedence over the pinned one
+            hinted_plan = core.explain_plan(f"/*=pg_lab= HashJoin(p u) */\n{self.query}", cur)
+
+        self.assertEqual(self._join_operator(pinned_plan), "Nested Loop")
+        self.assertEqual(self._join_operator(hinted_plan), "Hash Join")
+
+    def test_unpin_hints(self) -> None:
+        with self.conn.cursor() as cur:
+            native_plan = core.explain_plan(self.query, cur)
+            cur.execute("SELECT pg_lab_pin_hints(%s, %s);", (self.queryid, self.pinned_hints))
+            self.conn.commit()
+
+            cur.execute("SELECT pg_lab_unpin_hints(%s);", (self.queryid,))
+            self.conn.commit()
+            unpinned_plan = core.explain_plan(self.query, cur)
+
+        self.assertPlansEqual(native_plan, unpinned_plan)
+
+    def test_rollback(self) -> None:
+        with self.conn.cursor() as cur:
+            native_plan = core.explain_plan(self.query, cur)
+            cur.execute("SELECT pg_lab_pin_hints(%s, %s);", (self.queryid, self.pinned_hints))
+            self.conn.rollback()
+
+            cur.execute("SELECT count(*) FROM pg_lab_pinned_hints WHERE queryid = %s;", (self.queryid,))
+            (n_pinned,) = cur.fetchone()
+            rollback_plan = core.explain_plan(self.query, cur)
+
+        self.assertEqual(n_pinned, 0)
+        self.assertPlansEqual(native_plan, rollback_plan)
+
+    def test_prepare_transaction(self) -> None:
+        with self.conn.cursor() as cur:
+            native_plan = core.explain_plan(self.query, cur)
+            cur.execute("SELECT pg_lab_pin_hints(%s, %s);", (self.queryid, self.pinned_hints))
+
+            # the pending pins cannot survive the PREPARE, hence it must be rejected (before max_prepared_transactions
+            # is even checked)
+            with self.assertRaises(psycopg.errors.FeatureNotSupported):
+                cur.execute("PREPARE TRANSACTION 'pglab_pin_test';")
+            self.conn.rollback()
+
+            # the next transaction must not see (or apply) any leftovers of the failed one
+            cur.execute("SELECT count(*) FROM pg_lab_pinned_hints WHERE queryid = %s;", (self.queryid,))
+            (n_pinned,) = cur.fetchone()
+            self.conn.commit()
+            prepared_plan = core.explain_plan(self.query, cur)
+
+        self.assertEqual(n_pinned, 0)
+        self.assertPlansEqual(native_plan, prepared_plan)
+
+    def test_load_pinned_hints(self) -> None:
+        with self.conn.cursor() as cur:
+            cur.execute("SELECT pg_lab_pin_hints(%s, %s);", (self.queryid, self.pinned_hints))
+            self.conn.commit()
+
+            cur.execute("SELECT pg_lab_load_pinned_hints();")
+            self.conn.commit()
+            pinned_plan = core.explain_plan(self.query, cur)
+
+        self.assertEqual(self._join_operator(pinned_plan), "Nested Loop")
+
+    def _join_operator(self, plan: dict) -> str:
+        while plan["Node Type"] not in ("Nested Loop", "Hash Join", "Merge Join"):
+            plan = plan["Plans"][0]
+        return plan["Node Type"]
+
+
 class RegressionTests(core.PostgresTestCase):
     def setUp(self) -> None:
         _init_db()